@@ -20,7 +20,7 @@ const std::function<void(const std::string&)> G_TEST_LOG_FUN{};
 
 void benchmark::ConsolePrinter::header()
 {
-    std::cout << "# Benchmark, evals, iterations, total, min, max, median" << std::endl;
+    std::cout << "# Benchmark, evals, iterations, total, min, max, median, items/min" << std::endl;
 }
 
 void benchmark::ConsolePrinter::result(const State& state)
@@ -46,7 +46,11 @@ void benchmark::ConsolePrinter::result(const State& state)
     }
 
     std::cout << std::setprecision(6);
-    std::cout << state.m_name << ", " << state.m_num_evals << ", " << state.m_num_iters << ", " << total << ", " << front << ", " << back << ", " << median << std::endl;
+    std::cout << state.m_name << ", " << state.m_num_evals << ", " << state.m_num_iters << ", " << total << ", " << front << ", " << back << ", " << median << ", ";
+    if (state.m_items_per_iteration > 0 && median > 0) {
+        std::cout << state.m_items_per_iteration * 60 / median;
+    }
+    std::cout << std::endl;
 }
 
 void benchmark::ConsolePrinter::footer() {}
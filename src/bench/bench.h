@@ -62,6 +62,8 @@ public:
     const uint64_t m_num_evals;
     std::vector<double> m_elapsed_results;
     time_point m_start_time;
+    //! Work items (e.g. hashes) done per iteration, reported as a rate when set
+    uint64_t m_items_per_iteration{0};
 
     bool UpdateTimer(time_point finish_time);
 
@@ -10,6 +10,8 @@
 #include <streams.h>
 #include <consensus/validation.h>
 
+#include <boost/thread/thread.hpp>
+
 // These are the two major time-sinks which happen after we have fully received
 // a block off the wire, but before we can relay the block on to peers using
 // compact block relay.
@@ -48,5 +50,45 @@ static void DeserializeAndCheckBlockTest(benchmark::State& state)
     }
 }
 
+// The context-free checks alone, with the transactions checked on the
+// calling thread, then on block check threads next to the merkle root.
+static void CheckBlockTest(benchmark::State& state, int threads)
+{
+    CDataStream stream(benchmark::data::block413567, SER_NETWORK, PROTOCOL_VERSION);
+    CBlock block;
+    stream >> block;
+
+    const auto chainParams = CreateChainParams(CBaseChainParams::MAIN);
+
+    boost::thread_group tg;
+    for (int i = 0; i < threads; i++) {
+        tg.create_thread([i]() { return ThreadBlockCheck(i); });
+    }
+    g_parallel_script_checks = threads > 0;
+
+    while (state.KeepRunning()) {
+        block.fChecked = false;
+        BlockValidationState validationState;
+        bool checked = CheckBlock(block, validationState, chainParams->GetConsensus());
+        assert(checked);
+    }
+
+    g_parallel_script_checks = false;
+    tg.interrupt_all();
+    tg.join_all();
+}
+
+static void CheckBlockSerialTest(benchmark::State& state)
+{
+    CheckBlockTest(state, 0);
+}
+
+static void CheckBlockParallelTest(benchmark::State& state)
+{
+    CheckBlockTest(state, 3);
+}
+
 BENCHMARK(DeserializeBlockTest, 130);
 BENCHMARK(DeserializeAndCheckBlockTest, 160);
+BENCHMARK(CheckBlockSerialTest, 160);
+BENCHMARK(CheckBlockParallelTest, 160);
@@ -0,0 +1,106 @@
+// Copyright (c) 2020 The Vericonomy developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <chain.h>
+#include <clientversion.h>
+#include <coins.h>
+#include <fs.h>
+#include <pos.h>
+#include <primitives/block.h>
+#include <primitives/transaction.h>
+#include <streams.h>
+
+#include <vector>
+
+static const int COIN_AGE_CHAIN_LENGTH = 2000;
+static const int COIN_AGE_INPUTS = 100;
+
+/** A block index chain, and a coinstake-like transaction spending coins created along it */
+struct CoinAgeSetup
+{
+    std::vector<CBlockIndex> chain;
+    CCoinsView coinsDummy;
+    CCoinsViewCache view;
+    std::vector<CMutableTransaction> prevTxs;
+    CMutableTransaction spend;
+
+    CoinAgeSetup() : chain(COIN_AGE_CHAIN_LENGTH), view(&coinsDummy)
+    {
+        for (int i = 0; i < COIN_AGE_CHAIN_LENGTH; i++) {
+            chain[i].pprev = i ? &chain[i - 1] : nullptr;
+            chain[i].nHeight = i;
+            chain[i].nTime = 1472669240 + i * 600;
+            chain[i].BuildSkip();
+            UpdateStakeWeightStats(&chain[i]);
+        }
+
+        for (int i = 0; i < COIN_AGE_INPUTS; i++) {
+            const CBlockIndex& block = chain[i * (COIN_AGE_CHAIN_LENGTH / 2) / COIN_AGE_INPUTS];
+            CMutableTransaction tx;
+            tx.nTime = block.nTime;
+            tx.vin.resize(1);
+            tx.vin[0].prevout.n = i;
+            tx.vout.resize(1);
+            tx.vout[0].nValue = (i + 1) * COIN;
+            tx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+            view.AddCoin(COutPoint(tx.GetHash(), 0), Coin(tx.vout[0], block.nHeight, false, false, tx.nTime), false);
+            prevTxs.push_back(tx);
+            spend.vin.emplace_back(COutPoint(tx.GetHash(), 0));
+        }
+        spend.nTime = chain.back().nTime + 60;
+        spend.vout.resize(1);
+    }
+};
+
+// Coin age from the UTXO set and the block index, as staking and coinstake
+// validation compute it.
+static void CoinAgeFromCoins(benchmark::State& state)
+{
+    CoinAgeSetup setup;
+    const CTransaction tx(setup.spend);
+    uint64_t nCoinAge;
+    state.m_items_per_iteration = COIN_AGE_INPUTS;
+    while (state.KeepRunning()) {
+        bool success = GetCoinAge(tx, setup.view, nCoinAge, &setup.chain.back());
+        assert(success);
+    }
+}
+
+// What GetCoinAge() used to do per input on top of the above, once -txindex
+// had located the previous transaction: open its block file and read the
+// block header and the transaction back. The index lookup itself is left out.
+static void CoinAgeFromDisk(benchmark::State& state)
+{
+    CoinAgeSetup setup;
+    const fs::path path = fs::temp_directory_path() / fs::unique_path();
+    std::vector<long> offsets;
+    {
+        CAutoFile file(fsbridge::fopen(path, "wb"), SER_DISK, CLIENT_VERSION);
+        file << CBlockHeader();
+        const long nHeaderEnd = ftell(file.Get());
+        for (const CMutableTransaction& tx : setup.prevTxs) {
+            offsets.push_back(ftell(file.Get()) - nHeaderEnd);
+            file << tx;
+        }
+    }
+
+    const CTransaction tx(setup.spend);
+    state.m_items_per_iteration = COIN_AGE_INPUTS;
+    while (state.KeepRunning()) {
+        for (size_t i = 0; i < tx.vin.size(); i++) {
+            CAutoFile file(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+            CBlockHeader header;
+            CTransactionRef txPrev;
+            file >> header;
+            fseek(file.Get(), offsets[i], SEEK_CUR);
+            file >> txPrev;
+            assert(txPrev->GetHash() == tx.vin[i].prevout.hash);
+        }
+    }
+    fs::remove(path);
+}
+
+BENCHMARK(CoinAgeFromCoins, 5000);
+BENCHMARK(CoinAgeFromDisk, 50);
@@ -0,0 +1,56 @@
+// Copyright (c) 2020 The Vericonomy developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <arith_uint256.h>
+#include <bench/bench.h>
+#include <bignum.h>
+#include <consensus/params.h>
+#include <pow.h>
+#include <uint256.h>
+
+static const unsigned int RETARGET_BITS = 0x1d0a3f4c;
+// Two day timespan at 60 second blocks, after a 95 second block
+static const int64_t RETARGET_MULTIPLIER = (2 * 24 * 60 - 1) * 60 + 2 * 95;
+static const int64_t RETARGET_DIVISOR = (2 * 24 * 60 + 1) * 60;
+
+// Retargeting with fixed-size integers, as GetNextWorkRequired() and
+// GetNextTargetRequired() do it for every header.
+static void RetargetArith(benchmark::State& state)
+{
+    const arith_uint256 bnLimit = ~arith_uint256(0) >> 11;
+    while (state.KeepRunning()) {
+        ScaleCompactTarget(RETARGET_BITS, RETARGET_MULTIPLIER, RETARGET_DIVISOR, bnLimit, false);
+    }
+}
+
+// The same with the OpenSSL bignums it used before.
+static void RetargetBigNum(benchmark::State& state)
+{
+    const CBigNum bnLimit(ArithToUint256(~arith_uint256(0) >> 11));
+    while (state.KeepRunning()) {
+        CBigNum bnNew;
+        bnNew.SetCompact(RETARGET_BITS);
+        bnNew *= RETARGET_MULTIPLIER;
+        bnNew /= RETARGET_DIVISOR;
+        if (bnNew > bnLimit)
+            bnNew = bnLimit;
+        bnNew.GetCompact();
+    }
+}
+
+// The target range and hash check of every proof-of-work header.
+static void CheckProofOfWorkTarget(benchmark::State& state)
+{
+    Consensus::Params params;
+    params.powLimit = ~arith_uint256(0) >> 11;
+    const uint256 hash = ArithToUint256(arith_uint256().SetCompact(RETARGET_BITS) >> 1);
+    while (state.KeepRunning()) {
+        bool success = CheckProofOfWork(hash, RETARGET_BITS, params);
+        assert(success);
+    }
+}
+
+BENCHMARK(RetargetArith, 500 * 1000);
+BENCHMARK(RetargetBigNum, 500 * 1000);
+BENCHMARK(CheckProofOfWorkTarget, 500 * 1000);
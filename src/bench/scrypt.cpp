@@ -0,0 +1,117 @@
+// Copyright (c) 2020 The Vericonomy developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <crypto/scrypt.h>
+#include <primitives/block.h>
+#include <uint256.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+static CBlockHeader ScryptHeader()
+{
+    CBlockHeader header;
+    header.nVersion = 1;
+    header.nTime = 1472669240;
+    header.nBits = 0x1e0fffff;
+    header.nNonce = 1;
+    return header;
+}
+
+// Per-block PoW check as it was done before: a fresh scratchpad for every header.
+static void ScryptHashFreshScratchpad(benchmark::State& state)
+{
+    const CBlockHeader header = ScryptHeader();
+    uint256 hash;
+    state.m_items_per_iteration = 1;
+    while (state.KeepRunning()) {
+        unsigned char* scratchbuf = (unsigned char*)malloc(SCRYPT_SCRATCHPAD_SIZE);
+        scryptHash(&header.nVersion, (char*)hash.begin(), scratchbuf);
+        free(scratchbuf);
+    }
+}
+
+// Per-block PoW check through GetWorkHash(), reusing a scratchpad from the pool.
+static void ScryptHashReusedScratchpad(benchmark::State& state)
+{
+    const CBlockHeader header = ScryptHeader();
+    state.m_items_per_iteration = 1;
+    while (state.KeepRunning()) {
+        header.GetWorkHash();
+    }
+}
+
+// The single-way kernel, with a caller-provided scratchpad.
+static void ScryptHash(benchmark::State& state)
+{
+    const CBlockHeader header = ScryptHeader();
+    ScryptScratchpad scratchpad(1);
+    uint256 hash;
+    state.m_items_per_iteration = 1;
+    while (state.KeepRunning()) {
+        scryptHash(&header.nVersion, (char*)hash.begin(), scratchpad.data());
+    }
+}
+
+// Mapping a one-lane scratchpad and faulting in its pages, which a hash pays
+// for whenever its scratchpad is not reused.
+static void ScryptScratchpadAlloc(benchmark::State& state)
+{
+    while (state.KeepRunning()) {
+        ScryptScratchpad scratchpad(1);
+        unsigned char* data = scratchpad.data();
+        for (size_t i = 0; i < (size_t)SCRYPT_SCRATCHPAD_SIZE; i += 4096)
+            data[i] = 1;
+    }
+}
+
+// One batch of as many headers as the kernel of a given throughput hashes at
+// once. Kernels the CPU lacks fall back to narrower ones, see scryptHashBatch().
+static void ScryptHashBatch(benchmark::State& state, int throughput)
+{
+    std::vector<CBlockHeader> headers(throughput, ScryptHeader());
+    std::vector<unsigned char> input(throughput * 80);
+    for (int i = 0; i < throughput; i++) {
+        headers[i].nNonce = i;
+        memcpy(&input[i * 80], &headers[i].nVersion, 80);
+    }
+    std::vector<uint256> hashes(throughput);
+    state.m_items_per_iteration = throughput;
+    while (state.KeepRunning()) {
+        scryptHashBatch(input.data(), (char*)hashes.data(), throughput, throughput);
+    }
+}
+
+static void ScryptHashBatch3Way(benchmark::State& state) { ScryptHashBatch(state, 3); }
+static void ScryptHashBatch12Way(benchmark::State& state) { ScryptHashBatch(state, 12); }
+static void ScryptHashBatch16Way(benchmark::State& state) { ScryptHashBatch(state, 16); }
+static void ScryptHashBatch24Way(benchmark::State& state) { ScryptHashBatch(state, 24); }
+
+// The miner's inner loop: one call hashes scrypt_best_throughput() nonces.
+static void ScryptHashMulti(benchmark::State& state)
+{
+    CBlockHeader header = ScryptHeader();
+    // An impossible target, so every call runs through all of its nonces
+    const uint256 target;
+    unsigned char* scratchbuf = scrypt_buffer_alloc();
+    int hashes_done = 0;
+    state.m_items_per_iteration = scrypt_best_throughput();
+    while (state.KeepRunning()) {
+        scrypt_N_1_1_256_multi(&header.nVersion, target, &hashes_done, scratchbuf);
+        header.nNonce += hashes_done;
+    }
+    free(scratchbuf);
+}
+
+BENCHMARK(ScryptHashFreshScratchpad, 1);
+BENCHMARK(ScryptHashReusedScratchpad, 1);
+BENCHMARK(ScryptHash, 1);
+BENCHMARK(ScryptScratchpadAlloc, 20);
+BENCHMARK(ScryptHashBatch3Way, 1);
+BENCHMARK(ScryptHashBatch12Way, 1);
+BENCHMARK(ScryptHashBatch16Way, 1);
+BENCHMARK(ScryptHashBatch24Way, 1);
+BENCHMARK(ScryptHashMulti, 1);
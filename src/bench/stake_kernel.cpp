@@ -0,0 +1,41 @@
+// Copyright (c) 2020 The Vericonomy developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <arith_uint256.h>
+#include <bench/bench.h>
+#include <pos.h>
+#include <primitives/transaction.h>
+#include <random.h>
+
+#include <vector>
+
+static const int STAKE_KERNEL_CANDIDATES = 1000;
+
+// One timestamp tried against the outputs of a wallet, as each staker thread
+// does for its share of them: the kernel data of every output is serialized
+// once, so a try is one double SHA256 and a comparison.
+static void StakeKernelSearch(benchmark::State& state)
+{
+    FastRandomContext rand(true);
+    std::vector<CStakeKernelData> vKernels;
+    std::vector<arith_uint256> vTargets;
+    for (int i = 0; i < STAKE_KERNEL_CANDIDATES; i++) {
+        vKernels.emplace_back(rand.rand64(), 1500000000, COutPoint(rand.rand256(), i), 1500000000);
+        vTargets.push_back(arith_uint256().SetCompact(0x1d00ffff) * (1 + rand.randrange(1000)));
+    }
+
+    unsigned int nTimeTx = 1600000000;
+    uint64_t nFound = 0;
+    state.m_items_per_iteration = STAKE_KERNEL_CANDIDATES;
+    while (state.KeepRunning()) {
+        for (size_t i = 0; i < vKernels.size(); i++) {
+            if (UintToArith256(vKernels[i].GetHash(nTimeTx)) <= vTargets[i])
+                nFound++;
+        }
+        nTimeTx++;
+    }
+    assert(nFound < (uint64_t)STAKE_KERNEL_CANDIDATES * (nTimeTx - 1600000000));
+}
+
+BENCHMARK(StakeKernelSearch, 500);
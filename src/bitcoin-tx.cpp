@@ -595,7 +595,7 @@ static void MutateTxSign(CMutableTransaction& tx, const std::string& flagStr)
                 if (prevOut.exists("amount")) {
                     newcoin.out.nValue = AmountFromValue(prevOut["amount"]);
                 }
-                newcoin.nHeight = 1;
+                newcoin.SetHeight(1);
                 view.AddCoin(out, std::move(newcoin), true);
             }
 
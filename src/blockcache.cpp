@@ -0,0 +1,79 @@
+// Copyright (c) 2020 The Vericonomy developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockcache.h>
+
+#include <core_memusage.h>
+#include <memusage.h>
+
+CBlockCache g_block_cache(DEFAULT_BLOCK_CACHE_SIZE << 20);
+
+/** The memory a cached block takes, with its list and index nodes */
+static size_t BlockCacheUsage(const CBlock& block)
+{
+    return memusage::MallocUsage(sizeof(CBlock)) + RecursiveDynamicUsage(block) + memusage::DynamicUsage(block.vchBlockSig) +
+        memusage::MallocUsage(sizeof(std::pair<uint256, std::shared_ptr<const CBlock>>) + 3 * sizeof(void*)) +
+        memusage::MallocUsage(sizeof(uint256) + 2 * sizeof(void*));
+}
+
+CBlockCache::CBlockCache(size_t max_usage) : m_max_usage(max_usage) {}
+
+std::shared_ptr<const CBlock> CBlockCache::Get(const uint256& hash)
+{
+    LOCK(m_mutex);
+    auto it = m_index.find(hash);
+    if (it == m_index.end()) {
+        m_misses++;
+        return nullptr;
+    }
+    m_hits++;
+    m_entries.splice(m_entries.begin(), m_entries, it->second);
+    return it->second->second.block;
+}
+
+void CBlockCache::Insert(const uint256& hash, const std::shared_ptr<const CBlock>& block)
+{
+    const size_t usage = BlockCacheUsage(*block);
+    LOCK(m_mutex);
+    if (usage > m_max_usage)
+        return;
+
+    auto it = m_index.find(hash);
+    if (it != m_index.end()) {
+        m_entries.splice(m_entries.begin(), m_entries, it->second);
+        return;
+    }
+    Shrink(m_max_usage - usage);
+    m_entries.emplace_front(hash, Entry{block, usage});
+    m_index.emplace(hash, m_entries.begin());
+    m_usage += usage;
+}
+
+void CBlockCache::SetMaxUsage(size_t max_usage)
+{
+    LOCK(m_mutex);
+    m_max_usage = max_usage;
+    Shrink(max_usage);
+}
+
+void CBlockCache::Clear()
+{
+    LOCK(m_mutex);
+    Shrink(0);
+}
+
+CBlockCache::Stats CBlockCache::GetStats() const
+{
+    LOCK(m_mutex);
+    return Stats{m_hits, m_misses, m_entries.size(), m_usage, m_max_usage};
+}
+
+void CBlockCache::Shrink(size_t max_usage)
+{
+    while (m_usage > max_usage) {
+        m_usage -= m_entries.back().second.usage;
+        m_index.erase(m_entries.back().first);
+        m_entries.pop_back();
+    }
+}
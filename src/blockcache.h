@@ -0,0 +1,86 @@
+// Copyright (c) 2020 The Vericonomy developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKCACHE_H
+#define BITCOIN_BLOCKCACHE_H
+
+#include <crypto/common.h>
+#include <primitives/block.h>
+#include <sync.h>
+#include <uint256.h>
+
+#include <stdint.h>
+
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+
+/** Default for -blockcachesize, in MiB */
+static const int64_t DEFAULT_BLOCK_CACHE_SIZE = 32;
+
+/**
+ * The blocks most recently read from disk or connected, by hash, so that
+ * RPC, REST, the indexes and peers asking for the same blocks share one
+ * deserialized copy instead of each reading and hashing it again.
+ *
+ * Blocks are accounted by their memory usage, and the least recently used
+ * ones are dropped when the total goes over the limit. The data of a block
+ * never changes for its hash, so an entry never goes stale.
+ */
+class CBlockCache
+{
+public:
+    struct Stats {
+        uint64_t hits;
+        uint64_t misses;
+        size_t entries;
+        size_t usage;
+        size_t max_usage;
+    };
+
+    explicit CBlockCache(size_t max_usage);
+
+    CBlockCache(const CBlockCache&) = delete;
+    CBlockCache& operator=(const CBlockCache&) = delete;
+
+    //! The block with this hash, or nullptr when it is not cached
+    std::shared_ptr<const CBlock> Get(const uint256& hash);
+    //! Keep a block as the most recently used one, unless it is larger than the whole cache
+    void Insert(const uint256& hash, const std::shared_ptr<const CBlock>& block);
+    //! Change the limit, dropping blocks until the cache fits in it. 0 disables the cache.
+    void SetMaxUsage(size_t max_usage);
+    void Clear();
+    Stats GetStats() const;
+
+private:
+    struct Hasher
+    {
+        size_t operator()(const uint256& hash) const { return ReadLE64(hash.begin()); }
+    };
+
+    struct Entry
+    {
+        std::shared_ptr<const CBlock> block;
+        size_t usage;
+    };
+
+    //! Most recently used first
+    typedef std::list<std::pair<uint256, Entry>> EntryList;
+
+    mutable Mutex m_mutex;
+    EntryList m_entries GUARDED_BY(m_mutex);
+    std::unordered_map<uint256, EntryList::iterator, Hasher> m_index GUARDED_BY(m_mutex);
+    size_t m_usage GUARDED_BY(m_mutex){0};
+    size_t m_max_usage GUARDED_BY(m_mutex);
+    uint64_t m_hits GUARDED_BY(m_mutex){0};
+    uint64_t m_misses GUARDED_BY(m_mutex){0};
+
+    void Shrink(size_t max_usage) EXCLUSIVE_LOCKS_REQUIRED(m_mutex);
+};
+
+/** Blocks shared by all readers of the block files, sized by -blockcachesize */
+extern CBlockCache g_block_cache;
+
+#endif // BITCOIN_BLOCKCACHE_H
@@ -119,6 +119,12 @@ void CBlockIndex::BuildSkip()
         pskip = pprev->GetAncestor(GetSkipHeight(nHeight));
 }
 
+void CBlockIndex::BuildLastBlockIndex()
+{
+    pindexLastPoS = (IsProofOfStake() || !pprev) ? this : pprev->pindexLastPoS;
+    pindexLastPoW = (IsProofOfWork() || !pprev) ? this : pprev->pindexLastPoW;
+}
+
 arith_uint256 GetBlockTrust(const CBlockIndex& block)
 {
     arith_uint256 bnTarget;
@@ -173,7 +179,12 @@ const CBlockIndex* LastCommonAncestor(const CBlockIndex* pa, const CBlockIndex*
 // ppcoin: find last block index up to pindex
 const CBlockIndex* GetLastBlockIndex(const CBlockIndex* pindex, bool fProofOfStake)
 {
-    while (pindex && pindex->pprev && (pindex->IsProofOfStake() != fProofOfStake))
+    while (pindex && pindex->pprev && (pindex->IsProofOfStake() != fProofOfStake)) {
+        // Walk only entries that are not in the block index, and so have no pointers built
+        const CBlockIndex* pindexLast = fProofOfStake ? pindex->pindexLastPoS : pindex->pindexLastPoW;
+        if (pindexLast)
+            return pindexLast;
         pindex = pindex->pprev;
+    }
     return pindex;
 }
@@ -129,6 +129,8 @@ enum BlockStatus: uint32_t {
     BLOCK_FAILED_MASK        =   BLOCK_FAILED_VALID | BLOCK_FAILED_CHILD,
 
     BLOCK_OPT_WITNESS       =   128, //!< block data in blk*.data was received with a witness-enforcing client
+
+    BLOCK_POW_VERIFIED      =   256, //!< scrypt proof of work checked, hashWork holds the work hash
 };
 
 /** The block chain is a tree shaped structure starting with the
@@ -182,6 +184,10 @@ public:
     uint32_t nBits{0};
     uint32_t nNonce{0};
 
+    //! Verium: scrypt work hash of the header, valid only if BLOCK_POW_VERIFIED is set.
+    //! Stored under its own key next to the index entry, see CBlockTreeDB::WriteBatchSync()
+    uint256 hashWork{};
+
     //! (memory only) Sequential id assigned to distinguish order in which blocks are received.
     int32_t nSequenceId{0};
 
@@ -207,6 +213,17 @@ public:
     unsigned int nStakeTime{0};
     uint256 hashProofOfStake{};
 
+    //! (memory only) Vericoin: this block or its nearest proof-of-stake and proof-of-work ancestors,
+    //! the genesis block if there is none. Set by BuildLastBlockIndex(), see GetLastBlockIndex()
+    const CBlockIndex* pindexLastPoS{nullptr};
+    const CBlockIndex* pindexLastPoW{nullptr};
+
+    //! (memory only) Vericoin: stake kernels tried per second over the last 72 proof-of-stake blocks up to and including this block
+    double dKernelPS{0};
+
+    //! (memory only) Vericoin: average of dKernelPS over the last 60 blocks up to and including this block, plus 21
+    double dAverageStakeWeight{0};
+
     bool IsProofOfWork() const
     {
         return !(nFlags & BLOCK_PROOF_OF_STAKE);
@@ -372,6 +389,10 @@ public:
     //! Build the skiplist pointer for this entry.
     void BuildSkip();
 
+    //! Build the last proof-of-stake and proof-of-work pointers for this entry. Needs the block type
+    //! and, if there is one, the predecessor's pointers.
+    void BuildLastBlockIndex();
+
     //! Efficiently find an ancestor of this block.
     CBlockIndex* GetAncestor(int height);
     const CBlockIndex* GetAncestor(int height) const;
@@ -514,6 +535,7 @@ public:
     CBlockIndex* FindEarliestAtLeast(int64_t nTime, int height) const;
 };
 
+/** Return pindex or its nearest ancestor of the given type, the genesis block if there is none */
 const CBlockIndex* GetLastBlockIndex(const CBlockIndex* pindex, bool fProofOfStake);
 
 #endif // BITCOIN_CHAIN_H
@@ -87,6 +87,9 @@ public:
         // By default assume that the signatures in ancestors of this block are valid.
         consensus.defaultAssumeValid = uint256S("0x0000000000000000000000000000000000000000000000000000000000000000"); // 623950
 
+        // By default assume that the proof of work of ancestors of this block is valid.
+        consensus.defaultAssumeValidPow = uint256S("0x0000000000000000000000000000000000000000000000000000000000000000");
+
         /**
         * The message start string is designed to be unlikely to occur in normal data.
         * The characters are rarely used upper ASCII, not valid as UTF-8, and produce
@@ -207,6 +210,9 @@ public:
             assert(consensus.hashGenesisBlock == uint256S("0x8232c0cf3bd7e05546e3d7aaaaf89fed8bc97c4df1a8c95e9249e13a2734932b"));
             assert(genesis.hashMerkleRoot == uint256S("0x925e430072a1f39b530fc79db162e29433ab0ea266a99c8cab4f03001dc9faa9"));
 
+            // Skip hashing the scrypt proof of work below the last checkpoint.
+            consensus.defaultAssumeValidPow = uint256S("0x0510c6cb8c5a2a5437fb893853f10e298654361a05cf611b1c54c1750dfbdad6"); // 100000
+
             vSeeds.emplace_back("seed.vrm.vericonomy.com");
 
             vFixedSeeds = std::vector<SeedSpec6>(pnSeed6_vrm_main, pnSeed6_vrm_main + ARRAYLEN(pnSeed6_vrm_main));
@@ -7,6 +7,7 @@
 #include <consensus/consensus.h>
 #include <logging.h>
 #include <random.h>
+#include <util/memory.h>
 #include <version.h>
 
 bool CCoinsView::GetCoin(const COutPoint &outpoint, Coin &coin) const { return false; }
@@ -33,7 +34,10 @@ size_t CCoinsViewBacked::EstimateSize() const { return base->EstimateSize(); }
 
 SaltedOutpointHasher::SaltedOutpointHasher() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
 
-CCoinsViewCache::CCoinsViewCache(CCoinsView *baseIn) : CCoinsViewBacked(baseIn), cachedCoinsUsage(0) {}
+CCoinsViewCache::CCoinsViewCache(CCoinsView *baseIn) : CCoinsViewBacked(baseIn),
+    m_cache_coins_memory_resource(MakeUnique<PoolResource>(COINS_MAP_POOL_BLOCK_SIZE)),
+    cacheCoins(0, SaltedOutpointHasher(), std::equal_to<COutPoint>(), CCoinsMapAllocator(m_cache_coins_memory_resource.get())),
+    cachedCoinsUsage(0) {}
 
 size_t CCoinsViewCache::DynamicMemoryUsage() const {
     return memusage::DynamicUsage(cacheCoins) + cachedCoinsUsage;
@@ -97,6 +101,14 @@ void AddCoins(CCoinsViewCache& cache, const CTransaction &tx, int nHeight, bool
     }
 }
 
+void CCoinsViewCache::AddFetchedCoin(const COutPoint& outpoint, Coin&& coin) {
+    if (coin.IsSpent())
+        return;
+    auto inserted = cacheCoins.emplace(std::piecewise_construct, std::forward_as_tuple(outpoint), std::forward_as_tuple(std::move(coin)));
+    if (inserted.second)
+        cachedCoinsUsage += inserted.first->second.coin.DynamicMemoryUsage();
+}
+
 bool CCoinsViewCache::SpendCoin(const COutPoint &outpoint, Coin* moveout) {
     CCoinsMap::iterator it = FetchCoin(outpoint);
     if (it == cacheCoins.end()) return false;
@@ -205,10 +217,31 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlockIn
 bool CCoinsViewCache::Flush() {
     bool fOk = base->BatchWrite(cacheCoins, hashBlock);
     cacheCoins.clear();
+    ReallocateCache();
     cachedCoinsUsage = 0;
     return fOk;
 }
 
+std::unique_ptr<CCoinsBatch> CCoinsViewCache::TakeBatch() {
+    const size_t usage = DynamicMemoryUsage();
+    std::unique_ptr<PoolResource> memory_resource = std::move(m_cache_coins_memory_resource);
+    std::unique_ptr<CCoinsBatch> batch = MakeUnique<CCoinsBatch>(nullptr, std::move(cacheCoins), hashBlock, usage);
+    // The moved from map still refers to the old pool, so it is rebuilt
+    // before the batch, and the thread that writes it, own that pool
+    ReallocateCache();
+    batch->memory_resource = std::move(memory_resource);
+    cachedCoinsUsage = 0;
+    return batch;
+}
+
+void CCoinsViewCache::ReallocateCache()
+{
+    cacheCoins.clear();
+    cacheCoins.~CCoinsMap();
+    m_cache_coins_memory_resource = MakeUnique<PoolResource>(COINS_MAP_POOL_BLOCK_SIZE);
+    ::new (&cacheCoins) CCoinsMap(0, SaltedOutpointHasher(), std::equal_to<COutPoint>(), CCoinsMapAllocator(m_cache_coins_memory_resource.get()));
+}
+
 void CCoinsViewCache::Uncache(const COutPoint& hash)
 {
     CCoinsMap::iterator it = cacheCoins.find(hash);
@@ -12,14 +12,19 @@
 #include <crypto/siphash.h>
 #include <memusage.h>
 #include <serialize.h>
+#include <support/allocators/pool.h>
 #include <uint256.h>
 
 #include <assert.h>
 #include <stdint.h>
 
 #include <functional>
+#include <memory>
 #include <unordered_map>
 
+/** Fake height value used in Coin to signify they are only in the memory pool (since 0.8) */
+static const uint32_t MEMPOOL_HEIGHT = 0x7FFFFFFF;
+
 /**
  * A UTXO entry.
  *
@@ -29,6 +34,9 @@
  */
 class Coin
 {
+    //! nHeight value standing for MEMPOOL_HEIGHT, which does not fit in 30 bits
+    static const uint32_t MEMPOOL_HEIGHT_CODE = (1U << 30) - 1;
+
 public:
     //! unspent transaction output
     CTxOut out;
@@ -36,31 +44,46 @@ public:
     //! whether containing transaction was a coinbase
     unsigned int fCoinBase : 1;
 
-    //! at which height this containing transaction was included in the active block chain
-    uint32_t nHeight : 31;
+    // peercoin: whether transaction is a coinstake. Kept in the same word
+    // as the height, so that it adds no padding to every cached coin.
+    unsigned int fCoinStake : 1;
 
-    // peercoin: whether transaction is a coinstake
-    bool fCoinStake;
+private:
+    //! at which height this containing transaction was included in the active
+    //! block chain, see GetHeight()
+    uint32_t nHeight : 30;
 
+public:
     // peercoin: transaction timestamp
-    unsigned int nTime;
+    uint32_t nTime;
 
     //! construct a Coin from a CTxOut and height/coinbase information.
     Coin(CTxOut&& outIn, int nHeightIn, bool fCoinBaseIn, bool fCoinStakeIn, int nTimeIn) :
-        out(std::move(outIn)), fCoinBase(fCoinBaseIn), nHeight(nHeightIn), fCoinStake(fCoinStakeIn), nTime(nTimeIn) {}
+        out(std::move(outIn)), fCoinBase(fCoinBaseIn), fCoinStake(fCoinStakeIn), nTime(nTimeIn) { SetHeight(nHeightIn); }
     Coin(const CTxOut& outIn, int nHeightIn, bool fCoinBaseIn, bool fCoinStakeIn, int nTimeIn) :
-        out(outIn), fCoinBase(fCoinBaseIn), nHeight(nHeightIn), fCoinStake(fCoinStakeIn), nTime(nTimeIn) {}
+        out(outIn), fCoinBase(fCoinBaseIn), fCoinStake(fCoinStakeIn), nTime(nTimeIn) { SetHeight(nHeightIn); }
 
     void Clear() {
         out.SetNull();
         fCoinBase = false;
-        nHeight = 0;
         fCoinStake = false;
+        nHeight = 0;
         nTime = 0;
     }
 
     //! empty constructor
-    Coin() : fCoinBase(false), nHeight(0), fCoinStake(false), nTime(0) { }
+    Coin() : fCoinBase(false), fCoinStake(false), nHeight(0), nTime(0) { }
+
+    //! at which height this containing transaction was included in the active
+    //! block chain, or MEMPOOL_HEIGHT for a coin of the memory pool
+    int GetHeight() const {
+        return nHeight == MEMPOOL_HEIGHT_CODE ? MEMPOOL_HEIGHT : nHeight;
+    }
+
+    void SetHeight(uint32_t nHeightIn) {
+        assert(nHeightIn < MEMPOOL_HEIGHT_CODE || nHeightIn == MEMPOOL_HEIGHT);
+        nHeight = nHeightIn == MEMPOOL_HEIGHT ? MEMPOOL_HEIGHT_CODE : nHeightIn;
+    }
 
     bool IsCoinBase() const {
         return fCoinBase;
@@ -73,7 +96,7 @@ public:
     template<typename Stream>
     void Serialize(Stream &s) const {
         assert(!IsSpent());
-        uint32_t code = nHeight * uint32_t{2} + fCoinBase;
+        uint32_t code = GetHeight() * uint32_t{2} + fCoinBase;
         ::Serialize(s, VARINT(code));
         ::Serialize(s, Using<TxOutCompression>(out));
         // peercoin flags
@@ -87,7 +110,9 @@ public:
     void Unserialize(Stream &s) {
         uint32_t code = 0;
         ::Unserialize(s, VARINT(code));
-        nHeight = code >> 1;
+        if ((code >> 1) >= MEMPOOL_HEIGHT_CODE)
+            throw std::ios_base::failure("Coin height out of range");
+        SetHeight(code >> 1);
         fCoinBase = code & 1;
         ::Unserialize(s, Using<TxOutCompression>(out));
         // peercoin flags
@@ -153,7 +178,19 @@ struct CCoinsCacheEntry
     explicit CCoinsCacheEntry(Coin&& coin_) : coin(std::move(coin_)), flags(0) {}
 };
 
-typedef std::unordered_map<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher> CCoinsMap;
+typedef PoolAllocator<std::pair<const COutPoint, CCoinsCacheEntry>> CCoinsMapAllocator;
+
+/**
+ * The largest block the pool of a CCoinsMap hands out: a node of the map, with
+ * room for the pointers and hash standard libraries keep next to the element.
+ */
+static constexpr size_t COINS_MAP_POOL_BLOCK_SIZE = sizeof(std::pair<const COutPoint, CCoinsCacheEntry>) + 4 * sizeof(void*);
+
+/**
+ * Maps built with a CCoinsMapAllocator on a PoolResource keep their nodes in
+ * the chunks of the pool rather than in one heap allocation each.
+ */
+typedef std::unordered_map<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher, std::equal_to<COutPoint>, CCoinsMapAllocator> CCoinsMap;
 
 /** Cursor for iterating over CoinsView state */
 class CCoinsViewCursor
@@ -231,6 +268,25 @@ public:
 };
 
 
+/**
+ * The contents of a CCoinsViewCache, handed over by TakeBatch() to be written
+ * to its base view later. The entries live in the batch's own pool, so the
+ * batch may be read by several threads, and written and destroyed on another
+ * one, while the cache it came from goes on.
+ */
+struct CCoinsBatch
+{
+    //! Where the nodes of coins live; declared first so it outlives them
+    std::unique_ptr<PoolResource> memory_resource;
+    const CCoinsMap coins;
+    const uint256 hashBlock;
+    //! Memory usage of the cache when it was handed over
+    const size_t usage;
+
+    CCoinsBatch(std::unique_ptr<PoolResource> memory_resource_in, CCoinsMap&& coins_in, const uint256& hashBlock_in, size_t usage_in) :
+        memory_resource(std::move(memory_resource_in)), coins(std::move(coins_in)), hashBlock(hashBlock_in), usage(usage_in) {}
+};
+
 /** CCoinsView that adds a memory cache for transactions to another CCoinsView */
 class CCoinsViewCache : public CCoinsViewBacked
 {
@@ -240,6 +296,8 @@ protected:
      * declared as "const".
      */
     mutable uint256 hashBlock;
+    //! Where the nodes of cacheCoins live; declared first so it outlives them
+    std::unique_ptr<PoolResource> m_cache_coins_memory_resource;
     mutable CCoinsMap cacheCoins;
 
     /* Cached dynamic memory usage for the inner Coin objects. */
@@ -288,6 +346,13 @@ public:
      */
     void AddCoin(const COutPoint& outpoint, Coin&& coin, bool potential_overwrite);
 
+    /**
+     * Add a coin that was read from the backing view elsewhere, e.g. by the
+     * input prefetcher, exactly as FetchCoin() would have cached it. Does
+     * nothing if the outpoint is already cached or the coin is spent.
+     */
+    void AddFetchedCoin(const COutPoint& outpoint, Coin&& coin);
+
     /**
      * Spend a coin. Pass moveto in order to get the deleted data.
      * If no unspent output exists for the passed outpoint, this call
@@ -302,6 +367,13 @@ public:
      */
     bool Flush();
 
+    /**
+     * Hand everything Flush() would push to the base over to a batch instead,
+     * and start over empty. Until the batch is written, the base must answer
+     * reads from it, as CCoinsViewBackgroundFlush does.
+     */
+    std::unique_ptr<CCoinsBatch> TakeBatch();
+
     /**
      * Removes the UTXO with the given outpoint from the cache, if it is
      * not modified.
@@ -333,6 +405,12 @@ private:
      * memory usage.
      */
     CCoinsMap::iterator FetchCoin(const COutPoint &outpoint) const;
+
+    /**
+     * Replace the empty, or moved from, cacheCoins and its pool with new
+     * ones, giving the memory the pool held back to the system.
+     */
+    void ReallocateCache();
 };
 
 //! Utility function to add all of a transaction's outputs to a cache.
@@ -45,6 +45,8 @@ struct Params {
     int64_t nPowTargetSpacing;
     uint256 nMinimumChainWork;
     uint256 defaultAssumeValid;
+    /** By default assume that the proof of work of the ancestors of this block is valid */
+    uint256 defaultAssumeValidPow;
 
     /** **/
     int nTargetTimespan;
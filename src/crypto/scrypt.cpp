@@ -29,9 +29,25 @@
 
 #include "scrypt.h"
 #include "compat.h"
+#include "compat/cpuid.h"
+#include "tinyformat.h"
 #include <stdlib.h>
 #include <string.h>
 #include <inttypes.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#ifndef WIN32
+#include <sys/mman.h>
+// Some systems (at least OS X) only define the deprecated MAP_ANON
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+#endif
 
 static const uint32_t sha256_h[8] = {
     0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
@@ -549,14 +565,398 @@ static inline void PBKDF2_SHA256_128_32_8way(uint32_t *tstate,
 
 #endif /* HAVE_SHA256_8WAY */
 
+#ifdef HAVE_SHA256_16WAY
+
+static const uint32_t finalblk_16way[16 * 16] __attribute__((aligned(64))) = {
+	0x00000001, 0x00000001, 0x00000001, 0x00000001, 0x00000001, 0x00000001, 0x00000001, 0x00000001, 0x00000001, 0x00000001, 0x00000001, 0x00000001, 0x00000001, 0x00000001, 0x00000001, 0x00000001,
+	0x80000000, 0x80000000, 0x80000000, 0x80000000, 0x80000000, 0x80000000, 0x80000000, 0x80000000, 0x80000000, 0x80000000, 0x80000000, 0x80000000, 0x80000000, 0x80000000, 0x80000000, 0x80000000,
+	0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000,
+	0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000,
+	0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000,
+	0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000,
+	0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000,
+	0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000,
+	0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000,
+	0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000,
+	0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000,
+	0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000,
+	0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000,
+	0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000,
+	0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000,
+	0x00000620, 0x00000620, 0x00000620, 0x00000620, 0x00000620, 0x00000620, 0x00000620, 0x00000620, 0x00000620, 0x00000620, 0x00000620, 0x00000620, 0x00000620, 0x00000620, 0x00000620, 0x00000620
+};
+
+static inline void HMAC_SHA256_80_init_16way(const uint32_t *key,
+	uint32_t *tstate, uint32_t *ostate)
+{
+	uint32_t ihash[16 * 8] __attribute__((aligned(64)));
+	uint32_t pad[16 * 16] __attribute__((aligned(64)));
+	int i;
+	
+	/* tstate is assumed to contain the midstate of key */
+	memcpy(pad, key + 16 * 16, 16 * 16);
+	for (i = 0; i < 16; i++)
+		pad[16 * 4 + i] = 0x80000000;
+	memset(pad + 16 * 5, 0x00, 16 * 40);
+	for (i = 0; i < 16; i++)
+		pad[16 * 15 + i] = 0x00000280;
+	scrypt_avx512::sha256_transform_16way(tstate, pad, 0);
+	memcpy(ihash, tstate, 16 * 32);
+	
+	scrypt_avx512::sha256_init_16way(ostate);
+	for (i = 0; i < 16 * 8; i++)
+		pad[i] = ihash[i] ^ 0x5c5c5c5c;
+	for (; i < 16 * 16; i++)
+		pad[i] = 0x5c5c5c5c;
+	scrypt_avx512::sha256_transform_16way(ostate, pad, 0);
+	
+	scrypt_avx512::sha256_init_16way(tstate);
+	for (i = 0; i < 16 * 8; i++)
+		pad[i] = ihash[i] ^ 0x36363636;
+	for (; i < 16 * 16; i++)
+		pad[i] = 0x36363636;
+	scrypt_avx512::sha256_transform_16way(tstate, pad, 0);
+}
+
+static inline void PBKDF2_SHA256_80_128_16way(const uint32_t *tstate,
+	const uint32_t *ostate, const uint32_t *salt, uint32_t *output)
+{
+	uint32_t istate[16 * 8] __attribute__((aligned(64)));
+	uint32_t ostate2[16 * 8] __attribute__((aligned(64)));
+	uint32_t ibuf[16 * 16] __attribute__((aligned(64)));
+	uint32_t obuf[16 * 16] __attribute__((aligned(64)));
+	int i, j;
+	
+	memcpy(istate, tstate, 16 * 32);
+	scrypt_avx512::sha256_transform_16way(istate, salt, 0);
+	
+	memcpy(ibuf, salt + 16 * 16, 16 * 16);
+	for (i = 0; i < 16; i++)
+		ibuf[16 * 5 + i] = 0x80000000;
+	memset(ibuf + 16 * 6, 0x00, 16 * 36);
+	for (i = 0; i < 16; i++)
+		ibuf[16 * 15 + i] = 0x000004a0;
+	
+	for (i = 0; i < 16; i++)
+		obuf[16 * 8 + i] = 0x80000000;
+	memset(obuf + 16 * 9, 0x00, 16 * 24);
+	for (i = 0; i < 16; i++)
+		obuf[16 * 15 + i] = 0x00000300;
+	
+	for (i = 0; i < 4; i++) {
+		memcpy(obuf, istate, 16 * 32);
+		for (j = 0; j < 16; j++)
+			ibuf[16 * 4 + j] = i + 1;
+		scrypt_avx512::sha256_transform_16way(obuf, ibuf, 0);
+		
+		memcpy(ostate2, ostate, 16 * 32);
+		scrypt_avx512::sha256_transform_16way(ostate2, obuf, 0);
+		for (j = 0; j < 16 * 8; j++)
+			output[16 * 8 * i + j] = swab32(ostate2[j]);
+	}
+}
+
+static inline void PBKDF2_SHA256_128_32_16way(uint32_t *tstate,
+	uint32_t *ostate, const uint32_t *salt, uint32_t *output)
+{
+	uint32_t buf[16 * 16] __attribute__((aligned(64)));
+	int i;
+	
+	scrypt_avx512::sha256_transform_16way(tstate, salt, 1);
+	scrypt_avx512::sha256_transform_16way(tstate, salt + 16 * 16, 1);
+	scrypt_avx512::sha256_transform_16way(tstate, finalblk_16way, 0);
+	
+	memcpy(buf, tstate, 16 * 32);
+	for (i = 0; i < 16; i++)
+		buf[16 * 8 + i] = 0x80000000;
+	memset(buf + 16 * 9, 0x00, 16 * 24);
+	for (i = 0; i < 16; i++)
+		buf[16 * 15 + i] = 0x00000300;
+	scrypt_avx512::sha256_transform_16way(ostate, buf, 0);
+	
+	for (i = 0; i < 16 * 8; i++)
+		output[i] = swab32(ostate[i]);
+}
+
+#endif /* HAVE_SHA256_16WAY */
+
 #ifndef SCRYPT_MAX_WAYS
 #define SCRYPT_MAX_WAYS 1
-#define scrypt_best_throughput() 1
 #endif
 
+namespace {
+/** Hashes per scrypt_N_1_1_256_multi() call, selected by ScryptAutoDetect(). */
+int scrypt_throughput = 1;
+/** Lanes the selected scrypt core mixes at once; each one needs N * 128 bytes of scratchpad. */
+int scrypt_core_ways = 1;
+std::string scrypt_implementation = "standard(1way)";
+/** Throughputs of the kernels usable on this CPU, narrowest first. */
+std::vector<int> scrypt_throughputs{1};
+
+/** Memory the scratchpads of scryptHashBatch() may take together, see ScryptSetMemoryBudget(). */
+std::atomic<size_t> scrypt_memory_budget{(size_t)DEFAULT_SCRYPT_MEMORY << 20};
+
+/** Scratchpads of scryptHashBatch() shared by all threads, so that their total
+ *  stays within the memory budget however many threads hash at once. */
+std::mutex scratchpad_pool_mutex;
+std::condition_variable scratchpad_pool_cv;
+/** Scratchpads not in use, kept for the next batch until ScryptReleaseScratchpads(). */
+std::vector<std::unique_ptr<ScryptScratchpad>> scratchpad_pool;
+/** Lane memory of all the scratchpads allocated from the pool, in use or not. */
+size_t scratchpad_pool_usage = 0;
+
+#if defined(__x86_64__) && defined(USE_AVX2)
+/** Check whether the CPU supports AVX2 and the OS has enabled AVX registers. */
+bool AVX2Enabled()
+{
+    uint32_t eax, ebx, ecx, edx;
+    GetCPUID(1, 0, eax, ebx, ecx, edx);
+    bool have_xsave = (ecx >> 27) & 1;
+    bool have_avx = (ecx >> 28) & 1;
+    if (!have_xsave || !have_avx) return false;
+    GetCPUID(7, 0, eax, ebx, ecx, edx);
+    if (!((ebx >> 5) & 1)) return false;
+    uint32_t a, d;
+    __asm__("xgetbv" : "=a"(a), "=d"(d) : "c"(0));
+    return (a & 6) == 6;
+}
+#endif
+
+#if defined(HAVE_SCRYPT_16WAY)
+/** Check whether the CPU supports AVX-512F and the OS saves the opmask and ZMM registers. */
+bool AVX512FEnabled()
+{
+    uint32_t eax, ebx, ecx, edx;
+    GetCPUID(1, 0, eax, ebx, ecx, edx);
+    if (!((ecx >> 27) & 1)) return false;
+    GetCPUID(7, 0, eax, ebx, ecx, edx);
+    if (!((ebx >> 16) & 1)) return false;
+    uint32_t a, d;
+    __asm__("xgetbv" : "=a"(a), "=d"(d) : "c"(0));
+    return (a & 0xe6) == 0xe6;
+}
+#endif
+
+/** Lanes mixed at once by the scrypt core behind a given throughput. */
+int ScryptCoreWays(int throughput)
+{
+    switch (throughput) {
+    case 3:
+    case 12:
+        return 3;
+    case 16:
+        return 16;
+    case 24:
+        return 6;
+    default:
+        return 1;
+    }
+}
+
+/** Memory of the lanes of a scratchpad, without the alignment slack. */
+size_t ScratchpadLaneBytes(int ways)
+{
+    return (size_t)N * ways * 128;
+}
+
+/** Kernels scryptHashBatch() may use on count headers, widest first: no wider
+ *  than max_throughput or count, sharing one scratchpad, and with that
+ *  scratchpad within the memory budget. The single-way kernel is always usable. */
+std::vector<int> BatchKernels(int max_throughput, int count, int& ways_needed)
+{
+    const int max_ways = ScryptCoreWays(max_throughput);
+    const size_t budget = scrypt_memory_budget;
+    std::vector<int> kernels;
+    ways_needed = 1;
+    for (int throughput : scrypt_throughputs) {
+        const int ways = ScryptCoreWays(throughput);
+        if (throughput > 1 && (throughput > max_throughput || throughput > count || ways > max_ways))
+            continue;
+        if (ways > 1 && ScratchpadLaneBytes(ways) > budget)
+            continue;
+        kernels.insert(kernels.begin(), throughput);
+        ways_needed = std::max(ways_needed, ways);
+    }
+    return kernels;
+}
+
+/** Take a scratchpad of at least the given ways from the pool, waiting for other
+ *  threads to return theirs when a new one would go over the memory budget.
+ *  Returns nullptr when the allocation fails. */
+std::unique_ptr<ScryptScratchpad> AcquireScratchpad(int ways)
+{
+    const size_t size = ScratchpadLaneBytes(ways);
+    std::unique_lock<std::mutex> lock(scratchpad_pool_mutex);
+    while (true) {
+        for (auto it = scratchpad_pool.begin(); it != scratchpad_pool.end(); ++it) {
+            if ((*it)->Ways() >= ways) {
+                std::unique_ptr<ScryptScratchpad> scratchpad = std::move(*it);
+                scratchpad_pool.erase(it);
+                return scratchpad;
+            }
+        }
+        // Free scratchpads are all too narrow; drop them before waiting for room
+        if (scratchpad_pool_usage + size > scrypt_memory_budget && !scratchpad_pool.empty()) {
+            scratchpad_pool_usage -= ScratchpadLaneBytes(scratchpad_pool.back()->Ways());
+            scratchpad_pool.pop_back();
+            continue;
+        }
+        // A scratchpad larger than the budget is still allocated when none is in use
+        if (scratchpad_pool_usage + size <= scrypt_memory_budget || scratchpad_pool_usage == 0)
+            break;
+        scratchpad_pool_cv.wait(lock);
+    }
+    std::unique_ptr<ScryptScratchpad> scratchpad(new ScryptScratchpad(ways));
+    if (!scratchpad->data())
+        return nullptr;
+    scratchpad_pool_usage += size;
+    return scratchpad;
+}
+
+void ReturnScratchpad(std::unique_ptr<ScryptScratchpad> scratchpad)
+{
+    {
+        std::lock_guard<std::mutex> lock(scratchpad_pool_mutex);
+        scratchpad_pool.push_back(std::move(scratchpad));
+    }
+    scratchpad_pool_cv.notify_one();
+}
+} // namespace
+
+void ScryptSetMemoryBudget(size_t bytes)
+{
+    scrypt_memory_budget = bytes;
+}
+
+int ScryptBatchThroughput()
+{
+    int ways_needed;
+    return BatchKernels(scrypt_throughput, scrypt_throughput, ways_needed).front();
+}
+
+void ScryptReleaseScratchpads()
+{
+    std::lock_guard<std::mutex> lock(scratchpad_pool_mutex);
+    for (const auto& scratchpad : scratchpad_pool)
+        scratchpad_pool_usage -= ScratchpadLaneBytes(scratchpad->Ways());
+    scratchpad_pool.clear();
+}
+
+std::string ScryptAutoDetect()
+{
+    scrypt_throughput = 1;
+    scrypt_core_ways = 1;
+    scrypt_implementation = "standard(1way)";
+    scrypt_throughputs.assign(1, 1);
+
+#if defined(HAVE_SCRYPT_3WAY)
+    scrypt_throughput = 3;
+    scrypt_core_ways = 3;
+    scrypt_implementation = "3way";
+    scrypt_throughputs.push_back(3);
+#endif
+
+#if defined(HAVE_SHA256_4WAY)
+    /* Also sets up the 4-way SHA256 transform; returns false when it would be slower. */
+    if (sha256_use_4way()) {
+        scrypt_throughput *= 4;
+        scrypt_implementation += strprintf(",sha256-4way(%dway)", scrypt_throughput);
+        scrypt_throughputs.push_back(scrypt_throughput);
+    }
+#endif
+
+#if defined(HAVE_SCRYPT_16WAY)
+    const bool have_16way = AVX512FEnabled();
+    if (have_16way)
+        scrypt_throughputs.push_back(16);
+#endif
+
+#if defined(HAVE_SCRYPT_6WAY) && defined(HAVE_SHA256_8WAY)
+    if (AVX2Enabled() && sha256_use_8way()) {
+        scrypt_throughput = 24;
+        scrypt_core_ways = 6;
+        scrypt_implementation = "avx2(6way),sha256-8way(24way)";
+        scrypt_throughputs.push_back(24);
+    }
+#endif
+
+#if defined(HAVE_SCRYPT_16WAY)
+    if (have_16way) {
+        scrypt_throughput = 16;
+        scrypt_core_ways = 16;
+        scrypt_implementation = "avx512(16way),sha256-16way(16way)";
+    }
+#endif
+
+    return scrypt_implementation;
+}
+
+std::vector<int> ScryptSupportedThroughputs()
+{
+    return scrypt_throughputs;
+}
+
+std::string GetScryptImplementation()
+{
+    return scrypt_implementation;
+}
+
+int scrypt_best_throughput()
+{
+    return scrypt_throughput;
+}
+
+size_t scrypt_buffer_size()
+{
+    return (size_t)N * scrypt_core_ways * 128 + 63;
+}
+
 unsigned char *scrypt_buffer_alloc()
 {
-    return (unsigned char*)malloc((size_t)N * SCRYPT_MAX_WAYS * 128 + 63);
+    return (unsigned char*)malloc(scrypt_buffer_size());
+}
+
+ScryptScratchpad::ScryptScratchpad(int ways) : m_ways(ways)
+{
+    m_size = (size_t)N * ways * 128 + 63;
+#ifndef WIN32
+    void *addr = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    /* Explicit huge pages only succeed when the administrator reserved some. */
+    static const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+    size_t huge_size = (m_size + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+    addr = mmap(nullptr, huge_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (addr != MAP_FAILED) {
+        m_size = huge_size;
+        m_huge_pages = true;
+    }
+#endif
+    if (addr == MAP_FAILED) {
+        addr = mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+#ifdef MADV_HUGEPAGE
+        /* Otherwise ask for transparent huge pages, to cut TLB misses in scrypt_core. */
+        if (addr != MAP_FAILED)
+            m_huge_pages = madvise(addr, m_size, MADV_HUGEPAGE) == 0;
+#endif
+    }
+    if (addr != MAP_FAILED) {
+        m_data = (unsigned char*)addr;
+        m_mapped = true;
+        return;
+    }
+#endif
+    m_data = (unsigned char*)malloc(m_size);
+}
+
+ScryptScratchpad::~ScryptScratchpad()
+{
+#ifndef WIN32
+    if (m_mapped) {
+        munmap(m_data, m_size);
+        return;
+    }
+#endif
+    free(m_data);
 }
 
 static void scrypt_N_1_1_256(const uint32_t *input, uint32_t *output, uint32_t *midstate, unsigned char *scratchpad)
@@ -594,7 +994,7 @@ static void scrypt_N_1_1_256_4way(const uint32_t *input,
 			W[4 * i + k] = input[k * 20 + i];
 	for (i = 0; i < 8; i++)
 		for (k = 0; k < 4; k++)
-			tstate[4 * i + k] = midstate[i];
+			tstate[4 * i + k] = midstate[k * 8 + i];
 	HMAC_SHA256_80_init_4way(W, tstate, ostate);
 	PBKDF2_SHA256_80_128_4way(tstate, ostate, W, W);
 	for (i = 0; i < 32; i++)
@@ -625,9 +1025,9 @@ static void scrypt_N_1_1_256_3way(const uint32_t *input,
 	
 	V = (uint32_t *)(((uintptr_t)(scratchpad) + 63) & ~ (uintptr_t)(63));
 
-	memcpy(tstate +  0, midstate, 32);
-	memcpy(tstate +  8, midstate, 32);
-	memcpy(tstate + 16, midstate, 32);
+	memcpy(tstate +  0, midstate +  0, 32);
+	memcpy(tstate +  8, midstate +  8, 32);
+	memcpy(tstate + 16, midstate + 16, 32);
 	HMAC_SHA256_80_init(input +  0, tstate +  0, ostate +  0);
 	HMAC_SHA256_80_init(input + 20, tstate +  8, ostate +  8);
 	HMAC_SHA256_80_init(input + 40, tstate + 16, ostate + 16);
@@ -662,7 +1062,7 @@ static void scrypt_N_1_1_256_12way(const uint32_t *input,
 	for (j = 0; j < 3; j++)
 		for (i = 0; i < 8; i++)
 			for (k = 0; k < 4; k++)
-				tstate[32 * j + 4 * i + k] = midstate[i];
+				tstate[32 * j + 4 * i + k] = midstate[(4 * j + k) * 8 + i];
 	HMAC_SHA256_80_init_4way(W +   0, tstate +  0, ostate +  0);
 	HMAC_SHA256_80_init_4way(W + 128, tstate + 32, ostate + 32);
 	HMAC_SHA256_80_init_4way(W + 256, tstate + 64, ostate + 64);
@@ -713,7 +1113,7 @@ static void scrypt_N_1_1_256_24way(const uint32_t *input,
 	for (j = 0; j < 3; j++)
 		for (i = 0; i < 8; i++)
 			for (k = 0; k < 8; k++)
-				tstate[8 * 8 * j + 8 * i + k] = midstate[i];
+				tstate[8 * 8 * j + 8 * i + k] = midstate[(8 * j + k) * 8 + i];
 	HMAC_SHA256_80_init_8way(W +   0, tstate +   0, ostate +   0);
 	HMAC_SHA256_80_init_8way(W + 256, tstate +  64, ostate +  64);
 	HMAC_SHA256_80_init_8way(W + 512, tstate + 128, ostate + 128);
@@ -742,6 +1142,35 @@ static void scrypt_N_1_1_256_24way(const uint32_t *input,
 }
 #endif /* HAVE_SCRYPT_6WAY */
 
+#ifdef HAVE_SCRYPT_16WAY
+static void scrypt_N_1_1_256_16way(const uint32_t *input,
+	uint32_t *output, uint32_t *midstate, unsigned char *scratchpad, int N)
+{
+	uint32_t tstate[16 * 8] __attribute__((aligned(64)));
+	uint32_t ostate[16 * 8] __attribute__((aligned(64)));
+	uint32_t W[16 * 32] __attribute__((aligned(64)));
+	uint32_t *V;
+	int i, k;
+	
+	V = (uint32_t *)(((uintptr_t)(scratchpad) + 63) & ~ (uintptr_t)(63));
+	
+	for (i = 0; i < 20; i++)
+		for (k = 0; k < 16; k++)
+			W[16 * i + k] = input[k * 20 + i];
+	for (i = 0; i < 8; i++)
+		for (k = 0; k < 16; k++)
+			tstate[16 * i + k] = midstate[k * 8 + i];
+	HMAC_SHA256_80_init_16way(W, tstate, ostate);
+	PBKDF2_SHA256_80_128_16way(tstate, ostate, W, W);
+	/* The 16-way core takes its input interleaved, as PBKDF2 leaves it. */
+	scrypt_avx512::scrypt_core_16way(W, V, N);
+	PBKDF2_SHA256_128_32_16way(tstate, ostate, W, W);
+	for (i = 0; i < 8; i++)
+		for (k = 0; k < 16; k++)
+			output[k * 8 + i] = W[16 * i + k];
+}
+#endif /* HAVE_SCRYPT_16WAY */
+
 bool fulltest(const uint32_t *hash, const uint32_t *target)
 {
 	int i;
@@ -757,34 +1186,9 @@ bool fulltest(const uint32_t *hash, const uint32_t *target)
 	return true;
 }
 
-bool scrypt_N_1_1_256_multi(void *input, uint256 hashTarget, int *nHashesDone, unsigned char *scratchbuf)
+/* Hash throughput headers at once; midstate holds one SHA256 midstate per lane. */
+static void scrypt_N_1_1_256_lanes(const uint32_t *data, uint32_t *dhash, uint32_t *midstate, unsigned char *scratchbuf, int throughput)
 {
-	uint32_t pdata[20];
-	uint32_t data[SCRYPT_MAX_WAYS * 20];
-	uint32_t dhash[SCRYPT_MAX_WAYS * 8];
-	uint32_t midstate[8];
-	uint32_t n;
-	int throughput = scrypt_best_throughput();
-	int i;
-
-	for (int i = 0; i < 20; i++)
-		pdata[i] = be32dec(&((const uint32_t *)input)[i]);
-	n = pdata[19];
-	
-#ifdef HAVE_SHA256_4WAY
-	if (sha256_use_4way())
-		throughput *= 4;
-#endif
-	
-	for (i = 0; i < throughput; i++)
-		memcpy(data + i * 20, pdata, 80);
-	
-	sha256_init(midstate);
-	sha256_transform(midstate, data, 0);
-	
-	for (i = 1; i < throughput; i++)
-		data[i * 20 + 19] = ++n;
-		
 #if defined(HAVE_SHA256_4WAY)
 	if (throughput == 4)
         scrypt_N_1_1_256_4way(data, dhash, midstate, scratchbuf, N);
@@ -795,6 +1199,11 @@ bool scrypt_N_1_1_256_multi(void *input, uint256 hashTarget, int *nHashesDone, u
         scrypt_N_1_1_256_12way(data, dhash, midstate, scratchbuf, N);
 	else
 #endif
+#if defined(HAVE_SCRYPT_16WAY)
+	if (throughput == 16)
+        scrypt_N_1_1_256_16way(data, dhash, midstate, scratchbuf, N);
+	else
+#endif
 #if defined(HAVE_SCRYPT_6WAY)
 	if (throughput == 24)
         scrypt_N_1_1_256_24way(data, dhash, midstate, scratchbuf, N);
@@ -806,6 +1215,35 @@ bool scrypt_N_1_1_256_multi(void *input, uint256 hashTarget, int *nHashesDone, u
 	else
 #endif
 		scrypt_N_1_1_256(data, dhash, midstate, scratchbuf);
+}
+
+bool scrypt_N_1_1_256_multi(void *input, uint256 hashTarget, int *nHashesDone, unsigned char *scratchbuf)
+{
+	uint32_t pdata[20];
+	uint32_t data[SCRYPT_MAX_WAYS * 20];
+	uint32_t dhash[SCRYPT_MAX_WAYS * 8];
+	uint32_t midstate[SCRYPT_MAX_WAYS * 8];
+	uint32_t n;
+	int throughput = scrypt_throughput;
+	int i;
+
+	for (int i = 0; i < 20; i++)
+		pdata[i] = be32dec(&((const uint32_t *)input)[i]);
+	n = pdata[19];
+	
+	for (i = 0; i < throughput; i++)
+		memcpy(data + i * 20, pdata, 80);
+	
+	/* The nonce is in the second SHA256 block, so all lanes share a midstate. */
+	sha256_init(midstate);
+	sha256_transform(midstate, data, 0);
+	for (i = 1; i < throughput; i++)
+		memcpy(midstate + i * 8, midstate, 32);
+	
+	for (i = 1; i < throughput; i++)
+		data[i * 20 + 19] = ++n;
+		
+	scrypt_N_1_1_256_lanes(data, dhash, midstate, scratchbuf, throughput);
 		
 	*nHashesDone = throughput;
 
@@ -818,15 +1256,78 @@ bool scrypt_N_1_1_256_multi(void *input, uint256 hashTarget, int *nHashesDone, u
 	return false;
 }
 
-void scryptHash(const void *input, char *output)
+bool scryptHashBatch(const void *input, char *output, int count)
+{
+    return scryptHashBatch(input, output, count, scrypt_throughput);
+}
+
+bool scryptHashBatch(const void *input, char *output, int count, int max_throughput)
+{
+    /* Narrower kernels fill the tail, as long as they fit in the same scratchpad. */
+    int ways_needed;
+    const std::vector<int> kernels = BatchKernels(max_throughput, count, ways_needed);
+
+    std::unique_ptr<ScryptScratchpad> scratchpad = AcquireScratchpad(ways_needed);
+    if (!scratchpad) {
+        memset(output, 0xff, (size_t)count * 32);
+        return false;
+    }
+
+    uint32_t data[SCRYPT_MAX_WAYS * 20];
+    uint32_t dhash[SCRYPT_MAX_WAYS * 8];
+    uint32_t midstate[SCRYPT_MAX_WAYS * 8];
+    const uint32_t *in = (const uint32_t *)input;
+    int done = 0;
+
+    while (done < count) {
+        /* Fill the widest kernel we can, then finish the tail with narrower ones. */
+        int ways = 1;
+        for (int throughput : kernels) {
+            if (count - done >= throughput) {
+                ways = throughput;
+                break;
+            }
+        }
+
+        for (int k = 0; k < ways; k++) {
+            for (int i = 0; i < 20; i++)
+                data[k * 20 + i] = be32dec(&in[(done + k) * 20 + i]);
+            sha256_init(midstate + k * 8);
+            sha256_transform(midstate + k * 8, data + k * 20, 0);
+        }
+
+        scrypt_N_1_1_256_lanes(data, dhash, midstate, scratchpad->data(), ways);
+        memcpy(output + (size_t)done * 32, dhash, (size_t)ways * 32);
+        done += ways;
+    }
+    ReturnScratchpad(std::move(scratchpad));
+    return true;
+}
+
+bool scryptHash(const void *input, char *output)
+{
+    /* Validation hashes one header at a time, so take a scratchpad from the
+     * pool instead of allocating 128 MB for every block. Giving it back right
+     * away keeps RPC and network threads from each holding one for life. */
+    std::unique_ptr<ScryptScratchpad> scratchpad = AcquireScratchpad(1);
+    if (!scratchpad) {
+        memset(output, 0xff, 32);
+        return false;
+    }
+    const bool ret = scryptHash(input, output, scratchpad->data());
+    ReturnScratchpad(std::move(scratchpad));
+    return ret;
+}
+
+bool scryptHash(const void *input, char *output, unsigned char *scratchbuf)
 {
     uint32_t midstate[8];
     uint32_t data[20];
-    unsigned char *scratchbuf = scrypt_buffer_alloc();
 
-    memset(output, 0, 32);
-    if (!scratchbuf)
-        return;
+    if (!scratchbuf) {
+        memset(output, 0xff, 32);
+        return false;
+    }
 
     for (int i = 0; i < 20; i++)
         data[i] = be32dec(&((const uint32_t *)input)[i]);
@@ -835,6 +1336,5 @@ void scryptHash(const void *input, char *output)
     sha256_transform(midstate, data, 0);
 
     scrypt_N_1_1_256(data, (uint32_t*)output, midstate, scratchbuf);
-
-    free(scratchbuf);
+    return true;
 }
@@ -1,6 +1,10 @@
 #ifndef SCRYPT_H
 #define SCRYPT_H
 
+#if defined(HAVE_CONFIG_H)
+#include "config/bitcoin-config.h"
+#endif
+
 #include "uint256.h"
 #include "compat/byteswap.h"
 #include "util/strencodings.h"
@@ -8,51 +12,123 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string>
+#include <vector>
 
 
 static const int SCRYPT_SCRATCHPAD_SIZE = 134218239;
 static const int N = 1048576;
+/** Default for -scryptmem, in MiB: enough for one scratchpad of the widest kernel */
+static const int64_t DEFAULT_SCRYPT_MEMORY = 2048;
+
+/** Autodetect the best available scrypt implementation for this CPU.
+ *  Returns the name of the implementation.
+ */
+std::string ScryptAutoDetect();
 
+/** Name of the scrypt implementation selected by ScryptAutoDetect(). */
+std::string GetScryptImplementation();
+
+/** Number of hashes computed by a single scrypt_N_1_1_256_multi() call. */
 int scrypt_best_throughput();
 
+/** Throughputs of the scrypt kernels usable on this CPU, narrowest first. */
+std::vector<int> ScryptSupportedThroughputs();
+
 bool scrypt_N_1_1_256_multi(void* input, uint256 hashTarget, int* nHashesDone, unsigned char* scratchbuf);
 
-void scryptHash(const void* input, char* output);
+/** Scrypt scratchpad large enough for a given number of lanes.
+ *  Backed by huge pages when the system provides them, and kept for the
+ *  lifetime of the object so it can be reused across hashes.
+ */
+class ScryptScratchpad
+{
+public:
+    explicit ScryptScratchpad(int ways = 1);
+    ~ScryptScratchpad();
+
+    ScryptScratchpad(const ScryptScratchpad&) = delete;
+    ScryptScratchpad& operator=(const ScryptScratchpad&) = delete;
+
+    unsigned char* data() const { return m_data; }
+    int Ways() const { return m_ways; }
+    bool IsHugePages() const { return m_huge_pages; }
+
+private:
+    int m_ways;
+    unsigned char* m_data = nullptr;
+    size_t m_size = 0;
+    bool m_mapped = false;
+    bool m_huge_pages = false;
+};
+
+/** Single-way scrypt hash of an 80-byte header, using a scratchpad from the pool of scryptHashBatch().
+ *  The scrypt hash functions return false when they have no scratchpad to
+ *  hash with, leaving the output all ones so it meets no target.
+ */
+bool scryptHash(const void* input, char* output);
+/** Single-way scrypt hash using a caller-provided scratchpad of at least SCRYPT_SCRATCHPAD_SIZE bytes. */
+bool scryptHash(const void* input, char* output, unsigned char* scratchbuf);
+/** Scrypt hash count 80-byte headers into count 32-byte hashes, using the
+ *  multi-way kernels selected by ScryptAutoDetect() and a scratchpad from a pool
+ *  shared by all threads. Blocks while the pool is at its memory budget.
+ */
+bool scryptHashBatch(const void* input, char* output, int count);
+/** Like scryptHashBatch(), but with kernels no wider than max_throughput, for tests and benchmarks. */
+bool scryptHashBatch(const void* input, char* output, int count, int max_throughput);
+/** Limit the memory the scratchpads of scryptHashBatch() take together. Kernels
+ *  whose scratchpad alone would not fit are not used, except the single-way one. */
+void ScryptSetMemoryBudget(size_t bytes);
+/** Widest kernel scryptHashBatch() uses within the memory budget, to size batches by. */
+int ScryptBatchThroughput();
+/** Free the scratchpads scryptHashBatch() keeps for reuse, once hashing goes idle. */
+void ScryptReleaseScratchpads();
 extern unsigned char* scrypt_buffer_alloc();
+/** Size of the buffers scrypt_buffer_alloc() returns, for the kernel picked by ScryptAutoDetect() */
+size_t scrypt_buffer_size();
 extern "C" void scrypt_core(uint32_t* X, uint32_t* V, int N);
 extern "C" void sha256_transform(uint32_t* state, const uint32_t* block, int swap);
 
-#if defined(__x86_64__) && !defined(USE_AVX2)
+#if defined(__x86_64__)
 
-#define SCRYPT_MAX_WAYS 12
 #define HAVE_SCRYPT_3WAY 1
 #define HAVE_SHA256_4WAY 1
-#define scrypt_best_throughput() 3;
 extern "C" int sha256_use_4way();
 extern "C" void sha256_init_4way(uint32_t* state);
 extern "C" void sha256_transform_4way(uint32_t* state, const uint32_t* block, int swap);
 extern "C" void scrypt_core_3way(uint32_t* X, uint32_t* V, int N);
 
-#elif defined(__x86_64__) && defined(USE_AVX2)
-
+#if defined(USE_AVX2)
 #define SCRYPT_MAX_WAYS 24
 #define HAVE_SCRYPT_6WAY 1
-#define HAVE_SHA256_4WAY 1
 #define HAVE_SHA256_8WAY 1
-#define scrypt_best_throughput() 6;
 extern "C" int sha256_use_8way();
 extern "C" void sha256_init_8way(uint32_t* state);
 extern "C" void sha256_transform_8way(uint32_t* state, const uint32_t* block, int swap);
-extern "C" int sha256_use_4way();
-extern "C" void sha256_init_4way(uint32_t* state);
-extern "C" void sha256_transform_4way(uint32_t* state, const uint32_t* block, int swap);
 extern "C" void scrypt_core_6way(uint32_t* X, uint32_t* V, int N);
+#else
+#define SCRYPT_MAX_WAYS 12
+#endif
+
+#if defined(ENABLE_AVX512F) && !defined(BUILD_BITCOIN_INTERNAL)
+#if SCRYPT_MAX_WAYS < 16
+#undef SCRYPT_MAX_WAYS
+#define SCRYPT_MAX_WAYS 16
+#endif
+#define HAVE_SCRYPT_16WAY 1
+#define HAVE_SHA256_16WAY 1
+/** Intrinsics kernels from scrypt_avx512.cpp, on data interleaved across 16 lanes. */
+namespace scrypt_avx512 {
+void sha256_init_16way(uint32_t* state);
+void sha256_transform_16way(uint32_t* state, const uint32_t* block, int swap);
+void scrypt_core_16way(uint32_t* X, uint32_t* V, int N);
+}
+#endif
 
 #elif defined(__i386__)
 
 #define SCRYPT_MAX_WAYS 4
 #define HAVE_SHA256_4WAY 1
-#define scrypt_best_throughput() 1
 extern "C" void scrypt_core(uint32_t* X, uint32_t* V, int N);
 extern "C" int sha256_use_4way();
 extern "C" void sha256_init_4way(uint32_t* state);
@@ -66,7 +142,6 @@ extern "C" void scrypt_core(uint32_t* X, uint32_t* V, int N);
 #undef HAVE_SHA256_4WAY
 #define SCRYPT_MAX_WAYS 3
 #define HAVE_SCRYPT_3WAY 1
-#define scrypt_best_throughput() 3
 void scrypt_core_3way(uint32_t *X, uint32_t *V, int N);
 #endif
 
@@ -77,7 +152,6 @@ void scrypt_core_3way(uint32_t *X, uint32_t *V, int N);
 #undef HAVE_SHA256_4WAY
 #define SCRYPT_MAX_WAYS 3
 #define HAVE_SCRYPT_3WAY 1
-#define scrypt_best_throughput() 3
 extern "C" void sha256_init(uint32_t *state);
 extern "C" void sha256_transform(uint32_t* state, const uint32_t* block, int swap);
 extern "C" void scrypt_core(uint32_t* X, uint32_t* V, int N);
@@ -0,0 +1,228 @@
+// Copyright (c) 2020 The Vericonomy developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifdef ENABLE_AVX512F
+
+#include <stddef.h>
+#include <stdint.h>
+#include <immintrin.h>
+
+// All data handled here is interleaved across 16 lanes word by word: word i
+// of lane k is at index 16 * i + k, so each vector holds one word of every lane.
+
+namespace scrypt_avx512 {
+namespace {
+
+__m512i inline K(uint32_t x) { return _mm512_set1_epi32(x); }
+
+__m512i inline Add(__m512i x, __m512i y) { return _mm512_add_epi32(x, y); }
+__m512i inline Add(__m512i x, __m512i y, __m512i z) { return Add(Add(x, y), z); }
+__m512i inline Add(__m512i x, __m512i y, __m512i z, __m512i w) { return Add(Add(x, y), Add(z, w)); }
+__m512i inline Xor(__m512i x, __m512i y) { return _mm512_xor_si512(x, y); }
+__m512i inline Xor(__m512i x, __m512i y, __m512i z) { return _mm512_ternarylogic_epi32(x, y, z, 0x96); }
+__m512i inline Or(__m512i x, __m512i y) { return _mm512_or_si512(x, y); }
+__m512i inline And(__m512i x, __m512i y) { return _mm512_and_si512(x, y); }
+__m512i inline ShR(__m512i x, int n) { return _mm512_srli_epi32(x, n); }
+
+#define Ror(x, n) _mm512_ror_epi32((x), (n))
+#define Rol(x, n) _mm512_rol_epi32((x), (n))
+
+////// SHA-256
+
+__m512i inline Ch(__m512i x, __m512i y, __m512i z) { return _mm512_ternarylogic_epi32(x, y, z, 0xca); }
+__m512i inline Maj(__m512i x, __m512i y, __m512i z) { return _mm512_ternarylogic_epi32(x, y, z, 0xe8); }
+__m512i inline Sigma0(__m512i x) { return Xor(Ror(x, 2), Ror(x, 13), Ror(x, 22)); }
+__m512i inline Sigma1(__m512i x) { return Xor(Ror(x, 6), Ror(x, 11), Ror(x, 25)); }
+__m512i inline sigma0(__m512i x) { return Xor(Ror(x, 7), Ror(x, 18), ShR(x, 3)); }
+__m512i inline sigma1(__m512i x) { return Xor(Ror(x, 17), Ror(x, 19), ShR(x, 10)); }
+
+/** Byte swap each 32-bit word, using AVX-512F only (vpshufb needs AVX-512BW). */
+__m512i inline BSwap(__m512i x)
+{
+    return Or(And(Ror(x, 8), K(0xff00ff00ul)), And(Rol(x, 8), K(0x00ff00fful)));
+}
+
+const uint32_t sha256_k[64] = {
+    0x428a2f98ul, 0x71374491ul, 0xb5c0fbcful, 0xe9b5dba5ul, 0x3956c25bul, 0x59f111f1ul, 0x923f82a4ul, 0xab1c5ed5ul,
+    0xd807aa98ul, 0x12835b01ul, 0x243185beul, 0x550c7dc3ul, 0x72be5d74ul, 0x80deb1feul, 0x9bdc06a7ul, 0xc19bf174ul,
+    0xe49b69c1ul, 0xefbe4786ul, 0x0fc19dc6ul, 0x240ca1ccul, 0x2de92c6ful, 0x4a7484aaul, 0x5cb0a9dcul, 0x76f988daul,
+    0x983e5152ul, 0xa831c66dul, 0xb00327c8ul, 0xbf597fc7ul, 0xc6e00bf3ul, 0xd5a79147ul, 0x06ca6351ul, 0x14292967ul,
+    0x27b70a85ul, 0x2e1b2138ul, 0x4d2c6dfcul, 0x53380d13ul, 0x650a7354ul, 0x766a0abbul, 0x81c2c92eul, 0x92722c85ul,
+    0xa2bfe8a1ul, 0xa81a664bul, 0xc24b8b70ul, 0xc76c51a3ul, 0xd192e819ul, 0xd6990624ul, 0xf40e3585ul, 0x106aa070ul,
+    0x19a4c116ul, 0x1e376c08ul, 0x2748774cul, 0x34b0bcb5ul, 0x391c0cb3ul, 0x4ed8aa4aul, 0x5b9cca4ful, 0x682e6ff3ul,
+    0x748f82eeul, 0x78a5636ful, 0x84c87814ul, 0x8cc70208ul, 0x90befffaul, 0xa4506cebul, 0xbef9a3f7ul, 0xc67178f2ul,
+};
+
+/** One round of SHA-256. */
+void inline __attribute__((always_inline)) Round(__m512i a, __m512i b, __m512i c, __m512i& d, __m512i e, __m512i f, __m512i g, __m512i& h, __m512i k)
+{
+    __m512i t1 = Add(h, Sigma1(e), Ch(e, f, g), k);
+    __m512i t2 = Add(Sigma0(a), Maj(a, b, c));
+    d = Add(d, t1);
+    h = Add(t1, t2);
+}
+
+////// Salsa20/8
+
+/** B ^= Bx, then B += Salsa20/8(B), for one 64-byte block of each lane. */
+void inline __attribute__((always_inline)) XorSalsa8(__m512i* B, const __m512i* Bx)
+{
+    __m512i x[16];
+    for (int i = 0; i < 16; i++)
+        x[i] = B[i] = Xor(B[i], Bx[i]);
+
+    for (int i = 0; i < 8; i += 2) {
+        /* Operate on columns. */
+        x[ 4] = Xor(x[ 4], Rol(Add(x[ 0], x[12]),  7)); x[ 9] = Xor(x[ 9], Rol(Add(x[ 5], x[ 1]),  7));
+        x[14] = Xor(x[14], Rol(Add(x[10], x[ 6]),  7)); x[ 3] = Xor(x[ 3], Rol(Add(x[15], x[11]),  7));
+        x[ 8] = Xor(x[ 8], Rol(Add(x[ 4], x[ 0]),  9)); x[13] = Xor(x[13], Rol(Add(x[ 9], x[ 5]),  9));
+        x[ 2] = Xor(x[ 2], Rol(Add(x[14], x[10]),  9)); x[ 7] = Xor(x[ 7], Rol(Add(x[ 3], x[15]),  9));
+        x[12] = Xor(x[12], Rol(Add(x[ 8], x[ 4]), 13)); x[ 1] = Xor(x[ 1], Rol(Add(x[13], x[ 9]), 13));
+        x[ 6] = Xor(x[ 6], Rol(Add(x[ 2], x[14]), 13)); x[11] = Xor(x[11], Rol(Add(x[ 7], x[ 3]), 13));
+        x[ 0] = Xor(x[ 0], Rol(Add(x[12], x[ 8]), 18)); x[ 5] = Xor(x[ 5], Rol(Add(x[ 1], x[13]), 18));
+        x[10] = Xor(x[10], Rol(Add(x[ 6], x[ 2]), 18)); x[15] = Xor(x[15], Rol(Add(x[11], x[ 7]), 18));
+
+        /* Operate on rows. */
+        x[ 1] = Xor(x[ 1], Rol(Add(x[ 0], x[ 3]),  7)); x[ 6] = Xor(x[ 6], Rol(Add(x[ 5], x[ 4]),  7));
+        x[11] = Xor(x[11], Rol(Add(x[10], x[ 9]),  7)); x[12] = Xor(x[12], Rol(Add(x[15], x[14]),  7));
+        x[ 2] = Xor(x[ 2], Rol(Add(x[ 1], x[ 0]),  9)); x[ 7] = Xor(x[ 7], Rol(Add(x[ 6], x[ 5]),  9));
+        x[ 8] = Xor(x[ 8], Rol(Add(x[11], x[10]),  9)); x[13] = Xor(x[13], Rol(Add(x[12], x[15]),  9));
+        x[ 3] = Xor(x[ 3], Rol(Add(x[ 2], x[ 1]), 13)); x[ 4] = Xor(x[ 4], Rol(Add(x[ 7], x[ 6]), 13));
+        x[ 9] = Xor(x[ 9], Rol(Add(x[ 8], x[11]), 13)); x[14] = Xor(x[14], Rol(Add(x[13], x[12]), 13));
+        x[ 0] = Xor(x[ 0], Rol(Add(x[ 3], x[ 2]), 18)); x[ 5] = Xor(x[ 5], Rol(Add(x[ 4], x[ 7]), 18));
+        x[10] = Xor(x[10], Rol(Add(x[ 9], x[ 8]), 18)); x[15] = Xor(x[15], Rol(Add(x[14], x[13]), 18));
+    }
+
+    for (int i = 0; i < 16; i++)
+        B[i] = Add(B[i], x[i]);
+}
+
+/** Transpose a 16x16 matrix of 32-bit words held in 16 vectors. */
+void inline __attribute__((always_inline)) Transpose(const __m512i* in, __m512i* out)
+{
+    __m512i t[16], u[16];
+    for (int i = 0; i < 16; i += 2) {
+        t[i] = _mm512_unpacklo_epi32(in[i], in[i + 1]);
+        t[i + 1] = _mm512_unpackhi_epi32(in[i], in[i + 1]);
+    }
+    for (int i = 0; i < 16; i += 4) {
+        u[i] = _mm512_unpacklo_epi64(t[i], t[i + 2]);
+        u[i + 1] = _mm512_unpackhi_epi64(t[i], t[i + 2]);
+        u[i + 2] = _mm512_unpacklo_epi64(t[i + 1], t[i + 3]);
+        u[i + 3] = _mm512_unpackhi_epi64(t[i + 1], t[i + 3]);
+    }
+    for (int i = 0; i < 16; i += 8) {
+        for (int j = 0; j < 4; j++) {
+            t[i + j] = _mm512_shuffle_i32x4(u[i + j], u[i + j + 4], 0x88);
+            t[i + j + 4] = _mm512_shuffle_i32x4(u[i + j], u[i + j + 4], 0xdd);
+        }
+    }
+    for (int j = 0; j < 8; j++) {
+        out[j] = _mm512_shuffle_i32x4(t[j], t[j + 8], 0x88);
+        out[j + 8] = _mm512_shuffle_i32x4(t[j], t[j + 8], 0xdd);
+    }
+}
+
+} // namespace
+
+void sha256_init_16way(uint32_t* state)
+{
+    static const uint32_t sha256_h[8] = {
+        0x6a09e667ul, 0xbb67ae85ul, 0x3c6ef372ul, 0xa54ff53aul, 0x510e527ful, 0x9b05688cul, 0x1f83d9abul, 0x5be0cd19ul,
+    };
+    for (int i = 0; i < 8; i++)
+        _mm512_storeu_si512((__m512i*)(state + 16 * i), K(sha256_h[i]));
+}
+
+void sha256_transform_16way(uint32_t* state, const uint32_t* block, int swap)
+{
+    __m512i w[16];
+    for (int i = 0; i < 16; i++) {
+        w[i] = _mm512_loadu_si512((const __m512i*)(block + 16 * i));
+        if (swap)
+            w[i] = BSwap(w[i]);
+    }
+
+    __m512i s[8];
+    for (int i = 0; i < 8; i++)
+        s[i] = _mm512_loadu_si512((const __m512i*)(state + 16 * i));
+    __m512i a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7];
+
+    for (int i = 0; i < 64; i += 8) {
+        if (i >= 16) {
+            for (int j = i; j < i + 8; j++)
+                w[j & 15] = Add(w[j & 15], sigma1(w[(j + 14) & 15]), w[(j + 9) & 15], sigma0(w[(j + 1) & 15]));
+        }
+        Round(a, b, c, d, e, f, g, h, Add(K(sha256_k[i + 0]), w[(i + 0) & 15]));
+        Round(h, a, b, c, d, e, f, g, Add(K(sha256_k[i + 1]), w[(i + 1) & 15]));
+        Round(g, h, a, b, c, d, e, f, Add(K(sha256_k[i + 2]), w[(i + 2) & 15]));
+        Round(f, g, h, a, b, c, d, e, Add(K(sha256_k[i + 3]), w[(i + 3) & 15]));
+        Round(e, f, g, h, a, b, c, d, Add(K(sha256_k[i + 4]), w[(i + 4) & 15]));
+        Round(d, e, f, g, h, a, b, c, Add(K(sha256_k[i + 5]), w[(i + 5) & 15]));
+        Round(c, d, e, f, g, h, a, b, Add(K(sha256_k[i + 6]), w[(i + 6) & 15]));
+        Round(b, c, d, e, f, g, h, a, Add(K(sha256_k[i + 7]), w[(i + 7) & 15]));
+    }
+
+    s[0] = Add(s[0], a); s[1] = Add(s[1], b); s[2] = Add(s[2], c); s[3] = Add(s[3], d);
+    s[4] = Add(s[4], e); s[5] = Add(s[5], f); s[6] = Add(s[6], g); s[7] = Add(s[7], h);
+    for (int i = 0; i < 8; i++)
+        _mm512_storeu_si512((__m512i*)(state + 16 * i), s[i]);
+}
+
+/**
+ * ROMix of 16 lanes at once. X holds the 32 words of each lane, interleaved.
+ * The N * 128 bytes of scratchpad of each lane are kept contiguous in V (lane
+ * k starts at V + k * N * 32), so a lookup touches two cache lines per lane.
+ */
+void scrypt_core_16way(uint32_t* X, uint32_t* V, int N)
+{
+    const size_t lane_stride = (size_t)N * 32;
+    __m512i B[16], Bx[16], T[16];
+
+    for (int i = 0; i < 16; i++) {
+        B[i] = _mm512_loadu_si512((const __m512i*)(X + 16 * i));
+        Bx[i] = _mm512_loadu_si512((const __m512i*)(X + 16 * (i + 16)));
+    }
+
+    for (int i = 0; i < N; i++) {
+        uint32_t* v = V + (size_t)i * 32;
+        Transpose(B, T);
+        for (int k = 0; k < 16; k++)
+            _mm512_store_si512((__m512i*)(v + k * lane_stride), T[k]);
+        Transpose(Bx, T);
+        for (int k = 0; k < 16; k++)
+            _mm512_store_si512((__m512i*)(v + k * lane_stride + 16), T[k]);
+        XorSalsa8(B, Bx);
+        XorSalsa8(Bx, B);
+    }
+
+    alignas(64) uint32_t j[16];
+    for (int i = 0; i < N; i++) {
+        _mm512_store_si512((__m512i*)j, And(Bx[0], K(N - 1)));
+        for (int k = 0; k < 16; k++)
+            T[k] = _mm512_load_si512((const __m512i*)(V + k * lane_stride + (size_t)j[k] * 32));
+        Transpose(T, T);
+        for (int k = 0; k < 16; k++)
+            B[k] = Xor(B[k], T[k]);
+        for (int k = 0; k < 16; k++)
+            T[k] = _mm512_load_si512((const __m512i*)(V + k * lane_stride + (size_t)j[k] * 32 + 16));
+        Transpose(T, T);
+        for (int k = 0; k < 16; k++)
+            Bx[k] = Xor(Bx[k], T[k]);
+        XorSalsa8(B, Bx);
+        XorSalsa8(Bx, B);
+    }
+
+    for (int i = 0; i < 16; i++) {
+        _mm512_storeu_si512((__m512i*)(X + 16 * i), B[i]);
+        _mm512_storeu_si512((__m512i*)(X + 16 * (i + 16)), Bx[i]);
+    }
+}
+
+} // namespace scrypt_avx512
+
+#undef Ror
+#undef Rol
+
+#endif
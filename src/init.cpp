@@ -12,11 +12,13 @@
 #include <addrman.h>
 #include <amount.h>
 #include <banman.h>
+#include <blockcache.h>
 #include <blockfilter.h>
 #include <chain.h>
 #include <chainparams.h>
 #include <compat/sanity.h>
 #include <consensus/validation.h>
+#include <crypto/scrypt.h>
 #include <downloader.h>
 #include <fs.h>
 #include <httprpc.h>
@@ -59,6 +61,7 @@
 
 #include <validationinterface.h>
 #include <walletinitinterface.h>
+#include <workserver.h>
 
 #include <stdint.h>
 #include <stdio.h>
@@ -162,6 +165,7 @@ void Interrupt(NodeContext& node)
     InterruptRPC();
     InterruptREST();
     InterruptTorControl();
+    InterruptWorkServer();
     InterruptMapPort();
     if (node.connman)
         node.connman->Interrupt();
@@ -214,12 +218,15 @@ void Shutdown(NodeContext& node)
     }
 
     StopTorControl();
+    StopWorkServer();
+    GenerateVerium(false, nullptr, 0, nullptr);
 
     // After everything has been shut down, but before things get flushed, stop the
     // CScheduler/checkqueue threadGroup
     if (node.scheduler) node.scheduler->stop();
     threadGroup.interrupt_all();
     threadGroup.join_all();
+    StopStakeMinter();
 
     // After the threads that potentially access these pointers have been stopped,
     // destruct and reset all to nullptr.
@@ -379,16 +386,19 @@ void SetupServerArgs()
     gArgs.AddArg("-alertnotify=<cmd>", "Execute command when a relevant alert is received or we see a really long fork (%s in cmd is replaced by message)", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
 #endif
     gArgs.AddArg("-assumevalid=<hex>", strprintf("If this block is in the chain assume that it and its ancestors are valid and potentially skip their script verification (0 to verify all, default: %s, testnet: %s)", defaultChainParams->GetConsensus().defaultAssumeValid.GetHex(), testnetChainParams->GetConsensus().defaultAssumeValid.GetHex()), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-assumevalidpow=<hex>", strprintf("If this block is in the chain assume that the proof of work of it and its ancestors is valid and potentially skip hashing their headers and blocks; difficulty is still checked (0 to verify all, default: %s)", defaultChainParams->GetConsensus().defaultAssumeValidPow.GetHex()), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-blocksdir=<dir>", "Specify directory to hold blocks subdirectory for *.dat files (default: <datadir>)", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-alerts", strprintf("Receive and display P2P network alerts (default: %u)", DEFAULT_ALERTS), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
 #if HAVE_SYSTEM
     gArgs.AddArg("-blocknotify=<cmd>", "Execute command when the best block changes (%s in cmd is replaced by block hash)", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
 #endif
+    gArgs.AddArg("-blockcachesize=<n>", strprintf("Keep up to <n> MiB of the blocks most recently connected or read from disk in memory, for RPC, REST and peers asking for them again (0 to disable, default: %d)", DEFAULT_BLOCK_CACHE_SIZE), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-blockreconstructionextratxn=<n>", strprintf("Extra transactions to keep in memory for compact block reconstructions (default: %u)", DEFAULT_BLOCK_RECONSTRUCTION_EXTRA_TXN), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-blocksonly", strprintf("Whether to reject transactions from network peers. Automatic broadcast and rebroadcast of any transactions from inbound peers is disabled, unless '-whitelistforcerelay' is '1', in which case whitelisted peers' transactions will be relayed. RPC transactions are not affected. (default: %u)", DEFAULT_BLOCKSONLY), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-conf=<file>", strprintf("Specify configuration file. Relative paths will be prefixed by datadir location. (default: %s)", BITCOIN_CONF_FILENAME), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-datadir=<dir>", "Specify data directory", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-dbbatchsize", strprintf("Maximum database write batch size in bytes (default: %u)", nDefaultDbBatchSize), ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-asyncflush", strprintf("Write the coins cache to disk on a background thread while blocks keep being connected to a new cache. Uses up to twice -dbcache (default: %u)", DEFAULT_ASYNC_FLUSH), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-dbcache=<n>", strprintf("Maximum database cache size <n> MiB (%d to %d, default: %d). In addition, unused mempool memory is shared for this cache (see -maxmempool).", nMinDbCache, nMaxDbCache, nDefaultDbCache), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-debuglogfile=<file>", strprintf("Specify location of debug log file. Relative paths will be prefixed by a net-specific datadir location. (-nodebuglogfile to disable; default: %s)", DEFAULT_DEBUGLOGFILE), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-feefilter", strprintf("Tell other nodes to filter invs to us by our mempool min fee (default: %u)", DEFAULT_FEEFILTER), ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::OPTIONS);
@@ -402,8 +412,10 @@ void SetupServerArgs()
         -GetNumCores(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-persistmempool", strprintf("Whether to save the mempool on shutdown and load on restart (default: %u)", DEFAULT_PERSIST_MEMPOOL), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-pid=<file>", strprintf("Specify pid file. Relative paths will be prefixed by a net-specific datadir location. (default: %s)", BITCOIN_PID_FILENAME), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-recheckpow", strprintf("Recompute the scrypt proof-of-work hashes recorded in the block index in the background and report mismatches (default: %u)", DEFAULT_RECHECK_POW), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-reindex", "Rebuild chain state and block index from the blk*.dat files on disk", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-reindex-chainstate", "Rebuild chain state from the currently indexed blocks. When in pruning mode or if blocks on disk might be corrupted, use full -reindex instead.", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-scryptmem=<n>", strprintf("Keep the scrypt scratchpads of the proof-of-work checks of all threads within <n> MiB. Threads wait for one another's scratchpads beyond it, and kernels whose scratchpad alone would not fit are not used (default: %d)", DEFAULT_SCRYPT_MEMORY), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
 #ifndef WIN32
     gArgs.AddArg("-sysperms", "Create new files with system default permissions, instead of umask 077 (only effective with disabled wallet functionality)", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
 #else
@@ -542,6 +554,13 @@ void SetupServerArgs()
 
     gArgs.AddArg("-blockmaxweight=<n>", strprintf("Set maximum BIP141 block weight (default: %d)", DEFAULT_BLOCK_MAX_WEIGHT), ArgsManager::ALLOW_ANY, OptionsCategory::BLOCK_CREATION);
     gArgs.AddArg("-blockversion=<n>", "Override block version to test forking scenarios", ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::BLOCK_CREATION);
+    gArgs.AddArg("-minerthreads=<layout>", strprintf("Place the threads of the built-in miner on cores: os leaves it to the scheduler, compact pins them to consecutive cores, spread pins them round-robin across NUMA nodes (default: %s)", DEFAULT_MINER_THREADS_LAYOUT), ArgsManager::ALLOW_ANY, OptionsCategory::BLOCK_CREATION);
+    gArgs.AddArg("-minernuma=<mode>", strprintf("With auto, bind each thread of the built-in miner and its scrypt scratchpad to one NUMA node on machines with several nodes; off disables this (default: %s)", DEFAULT_MINER_NUMA), ArgsManager::ALLOW_ANY, OptionsCategory::BLOCK_CREATION);
+    gArgs.AddArg("-workserver=<port>", "Serve stratum-style mining jobs to external miners on <port>, paying to the address each miner authorizes with (default: disabled)", ArgsManager::ALLOW_ANY, OptionsCategory::BLOCK_CREATION);
+    gArgs.AddArg("-workserverbind=<addr>", strprintf("Bind the work server to the given address (default: %s)", DEFAULT_WORKSERVER_BIND), ArgsManager::ALLOW_ANY, OptionsCategory::BLOCK_CREATION);
+    gArgs.AddArg("-minerleavepar", strprintf("Keep the threads of the built-in miner off as many cores as there are -par script verification threads (default: %u)", DEFAULT_MINER_LEAVE_PAR), ArgsManager::ALLOW_BOOL, OptionsCategory::BLOCK_CREATION);
+    gArgs.AddArg("-stakegen", "Stake the outputs of the first wallet, on Vericoin (default: 1)", ArgsManager::ALLOW_BOOL, OptionsCategory::BLOCK_CREATION);
+    gArgs.AddArg("-stakethreads=<n>", strprintf("Set the number of threads searching for stake kernels, <= 0 for one per core (default: %d)", DEFAULT_STAKE_THREADS), ArgsManager::ALLOW_ANY, OptionsCategory::BLOCK_CREATION);
 
     gArgs.AddArg("-rest", strprintf("Accept public REST requests (default: %u)", DEFAULT_REST_ENABLE), ArgsManager::ALLOW_ANY, OptionsCategory::RPC);
     gArgs.AddArg("-rpcallowip=<ip>", "Allow JSON-RPC connections from specified source. Valid for <ip> are a single IP (e.g. 1.2.3.4), a network/netmask (e.g. 1.2.3.4/255.255.255.0) or a network/CIDR (e.g. 1.2.3.4/24). This option can be specified multiple times", ArgsManager::ALLOW_ANY, OptionsCategory::RPC);
@@ -997,6 +1016,10 @@ bool AppInitParameterInteraction()
     else
         LogPrintf("Validating signatures for all blocks.\n");
 
+    hashAssumeValidPow = uint256S(gArgs.GetArg("-assumevalidpow", chainparams.GetConsensus().defaultAssumeValidPow.GetHex()));
+    if (!hashAssumeValidPow.IsNull())
+        LogPrintf("Assuming ancestors of block %s have valid proof of work.\n", hashAssumeValidPow.GetHex());
+
     if (gArgs.IsArgSet("-minimumchainwork")) {
         const std::string minChainWorkStr = gArgs.GetArg("-minimumchainwork", "");
         if (!IsHexNumber(minChainWorkStr)) {
@@ -1075,6 +1098,13 @@ bool AppInitParameterInteraction()
 
     nMaxTipAge = gArgs.GetArg("-maxtipage", DEFAULT_MAX_TIP_AGE);
 
+    const std::string miner_layout = gArgs.GetArg("-minerthreads", DEFAULT_MINER_THREADS_LAYOUT);
+    if (miner_layout != "os" && miner_layout != "compact" && miner_layout != "spread")
+        return InitError(strprintf(_("Unknown -minerthreads layout: '%s'").translated, miner_layout));
+    const std::string miner_numa = gArgs.GetArg("-minernuma", DEFAULT_MINER_NUMA);
+    if (miner_numa != "auto" && miner_numa != "off")
+        return InitError(strprintf(_("Unknown -minernuma mode: '%s'").translated, miner_numa));
+
     return true;
 }
 
@@ -1098,6 +1128,8 @@ bool AppInitSanityChecks()
     // Initialize elliptic curve code
     std::string sha256_algo = SHA256AutoDetect();
     LogPrintf("Using the '%s' SHA256 implementation\n", sha256_algo);
+    std::string scrypt_algo = ScryptAutoDetect();
+    LogPrintf("Using the '%s' scrypt implementation\n", scrypt_algo);
     RandomInit();
     ECC_Start();
     globalVerifyHandle.reset(new ECCVerifyHandle());
@@ -1193,11 +1225,24 @@ bool AppInitMain(NodeContext& node)
     script_threads = std::min(script_threads, MAX_SCRIPTCHECK_THREADS);
 
     LogPrintf("Script verification uses %d additional threads\n", script_threads);
+    g_script_check_threads = script_threads;
     if (script_threads >= 1) {
         g_parallel_script_checks = true;
         for (int i = 0; i < script_threads; ++i) {
             threadGroup.create_thread([i]() { return ThreadScriptCheck(i); });
         }
+        // Header scrypt proof-of-work checks share the -par thread budget
+        for (int i = 0; i < script_threads; ++i) {
+            threadGroup.create_thread([i]() { return ThreadHeaderPoWCheck(i); });
+        }
+        // So do the reads of the input prefetcher, which mostly wait on disk
+        for (int i = 0; i < script_threads; ++i) {
+            threadGroup.create_thread([i]() { return ThreadCoinsFetch(i); });
+        }
+        // And the context-free checks of the transactions of a block
+        for (int i = 0; i < script_threads; ++i) {
+            threadGroup.create_thread([i]() { return ThreadBlockCheck(i); });
+        }
     }
 
     assert(!node.scheduler);
@@ -1398,6 +1443,7 @@ bool AppInitMain(NodeContext& node)
 
     fReindex = gArgs.GetBoolArg("-reindex", false);
     bool fReindexChainState = gArgs.GetBoolArg("-reindex-chainstate", false);
+    g_async_coins_flush = gArgs.GetBoolArg("-asyncflush", DEFAULT_ASYNC_FLUSH);
 
     // cache size calculations
     int64_t nTotalCache = (gArgs.GetArg("-dbcache", nDefaultDbCache) << 20);
@@ -1428,6 +1474,12 @@ bool AppInitMain(NodeContext& node)
     }
     LogPrintf("* Using %.1f MiB for chain state database\n", nCoinDBCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1f MiB for in-memory UTXO set (plus up to %.1f MiB of unused mempool space)\n", nCoinCacheUsage * (1.0 / 1024 / 1024), nMempoolSizeMax * (1.0 / 1024 / 1024));
+    const int64_t nBlockCacheSize = std::max<int64_t>(0, gArgs.GetArg("-blockcachesize", DEFAULT_BLOCK_CACHE_SIZE)) << 20;
+    g_block_cache.SetMaxUsage(nBlockCacheSize);
+    LogPrintf("* Using %.1f MiB for recently used blocks\n", nBlockCacheSize * (1.0 / 1024 / 1024));
+    const int64_t nScryptMemory = std::max<int64_t>(0, gArgs.GetArg("-scryptmem", DEFAULT_SCRYPT_MEMORY)) << 20;
+    ScryptSetMemoryBudget(nScryptMemory);
+    LogPrintf("* Using up to %.1f MiB for scrypt scratchpads\n", nScryptMemory * (1.0 / 1024 / 1024));
 
     bool fLoaded = false;
     while (!fLoaded && !ShutdownRequested()) {
@@ -1651,6 +1703,10 @@ bool AppInitMain(NodeContext& node)
 
     threadGroup.create_thread(std::bind(&ThreadImport, vImportFiles));
 
+    if (gArgs.GetBoolArg("-recheckpow", DEFAULT_RECHECK_POW)) {
+        threadGroup.create_thread(&ThreadRecheckBlockWork);
+    }
+
     // Wait for genesis block to be processed
     {
         WAIT_LOCK(g_genesis_wait_mutex, lock);
@@ -1682,6 +1738,9 @@ bool AppInitMain(NodeContext& node)
     if (gArgs.GetBoolArg("-listenonion", DEFAULT_LISTEN_ONION))
         StartTorControl();
 
+    if (gArgs.IsArgSet("-workserver") && !StartWorkServer())
+        return false;
+
     Discover();
 
     // Map ports with UPnP
@@ -1757,7 +1816,7 @@ bool AppInitMain(NodeContext& node)
         banman->DumpBanlist();
     }, DUMP_BANS_INTERVAL);
 
-    if (GetWallets()[0] && gArgs.GetBoolArg("-stakegen", true))
+    if (!GetWallets().empty() && gArgs.GetBoolArg("-stakegen", true))
         MintStake(threadGroup, GetWallets()[0], node.connman.get(), node.mempool);
 
     return true;
@@ -7,6 +7,7 @@
 
 #include <indirectmap.h>
 #include <prevector.h>
+#include <support/allocators/pool.h>
 
 #include <stdlib.h>
 
@@ -167,6 +168,24 @@ static inline size_t DynamicUsage(const std::unordered_map<X, Y, Z>& m)
     return MallocUsage(sizeof(unordered_node<std::pair<const X, Y> >)) * m.size() + MallocUsage(sizeof(void*) * m.bucket_count());
 }
 
+static inline size_t DynamicUsage(const PoolResource& resource)
+{
+    return MallocUsage(resource.ChunkSizeBytes()) * resource.NumAllocatedChunks() + MallocUsage(sizeof(void*) * resource.NumAllocatedChunks());
+}
+
+/**
+ * The nodes of a map with a pool are in the chunks of the pool, whether in use
+ * or freed. Bucket arrays too large for the pool are allocated on their own,
+ * and small ones are counted twice.
+ */
+template<typename X, typename Y, typename Z, typename W>
+static inline size_t DynamicUsage(const std::unordered_map<X, Y, Z, W, PoolAllocator<std::pair<const X, Y> > >& m)
+{
+    const PoolResource* resource = m.get_allocator().resource();
+    const size_t nodes = resource ? DynamicUsage(*resource) : MallocUsage(sizeof(unordered_node<std::pair<const X, Y> >)) * m.size();
+    return nodes + MallocUsage(sizeof(void*) * m.bucket_count());
+}
+
 }
 
 #endif // BITCOIN_MEMUSAGE_H
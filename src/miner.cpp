@@ -8,26 +8,32 @@
 #include <amount.h>
 #include <chain.h>
 #include <chainparams.h>
+#include <clientversion.h>
 #include <coins.h>
 #include <consensus/consensus.h>
 #include <consensus/merkle.h>
 #include <consensus/tx_verify.h>
 #include <consensus/validation.h>
 #include <crypto/scrypt.h>
+#include <interfaces/handler.h>
 #include <net.h>
 #include <policy/feerate.h>
 #include <policy/policy.h>
+#include <pos.h>
 #include <pow.h>
 #include <primitives/transaction.h>
+#include <script/standard.h>
 #include <shutdown.h>
 #include <timedata.h>
 #include <util/moneystr.h>
 #include <util/system.h>
 #include <validation.h>
+#include <validationinterface.h>
 #include <wallet/wallet.h>
 #include <util/threadnames.h>
 
 #include <algorithm>
+#include <cmath>
 #include <utility>
 #include <thread>
 #include <boost/thread/thread.hpp>
@@ -86,7 +92,7 @@ void BlockAssembler::resetBlock()
 Optional<int64_t> BlockAssembler::m_last_block_num_txs{nullopt};
 Optional<int64_t> BlockAssembler::m_last_block_weight{nullopt};
 
-std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& scriptPubKeyIn)
+std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& scriptPubKeyIn, int64_t nCoinStakeTime)
 {
     int64_t nTimeStart = GetTimeMicros();
 
@@ -114,7 +120,7 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     if (chainparams.MineBlocksOnDemand())
         pblock->nVersion = gArgs.GetArg("-blockversion", pblock->nVersion);
 
-    pblock->nTime = GetAdjustedTime();
+    pblock->nTime = nCoinStakeTime ? nCoinStakeTime : GetAdjustedTime();
     const int64_t nMedianTimePast = pindexPrev->GetMedianTimePast();
 
     nLockTimeCutoff = (STANDARD_LOCKTIME_VERIFY_FLAGS & LOCKTIME_MEDIAN_TIME_PAST)
@@ -146,21 +152,33 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     coinbaseTx.vin.resize(1);
     coinbaseTx.vin[0].prevout.SetNull();
     coinbaseTx.vout.resize(1);
-    coinbaseTx.vout[0].scriptPubKey = scriptPubKeyIn;
-    coinbaseTx.vout[0].nValue = nFees + GetProofOfWorkReward(nFees, pindexPrev);
     coinbaseTx.vin[0].scriptSig = CScript() << nHeight << OP_0;
+    if (nCoinStakeTime) {
+        // ppcoin: the fees go to the coinstake
+        coinbaseTx.vout[0].SetEmpty();
+        coinbaseTx.nTime = nCoinStakeTime;
+        pblock->nFlags = CBlockIndex::BLOCK_PROOF_OF_STAKE;
+    } else {
+        coinbaseTx.vout[0].scriptPubKey = scriptPubKeyIn;
+        coinbaseTx.vout[0].nValue = nFees + GetProofOfWorkReward(nFees, pindexPrev);
+    }
     pblock->vtx[0] = MakeTransactionRef(std::move(coinbaseTx));
-    pblocktemplate->vchCoinbaseCommitment = GenerateCoinbaseCommitment(*pblock, pindexPrev, chainparams.GetConsensus());
+    if (!nCoinStakeTime)
+        pblocktemplate->vchCoinbaseCommitment = GenerateCoinbaseCommitment(*pblock, pindexPrev, chainparams.GetConsensus());
     pblocktemplate->vTxFees[0] = -nFees;
 
     LogPrintf("CreateNewBlock(): block weight: %u txs: %u fees: %ld sigops %d\n", GetBlockWeight(*pblock), nBlockTx, nFees, nBlockSigOpsCost);
 
     // Fill in header
     pblock->hashPrevBlock  = pindexPrev->GetBlockHash();
-    UpdateTime(pblock, chainparams.GetConsensus(), pindexPrev);
-    pblock->nBits          = GetNextWorkRequired(pindexPrev, chainparams.GetConsensus());
     pblock->nNonce         = 0;
     pblocktemplate->vTxSigOpsCost[0] = WITNESS_SCALE_FACTOR * GetLegacySigOpCount(*pblock->vtx[0]);
+    if (nCoinStakeTime) {
+        pblock->nBits = GetNextTargetRequired(pindexPrev, chainparams.GetConsensus());
+        return std::move(pblocktemplate);
+    }
+    UpdateTime(pblock, chainparams.GetConsensus(), pindexPrev);
+    pblock->nBits          = GetNextWorkRequired(pindexPrev, chainparams.GetConsensus());
 
     BlockValidationState state;
     if (!TestBlockValidity(state, chainparams, *pblock, pindexPrev, false, false)) {
@@ -205,6 +223,8 @@ bool BlockAssembler::TestPackageTransactions(const CTxMemPool::setEntries& packa
     for (CTxMemPool::txiter it : package) {
         if (!IsFinalTx(it->GetTx(), nHeight, nLockTimeCutoff))
             return false;
+        if (it->GetTx().nTime > pblock->nTime)
+            return false;
         if (!fIncludeWitness && it->GetTx().HasWitness())
             return false;
     }
@@ -415,6 +435,8 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpda
     }
 }
 
+static void SetExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned int nExtraNonce);
+
 void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned int& nExtraNonce)
 {
     // Update nExtraNonce
@@ -425,6 +447,11 @@ void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned
         hashPrevBlock = pblock->hashPrevBlock;
     }
     ++nExtraNonce;
+    SetExtraNonce(pblock, pindexPrev, nExtraNonce);
+}
+
+static void SetExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned int nExtraNonce)
+{
     unsigned int nHeight = pindexPrev->nHeight+1; // Height first in coinbase required for block.version=2
     CMutableTransaction txCoinbase(*pblock->vtx[0]);
     txCoinbase.vin[0].scriptSig = (CScript() << nHeight << CScriptNum(nExtraNonce));
@@ -438,11 +465,13 @@ void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned
 //////////////////////////////////////////////////////////////////////////////
 ////////////////////////// Verium Miner /////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////
-double hashrate = 0.;
-bool fGenerateVerium = false;
+static std::atomic<bool> fGenerateVerium{false};
 static int64_t timeElapsed = 30000;
-double dHashesPerMin = 0.0;
-int64_t nHPSTimerStart = 0;
+
+// Only GenerateVerium() and the reporting functions take this lock, never the
+// hashing loop, which updates its own MinerThreadStats.
+static Mutex cs_miner_stats;
+static std::vector<std::shared_ptr<MinerThreadStats>> g_miner_stats GUARDED_BY(cs_miner_stats);
 
 static const unsigned int pSHA256InitState[8] =
 {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
@@ -549,57 +578,160 @@ void SHA256Transform(void* pstate, void* pinput, const void* pinit)
         ((uint32_t*)pstate)[i] = ctx.h[i];
 }
 
-void Miner(CWallet *pwallet, CConnman* connman)
+/** A copy of the shared block template, handed to one miner thread */
+struct MinerWork
+{
+    CBlock block;
+    const CBlockIndex* pindexPrev{nullptr};
+    unsigned int nTransactionsUpdated{0};
+    int64_t nTemplateTime{0};
+    uint64_t nGeneration{0};
+};
+
+/**
+ * Builds the block template all miner threads hash, once per tip change or
+ * mempool refresh, instead of every thread assembling its own under cs_main.
+ * Each thread gets a copy with its own extranonce, so their nonce ranges
+ * never overlap.
+ */
+class MinerTemplateProducer final : public CValidationInterface
+{
+private:
+    std::shared_ptr<CWallet> m_wallet;
+    ReserveDestination m_reserve_dest;
+    CScript m_script;
+
+    Mutex m_mutex;
+    std::unique_ptr<CBlockTemplate> m_template GUARDED_BY(m_mutex);
+    const CBlockIndex* m_template_prev GUARDED_BY(m_mutex){nullptr};
+    unsigned int m_template_tx_updated GUARDED_BY(m_mutex){0};
+    int64_t m_template_time GUARDED_BY(m_mutex){0};
+    unsigned int m_extra_nonce GUARDED_BY(m_mutex){0};
+
+    /** Bumped on every tip change, so miner threads notice without polling the chain */
+    std::atomic<uint64_t> m_generation{0};
+
+    /** Stops the miner when the wallet is unloaded; declared after m_wallet so it disconnects first */
+    std::unique_ptr<interfaces::Handler> m_unload_handler;
+
+public:
+    explicit MinerTemplateProducer(std::shared_ptr<CWallet> wallet) : m_wallet(wallet), m_reserve_dest(wallet.get(), DEFAULT_ADDRESS_TYPE)
+    {
+        m_unload_handler = interfaces::MakeHandler(m_wallet->NotifyUnload.connect([] { GenerateVerium(false, nullptr, 0, nullptr); }));
+    }
+
+    /** Reserve the payout address of all miner threads, returns false if the keypool ran out */
+    bool Init()
+    {
+        CTxDestination dest;
+        if (!m_reserve_dest.GetReservedDestination(dest, true))
+            return false;
+        m_script = GetScriptForDestination(dest);
+        return true;
+    }
+
+    uint64_t Generation() const { return m_generation; }
+
+    /**
+     * Copy the current template with a fresh extranonce into work, rebuilding
+     * the template first if the tip changed or if the mempool changed and the
+     * template is over a minute old. Returns false if no template could be built.
+     */
+    bool GetWork(MinerWork& work) LOCKS_EXCLUDED(m_mutex);
+
+protected:
+    void UpdatedBlockTip(const CBlockIndex* pindexNew, const CBlockIndex* pindexFork, bool fInitialDownload) override
+    {
+        ++m_generation;
+    }
+};
+
+bool MinerTemplateProducer::GetWork(MinerWork& work)
+{
+    unsigned int nExtraNonce;
+    {
+        LOCK(m_mutex);
+        // Read before looking at the tip, so a tip change racing with the
+        // rebuild makes the thread ask again rather than hash a stale block.
+        work.nGeneration = m_generation;
+        {
+            LOCK(cs_main);
+            if (!m_template || m_template_prev != ::ChainActive().Tip() ||
+                (mempool.GetTransactionsUpdated() != m_template_tx_updated && GetTime() - m_template_time > 60))
+            {
+                m_template_tx_updated = mempool.GetTransactionsUpdated();
+                try
+                {
+                    m_template = BlockAssembler(mempool, Params()).CreateNewBlock(m_script);
+                }
+                catch (const std::runtime_error& e)
+                {
+                    m_template.reset();
+                }
+                if (!m_template)
+                    return false;
+                m_template_prev = ::ChainActive().Tip();
+                m_template_time = GetTime();
+                m_extra_nonce = 0;
+            }
+        }
+        work.block = m_template->block;
+        work.pindexPrev = m_template_prev;
+        work.nTransactionsUpdated = m_template_tx_updated;
+        work.nTemplateTime = m_template_time;
+        nExtraNonce = ++m_extra_nonce;
+    }
+    SetExtraNonce(&work.block, work.pindexPrev, nExtraNonce);
+    return true;
+}
+
+void Miner(std::shared_ptr<MinerTemplateProducer> producer, CConnman* connman, std::shared_ptr<MinerThreadStats> stats)
 {
     LogPrintf("Miner started\n");
     SetThreadPriority(THREAD_PRIORITY_LOWEST);
     util::ThreadRename("verium-miner");
 
+    // Pin first, so the scratchpad is faulted in on the thread's own NUMA node
+    if (!stats->vCpus.empty())
+        stats->fPinned.store(SetThreadAffinity(stats->vCpus), std::memory_order_relaxed);
+
     //Build buffer and check for memory availability
     bool memory = true;
     unsigned char *scratchbuf = scrypt_buffer_alloc();
     if(!scratchbuf){memory = false;}
+    if (memory && stats->fPinned.load(std::memory_order_relaxed)) {
+        const size_t size = scrypt_buffer_size();
+        for (size_t i = 0; i < size; i += 4096)
+            scratchbuf[i] = 0;
+    }
+    stats->fScratchpad.store(memory, std::memory_order_relaxed);
+    if (!memory)
+        LogPrintf("Miner thread %d could not allocate its scrypt scratchpad\n", stats->nThread);
 
-    // Each thread has it's own nonce
-    ReserveDestination reservedest(pwallet, DEFAULT_ADDRESS_TYPE);
-
-    CTxDestination dest;
-    bool ret = reservedest.GetReservedDestination(dest, true);
-    if (!ret)
-        return;
-
-    CScript scriptChange;
-    scriptChange = GetScriptForDestination(dest);
+    // Hash meter of this thread
+    int64_t nHPSTimerStart = GetTimeMillis();
+    uint64_t nHashCounter = 0;
 
-    unsigned int nExtraNonce = 0;
     try
     {
         while (fGenerateVerium && memory)
         {
             while (::ChainstateActive().IsInitialBlockDownload() || connman->GetNodeCount(CConnman::CONNECTIONS_ALL) < 1 || ::ChainActive().Tip()->nHeight < connman->GetBestHeight()){
                 LogPrintf("Mining inactive while chain is syncing...\n");
-                UninterruptibleSleep(std::chrono::milliseconds{5000});
+                boost::this_thread::sleep_for(boost::chrono::milliseconds(5000));
             }
 
-            // Create new block
-            unsigned int nTransactionsUpdatedLast = mempool.GetTransactionsUpdated();
-            CBlockIndex* pindexPrev = ::ChainActive().Tip();
-
-            std::unique_ptr<CBlockTemplate> pblocktemplate;
-            try
-            {
-                pblocktemplate = BlockAssembler(mempool, Params()).CreateNewBlock(scriptChange);
-            }
-            catch(std::runtime_error& e)
+            // Get a copy of the shared block, with an extranonce of our own
+            MinerWork work;
+            if (!producer->GetWork(work))
             {
+                boost::this_thread::sleep_for(boost::chrono::milliseconds(1000));
                 continue;
             }
 
-            if (!pblocktemplate.get())
-                return;
-
-            CBlock *pblock = &pblocktemplate->block;
-            IncrementExtraNonce(pblock, pindexPrev, nExtraNonce);
+            CBlock *pblock = &work.block;
+            const CBlockIndex* pindexPrev = work.pindexPrev;
+            stats->nTemplateTime.store(work.nTemplateTime, std::memory_order_relaxed);
             LogPrintf("Miner thread running on block %s (%lu bytes)\n", pindexPrev->nHeight, ::GetSerializeSize(*pblock, PROTOCOL_VERSION));
 
             // Pre-build hash buffers
@@ -610,7 +742,6 @@ void Miner(CWallet *pwallet, CConnman* connman)
             unsigned int& nBlockTime = *(unsigned int*)(pdata + 64 + 4);
 
             // Search
-            int64_t nStart = GetTime();
             uint256 hashTarget = ArithToUint256(arith_uint256().SetCompact(pblock->nBits));
             while (fGenerateVerium)
             {
@@ -623,7 +754,8 @@ void Miner(CWallet *pwallet, CConnman* connman)
                     {
                         // Found a solution
                         SetThreadPriority(THREAD_PRIORITY_NORMAL);
-                        CheckWork(pblock);
+                        if (CheckWork(pblock))
+                            stats->nBlocksFound.fetch_add(1, std::memory_order_relaxed);
                         SetThreadPriority(THREAD_PRIORITY_LOWEST);
                     }
                     nHashesDone += nHashes;
@@ -631,43 +763,32 @@ void Miner(CWallet *pwallet, CConnman* connman)
                 }
 
                 // Hash meter
-                static int64_t nHashCounter;
+                stats->nHashes.fetch_add(nHashesDone, std::memory_order_relaxed);
+                nHashCounter += nHashesDone;
+                if (GetTimeMillis() - nHPSTimerStart > timeElapsed)
                 {
-                    static RecursiveMutex cs;
-                    {
-                        LOCK(cs);
-                        if (nHPSTimerStart == 0)
-                        {
-                            nHPSTimerStart = GetTimeMillis();
-                            nHashCounter = 0;
-                        }
-                        else
-                            nHashCounter += nHashesDone;
-
-                        if (GetTimeMillis() - nHPSTimerStart > timeElapsed)
-                        {
-                            dHashesPerMin = 60000.0 * nHashCounter / (GetTimeMillis() - nHPSTimerStart);
-                            nHPSTimerStart = GetTimeMillis();
-                            nHashCounter = 0;
-                            updateHashrate(dHashesPerMin);
-                            LogPrintf("Total local hashrate: %6.0f hashes/min\n", hashrate);
-                        }
-                    }
+                    stats->dHashesPerMin.store(60000.0 * nHashCounter / (GetTimeMillis() - nHPSTimerStart), std::memory_order_relaxed);
+                    nHPSTimerStart = GetTimeMillis();
+                    nHashCounter = 0;
+                    if (stats->nThread == 0)
+                        LogPrintf("Total local hashrate: %6.0f hashes/min\n", GetMinerHashrate());
                 }
 
                 // Check for stop or if block needs to be rebuilt
                 boost::this_thread::interruption_point();
                 if (!fGenerateVerium)
                     break;
-                if (ShutdownRequested())
+                if (ShutdownRequested()) {
+                    free(scratchbuf);
                     return;
+                }
                 if ( connman->GetNodeCount(CConnman::CONNECTIONS_ALL) < 1)
                     break;
                 if (pblock->nNonce >= 0xffff0000)
                     break;
-                if (mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast && GetTime() - nStart > 60)
+                if (mempool.GetTransactionsUpdated() != work.nTransactionsUpdated && GetTime() - work.nTemplateTime > 60)
                     break;
-                if (pindexPrev != ::ChainActive().Tip())
+                if (producer->Generation() != work.nGeneration)
                     break;
 
                 // Update nTime every few seconds
@@ -679,40 +800,484 @@ void Miner(CWallet *pwallet, CConnman* connman)
     catch (boost::thread_interrupted)
     {
         free(scratchbuf);
-        hashrate = 0;
         LogPrintf("Miner terminated\n");
         throw;
     }
+    free(scratchbuf);
 }
 
-void GenerateVerium(bool fGenerate, CWallet* pwallet, int nThreads, CConnman* connman)
+/**
+ * Plan the CPUs and NUMA node of each miner thread from -minerthreads,
+ * -minernuma and -minerleavepar. nThreads < 0 becomes one thread per usable core.
+ */
+static std::vector<std::pair<std::vector<int>, int>> PlanMinerPlacement(int& nThreads)
 {
-    fGenerateVerium = fGenerate;
-    static boost::thread_group* minerThreads = NULL;
-
+    const std::string layout = gArgs.GetArg("-minerthreads", DEFAULT_MINER_THREADS_LAYOUT);
+    const bool fNuma = gArgs.GetArg("-minernuma", DEFAULT_MINER_NUMA) == "auto";
+    std::vector<std::vector<int>> nodes = GetNumaNodeCpus();
+
+    // The script-check threads are not pinned; keeping the miner off the
+    // last cores leaves the scheduler somewhere to put them.
+    size_t nCpus = 0;
+    for (const auto& node : nodes)
+        nCpus += node.size();
+    if (gArgs.GetBoolArg("-minerleavepar", DEFAULT_MINER_LEAVE_PAR)) {
+        size_t nReserve = std::min<size_t>(g_script_check_threads, nCpus - 1);
+        nCpus -= nReserve;
+        while (nReserve > 0) {
+            nodes.back().pop_back();
+            if (nodes.back().empty())
+                nodes.pop_back();
+            --nReserve;
+        }
+    }
     if (nThreads < 0)
-        nThreads = std::thread::hardware_concurrency();
+        nThreads = nCpus;
+
+    std::vector<std::pair<std::vector<int>, int>> placement(nThreads, {std::vector<int>(), -1});
+    if (layout == "os") {
+        // Only bind threads to whole nodes, and only where there is more than one
+        if (fNuma && nodes.size() > 1) {
+            for (int i = 0; i < nThreads; i++)
+                placement[i] = {nodes[i % nodes.size()], (int)(i % nodes.size())};
+        }
+        return placement;
+    }
+
+    // Order the cores so that thread i takes the i-th one: node by node for
+    // compact, alternating between nodes for spread.
+    std::vector<std::pair<int, int>> order;
+    if (layout == "spread" && fNuma) {
+        for (size_t i = 0; order.size() < nCpus; i++) {
+            for (size_t node = 0; node < nodes.size(); node++) {
+                if (i < nodes[node].size())
+                    order.emplace_back(nodes[node][i], node);
+            }
+        }
+    } else {
+        for (size_t node = 0; node < nodes.size(); node++) {
+            for (int cpu : nodes[node])
+                order.emplace_back(cpu, node);
+        }
+    }
+    for (int i = 0; i < nThreads; i++) {
+        const auto& cpu = order[i % order.size()];
+        placement[i] = {{cpu.first}, cpu.second};
+    }
+    return placement;
+}
+
+// Held across a whole start or stop, including the join of the old threads,
+// which never take it themselves.
+static Mutex cs_miner_threads;
+static std::unique_ptr<boost::thread_group> g_miner_threads GUARDED_BY(cs_miner_threads);
+static std::shared_ptr<MinerTemplateProducer> g_miner_producer GUARDED_BY(cs_miner_threads);
+
+bool GenerateVerium(bool fGenerate, std::shared_ptr<CWallet> pwallet, int nThreads, CConnman* connman)
+{
+    LOCK(cs_miner_threads);
+    fGenerateVerium = fGenerate;
 
-    if (minerThreads != NULL)
+    // Join the old threads, so none of them uses the wallet once we return
+    if (g_miner_threads)
+    {
+        g_miner_threads->interrupt_all();
+        g_miner_threads->join_all();
+        g_miner_threads.reset();
+    }
+    if (g_miner_producer)
     {
-        minerThreads->interrupt_all();
-        delete minerThreads;
-        minerThreads = NULL;
+        UnregisterSharedValidationInterface(g_miner_producer);
+        g_miner_producer.reset();
     }
+    WITH_LOCK(cs_miner_stats, g_miner_stats.clear());
 
     if (nThreads == 0 || !fGenerate)
+        return true;
+
+    g_miner_producer = std::make_shared<MinerTemplateProducer>(pwallet);
+    if (!g_miner_producer->Init())
+    {
+        g_miner_producer.reset();
+        fGenerateVerium = false;
+        return false;
+    }
+    RegisterSharedValidationInterface(g_miner_producer);
+
+    const auto placement = PlanMinerPlacement(nThreads);
+    LOCK(cs_miner_stats);
+    g_miner_threads.reset(new boost::thread_group());
+    for (int i = 0; i < nThreads; i++) {
+        g_miner_stats.push_back(std::make_shared<MinerThreadStats>(i, placement[i].first, placement[i].second));
+        g_miner_threads->create_thread(std::bind(&Miner, g_miner_producer, connman, g_miner_stats.back()));
+    }
+    return true;
+}
+
+bool IsGeneratingVerium()
+{
+    return fGenerateVerium;
+}
+
+std::vector<std::shared_ptr<const MinerThreadStats>> GetMinerThreadStats()
+{
+    LOCK(cs_miner_stats);
+    return std::vector<std::shared_ptr<const MinerThreadStats>>(g_miner_stats.begin(), g_miner_stats.end());
+}
+
+double GetMinerHashrate()
+{
+    double dHashrate = 0.0;
+    for (const auto& stats : GetMinerThreadStats())
+        dHashrate += stats->dHashesPerMin.load(std::memory_order_relaxed);
+    return dHashrate;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+////////////////////////// Vericoin Staker //////////////////////////////////
+////////////////////////////////////////////////////////////////////////////
+
+/** How far back the staker starts trying timestamps on a new block, in seconds */
+static const int64_t MAX_STAKE_SEARCH_INTERVAL = 60;
+/** How long the stakeable outputs of the wallet are reused on the same block, in seconds */
+static const int64_t STAKE_CANDIDATES_LIFETIME = 60;
+
+/**
+ * What the kernel search needs of a stakeable output, kept in one array so a
+ * thread trying a timestamp walks its outputs front to back.
+ */
+struct StakeKernelCandidate
+{
+    CStakeKernelData kernel;
+    CAmount nValue;
+    unsigned int nTimeTxPrev;
+    unsigned int nTimeBlockFrom;
+};
+
+/** The outputs of the wallet that can stake on top of pindexPrev */
+struct StakeCandidates
+{
+    CBlockIndex* pindexPrev{nullptr};
+    unsigned int nBits{0};
+    std::vector<StakeKernelCandidate> vKernels;
+    //! The outputs and the keys of vKernels, looked at once a kernel is found
+    std::vector<COutPoint> vPrevouts;
+    std::vector<CPubKey> vPubKeys;
+    CAmount nWeight{0};
+};
+
+/** Counters of one staker thread, written by it with relaxed atomics */
+struct StakerThreadStats
+{
+    std::atomic<uint64_t> nKernels{0};
+    std::atomic<double> dKernelsPerSec{0.0};
+    //! Chance of the thread's outputs to stake in one second, at the last timestamp tried
+    std::atomic<double> dChance{0.0};
+};
+
+/**
+ * Keeps the stakeable outputs of the wallet for the staker threads, each of
+ * which searches its share of them for kernels, and turns the kernels found
+ * into blocks.
+ */
+class StakeMinter
+{
+private:
+    std::shared_ptr<CWallet> m_wallet;
+    CTxMemPool* m_mempool;
+
+    Mutex m_mutex;
+    std::shared_ptr<const StakeCandidates> m_candidates GUARDED_BY(m_mutex);
+    int64_t m_candidates_time GUARDED_BY(m_mutex){0};
+
+    /** Held while a found kernel is turned into a block, so two threads never stake the same block */
+    Mutex m_submit_mutex;
+
+    /** Stops the staker when the wallet is unloaded; declared after m_wallet so it disconnects first */
+    std::unique_ptr<interfaces::Handler> m_unload_handler;
+
+    std::shared_ptr<const StakeCandidates> BuildCandidates() EXCLUSIVE_LOCKS_REQUIRED(m_mutex);
+
+public:
+    const std::vector<std::unique_ptr<StakerThreadStats>> m_thread_stats;
+    std::atomic<size_t> m_num_candidates{0};
+    std::atomic<CAmount> m_weight{0};
+    std::atomic<uint64_t> m_stakes_found{0};
+    /** Set to make the staker threads exit and drop their reference to the wallet */
+    std::atomic<bool> m_stopped{false};
+
+    StakeMinter(std::shared_ptr<CWallet> wallet, CTxMemPool* mempool, int nThreads)
+        : m_wallet(wallet), m_mempool(mempool), m_thread_stats(MakeThreadStats(nThreads))
+    {
+        m_unload_handler = interfaces::MakeHandler(m_wallet->NotifyUnload.connect(StopStakeMinter));
+    }
+
+    static std::vector<std::unique_ptr<StakerThreadStats>> MakeThreadStats(int nThreads)
+    {
+        std::vector<std::unique_ptr<StakerThreadStats>> stats;
+        for (int i = 0; i < nThreads; i++)
+            stats.emplace_back(new StakerThreadStats());
+        return stats;
+    }
+
+    /**
+     * The stakeable outputs on top of the tip, rebuilt if the tip changed or
+     * if they are over a minute old. Null if the wallet is locked.
+     */
+    std::shared_ptr<const StakeCandidates> GetCandidates() LOCKS_EXCLUDED(m_mutex);
+
+    /** Build, sign and process the block staking output nIndex of candidates at nTimeTx */
+    bool SubmitStake(const StakeCandidates& candidates, size_t nIndex, unsigned int nTimeTx) LOCKS_EXCLUDED(m_submit_mutex);
+};
+
+std::shared_ptr<const StakeCandidates> StakeMinter::GetCandidates()
+{
+    LOCK(m_mutex);
+    const CBlockIndex* pindexTip = WITH_LOCK(cs_main, return ::ChainActive().Tip());
+    if (!m_candidates || m_candidates->pindexPrev != pindexTip || GetTime() - m_candidates_time > STAKE_CANDIDATES_LIFETIME) {
+        m_candidates = BuildCandidates();
+        m_candidates_time = GetTime();
+        m_num_candidates.store(m_candidates ? m_candidates->vKernels.size() : 0, std::memory_order_relaxed);
+        m_weight.store(m_candidates ? m_candidates->nWeight : 0, std::memory_order_relaxed);
+    }
+    return m_candidates;
+}
+
+std::shared_ptr<const StakeCandidates> StakeMinter::BuildCandidates()
+{
+    const Consensus::Params& params = Params().GetConsensus();
+    auto candidates = std::make_shared<StakeCandidates>();
+
+    if (m_wallet->IsLocked())
+        return nullptr;
+
+    // The outputs old enough to stake before the candidates are rebuilt. The
+    // wallet keeps them up to date under a lock of its own, so this neither
+    // scans the wallet nor holds up sends.
+    const std::vector<CStakeableOutput> vOutputs = m_wallet->GetStakeableOutputs(GetAdjustedTime() + STAKE_CANDIDATES_LIFETIME);
+
+    LOCK(cs_main);
+    candidates->pindexPrev = ::ChainActive().Tip();
+    if (!candidates->pindexPrev)
+        return nullptr;
+    candidates->nBits = GetNextTargetRequired(candidates->pindexPrev, params);
+
+    for (const CStakeableOutput& out : vOutputs) {
+        const int nDepth = candidates->pindexPrev->nHeight - out.nHeight + 1;
+        if (nDepth < 1 || (out.fCoinBase && nDepth < params.nCoinbaseMaturity))
+            continue;
+
+        const CBlockIndex* pindexFrom = LookupBlockIndex(out.hashBlock);
+        if (!pindexFrom || candidates->pindexPrev->GetAncestor(pindexFrom->nHeight) != pindexFrom)
+            continue;
+
+        candidates->vKernels.push_back({CStakeKernelData(candidates->pindexPrev->nStakeModifier, pindexFrom->GetBlockTime(), out.prevout, out.nTime),
+            out.nValue, out.nTime, (unsigned int)pindexFrom->GetBlockTime()});
+        candidates->vPrevouts.push_back(out.prevout);
+        candidates->vPubKeys.push_back(out.pubkey);
+        candidates->nWeight += out.nValue;
+    }
+    return candidates;
+}
+
+bool StakeMinter::SubmitStake(const StakeCandidates& candidates, size_t nIndex, unsigned int nTimeTx)
+{
+    LOCK(m_submit_mutex);
+    const Consensus::Params& params = Params().GetConsensus();
+    CBlockIndex* pindexPrev = candidates.pindexPrev;
+    if (WITH_LOCK(cs_main, return ::ChainActive().Tip()) != pindexPrev)
+        return false;
+
+    std::unique_ptr<CBlockTemplate> pblocktemplate;
+    try {
+        pblocktemplate = BlockAssembler(*m_mempool, Params()).CreateNewBlock(CScript(), nTimeTx);
+    } catch (const std::runtime_error& e) {
+        return error("%s: %s", __func__, e.what());
+    }
+    CBlock& block = pblocktemplate->block;
+    if (block.hashPrevBlock != pindexPrev->GetBlockHash())
+        return false;
+
+    // The staked output goes back to its key with the reward and the fees
+    CMutableTransaction txCoinStake;
+    txCoinStake.nTime = nTimeTx;
+    txCoinStake.vin.emplace_back(candidates.vPrevouts[nIndex]);
+    txCoinStake.vout.emplace_back();
+    txCoinStake.vout[0].SetEmpty();
+    txCoinStake.vout.emplace_back(candidates.vKernels[nIndex].nValue, CScript() << ToByteVector(candidates.vPubKeys[nIndex]) << OP_CHECKSIG);
+    {
+        LOCK(cs_main);
+        CCoinsViewCache view(&::ChainstateActive().CoinsTip());
+        uint64_t nCoinAge;
+        if (!GetCoinAge(CTransaction(txCoinStake), view, nCoinAge, pindexPrev))
+            return error("%s: cannot get the coin age of the coinstake", __func__);
+        txCoinStake.vout[1].nValue += GetProofOfStakeReward(nCoinAge, -pblocktemplate->vTxFees[0], pindexPrev, params);
+    }
+    {
+        LOCK(m_wallet->cs_wallet);
+        if (!m_wallet->SignTransaction(txCoinStake))
+            return error("%s: cannot sign the coinstake", __func__);
+    }
+
+    block.vtx.insert(block.vtx.begin() + 1, MakeTransactionRef(std::move(txCoinStake)));
+    WITH_LOCK(cs_main, GenerateCoinbaseCommitment(block, pindexPrev, params));
+    block.hashMerkleRoot = BlockMerkleRoot(block);
+    if (!SignBlock(block, *m_wallet))
+        return error("%s: cannot sign the block", __func__);
+
+    LogPrintf("Found stake: %s", block.ToString());
+    if (!ProcessNewBlock(Params(), std::make_shared<const CBlock>(block), true, nullptr))
+        return error("%s: block not accepted", __func__);
+    m_stakes_found.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+static void StakeMiner(std::shared_ptr<StakeMinter> minter, int nThread, CConnman* connman)
+{
+    LogPrintf("Staker thread %d started\n", nThread);
+    SetThreadPriority(THREAD_PRIORITY_LOWEST);
+    util::ThreadRename(strprintf("stake-%d", nThread));
+
+    const Consensus::Params& params = Params().GetConsensus();
+    const int nThreads = minter->m_thread_stats.size();
+    StakerThreadStats& stats = *minter->m_thread_stats[nThread];
+
+    // This thread's share of the outputs, and their targets at the timestamp being tried
+    std::shared_ptr<const StakeCandidates> candidates;
+    size_t nBegin = 0;
+    std::vector<StakeKernelCandidate> vKernels;
+    std::vector<arith_uint256> vTargets;
+    int64_t nLastSearchTime = 0;
+
+    int64_t nMeterStart = GetTimeMillis();
+    uint64_t nMeterKernels = 0;
+
+    try
+    {
+        while (!minter->m_stopped)
+        {
+            boost::this_thread::sleep_for(boost::chrono::milliseconds(500));
+            if (minter->m_stopped)
+                break;
+            if (::ChainstateActive().IsInitialBlockDownload() || connman->GetNodeCount(CConnman::CONNECTIONS_ALL) < 1 || ::ChainActive().Tip()->nHeight < connman->GetBestHeight())
+                continue;
+
+            std::shared_ptr<const StakeCandidates> latest = minter->GetCandidates();
+            if (!latest) {
+                stats.dChance.store(0, std::memory_order_relaxed);
+                continue;
+            }
+            if (latest != candidates) {
+                if (!candidates || candidates->pindexPrev != latest->pindexPrev)
+                    nLastSearchTime = 0;
+                candidates = latest;
+                const size_t nSize = candidates->vKernels.size();
+                nBegin = nSize * nThread / nThreads;
+                vKernels.assign(candidates->vKernels.begin() + nBegin, candidates->vKernels.begin() + nSize * (nThread + 1) / nThreads);
+                vTargets.resize(vKernels.size());
+            }
+
+            // Every second not tried yet is a timestamp the coinstake and block may have
+            CBlockIndex* pindexPrev = candidates->pindexPrev;
+            const int64_t nNow = GetAdjustedTime();
+            const int64_t nSearchFrom = std::max(std::max(nLastSearchTime + 1, pindexPrev->GetMedianTimePast() + 1), nNow - MAX_STAKE_SEARCH_INTERVAL);
+            uint64_t nKernels = 0;
+            double dChance = 0;
+            bool fFound = false;
+            for (int64_t nTimeTx = nSearchFrom; nTimeTx <= nNow && !fFound; nTimeTx++)
+            {
+                // Targets first, then a tight loop over the hashes
+                dChance = 0;
+                for (size_t i = 0; i < vKernels.size(); i++) {
+                    const StakeKernelCandidate& candidate = vKernels[i];
+                    if (candidate.nTimeBlockFrom + params.nStakeMinAge > nTimeTx)
+                        vTargets[i] = 0;
+                    else
+                        vTargets[i] = GetStakeKernelTarget(candidates->nBits, candidate.nValue, candidate.nTimeTxPrev, nTimeTx, pindexPrev, params);
+                    dChance += ldexp(vTargets[i].getdouble(), -256);
+                }
+                for (size_t i = 0; i < vKernels.size(); i++) {
+                    if (vTargets[i] == 0)
+                        continue;
+                    nKernels++;
+                    if (UintToArith256(vKernels[i].kernel.GetHash(nTimeTx)) <= vTargets[i]) {
+                        SetThreadPriority(THREAD_PRIORITY_NORMAL);
+                        fFound = minter->SubmitStake(*candidates, nBegin + i, nTimeTx);
+                        SetThreadPriority(THREAD_PRIORITY_LOWEST);
+                        if (fFound)
+                            break;
+                    }
+                }
+            }
+            nLastSearchTime = std::max(nLastSearchTime, nNow);
+            stats.dChance.store(dChance, std::memory_order_relaxed);
+
+            // Kernel meter
+            stats.nKernels.fetch_add(nKernels, std::memory_order_relaxed);
+            nMeterKernels += nKernels;
+            if (GetTimeMillis() - nMeterStart > timeElapsed)
+            {
+                stats.dKernelsPerSec.store(1000.0 * nMeterKernels / (GetTimeMillis() - nMeterStart), std::memory_order_relaxed);
+                nMeterStart = GetTimeMillis();
+                nMeterKernels = 0;
+            }
+        }
+    }
+    catch (const boost::thread_interrupted&)
+    {
+        LogPrintf("Staker thread %d terminated\n", nThread);
+        throw;
+    }
+    LogPrintf("Staker thread %d stopped\n", nThread);
+}
+
+static Mutex cs_stake_minter;
+static std::shared_ptr<StakeMinter> g_stake_minter GUARDED_BY(cs_stake_minter);
+
+void MintStake(boost::thread_group& threadGroup, std::shared_ptr<CWallet> pwallet, CConnman* connman, CTxMemPool* mempool)
+{
+    if (!IsVericoin())
         return;
 
-    minerThreads = new boost::thread_group();
+    int nThreads = gArgs.GetArg("-stakethreads", DEFAULT_STAKE_THREADS);
+    if (nThreads <= 0)
+        nThreads = GetNumCores();
+
+    LOCK(cs_stake_minter);
+    g_stake_minter = std::make_shared<StakeMinter>(pwallet, mempool, nThreads);
     for (int i = 0; i < nThreads; i++)
-        minerThreads->create_thread(std::bind(&Miner, pwallet, connman));
+        threadGroup.create_thread(std::bind(&StakeMiner, g_stake_minter, i, connman));
 }
 
-void updateHashrate(double nHashrate)
+void StopStakeMinter()
 {
-    hashrate = nHashrate;
+    std::shared_ptr<StakeMinter> minter;
+    {
+        LOCK(cs_stake_minter);
+        minter.swap(g_stake_minter);
+    }
+    if (minter)
+        minter->m_stopped = true;
 }
 
-void MintStake(boost::thread_group& threadGroup, std::shared_ptr<CWallet> pwallet, CConnman* connman, CTxMemPool* mempool)
+StakingInfo GetStakingInfo()
 {
+    std::shared_ptr<StakeMinter> minter = WITH_LOCK(cs_stake_minter, return g_stake_minter);
+    StakingInfo info;
+    if (!minter)
+        return info;
+
+    info.fEnabled = true;
+    info.nThreads = minter->m_thread_stats.size();
+    info.nCandidates = minter->m_num_candidates.load(std::memory_order_relaxed);
+    info.nWeight = minter->m_weight.load(std::memory_order_relaxed);
+    double dChance = 0;
+    for (const auto& stats : minter->m_thread_stats) {
+        info.nKernels += stats->nKernels.load(std::memory_order_relaxed);
+        info.dKernelsPerSec += stats->dKernelsPerSec.load(std::memory_order_relaxed);
+        dChance += stats->dChance.load(std::memory_order_relaxed);
+    }
+    info.dExpectedTime = dChance > 0 ? 1 / dChance : 0;
+    info.nStakesFound = minter->m_stakes_found.load(std::memory_order_relaxed);
+    return info;
 }
\ No newline at end of file
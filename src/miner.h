@@ -11,8 +11,10 @@
 #include <txmempool.h>
 #include <validation.h>
 
+#include <atomic>
 #include <memory>
 #include <stdint.h>
+#include <vector>
 
 #include <boost/multi_index_container.hpp>
 #include <boost/multi_index/ordered_index.hpp>
@@ -26,6 +28,14 @@ class CWallet;
 namespace Consensus { struct Params; };
 
 static const bool DEFAULT_PRINTPRIORITY = false;
+/** Default for -minerthreads, the placement of the built-in miner threads */
+static const char* const DEFAULT_MINER_THREADS_LAYOUT = "os";
+/** Default for -minernuma */
+static const char* const DEFAULT_MINER_NUMA = "auto";
+/** Default for -minerleavepar */
+static const bool DEFAULT_MINER_LEAVE_PAR = false;
+/** Default for -stakethreads */
+static const int DEFAULT_STAKE_THREADS = 1;
 
 struct CBlockTemplate
 {
@@ -159,8 +169,13 @@ public:
     explicit BlockAssembler(const CTxMemPool& mempool, const CChainParams& params);
     explicit BlockAssembler(const CTxMemPool& mempool, const CChainParams& params, const Options& options);
 
-    /** Construct a new block template with coinbase to scriptPubKeyIn */
-    std::unique_ptr<CBlockTemplate> CreateNewBlock(const CScript& scriptPubKeyIn);
+    /**
+     * Construct a new block template with coinbase to scriptPubKeyIn. With
+     * nCoinStakeTime set, construct a proof-of-stake block with that time
+     * and an empty coinbase instead, for the caller to add the coinstake,
+     * witness commitment and signature; it is not checked for validity.
+     */
+    std::unique_ptr<CBlockTemplate> CreateNewBlock(const CScript& scriptPubKeyIn, int64_t nCoinStakeTime = 0);
 
     static Optional<int64_t> m_last_block_num_txs;
     static Optional<int64_t> m_last_block_weight;
@@ -184,7 +199,7 @@ private:
     /** Test if a new package would "fit" in the block */
     bool TestPackage(uint64_t packageSize, int64_t packageSigOpsCost) const;
     /** Perform checks on each transaction in a package:
-      * locktime, premature-witness, serialized size (if necessary)
+      * locktime, timestamp, premature-witness, serialized size (if necessary)
       * These checks should always succeed, and they're here
       * only as an extra check in case of suboptimal node configuration */
     bool TestPackageTransactions(const CTxMemPool::setEntries& package);
@@ -203,21 +218,93 @@ private:
 void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned int& nExtraNonce);
 int64_t UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParams, const CBlockIndex* pindexPrev);
 
+/** Check a solved block against its target and the tip, and process it like one received from a peer */
+bool CheckWork(CBlock* pblock);
+
 /** Base sha256 mining transform */
 void SHA256Transform(void* pstate, void* pinput, const void* pinit);
 
-void GenerateVerium(bool fGenerate, CWallet* pwallet, int nThreads, CConnman* connman);
+/**
+ * Counters of one built-in miner thread. Only the owning thread writes them,
+ * with relaxed atomics, so reporting never stalls the hashing loop.
+ */
+struct MinerThreadStats
+{
+    const int nThread;
+    /** CPUs the thread is meant to be pinned to, empty to leave it to the scheduler */
+    const std::vector<int> vCpus;
+    /** NUMA node of those CPUs, -1 if unpinned */
+    const int nNumaNode;
+    /** Whether pinning the thread to vCpus succeeded */
+    std::atomic<bool> fPinned{false};
+    /** Whether the thread got its scrypt scratchpad */
+    std::atomic<bool> fScratchpad{false};
+    /** Hashes done since the thread started */
+    std::atomic<uint64_t> nHashes{0};
+    /** Hash rate over the last completed meter period */
+    std::atomic<double> dHashesPerMin{0.0};
+    /** Time the block being hashed was assembled, 0 if none yet */
+    std::atomic<int64_t> nTemplateTime{0};
+    /** Blocks found by this thread and accepted locally */
+    std::atomic<uint64_t> nBlocksFound{0};
+
+    MinerThreadStats(int nThreadIn, std::vector<int> vCpusIn, int nNumaNodeIn) : nThread(nThreadIn), vCpus(std::move(vCpusIn)), nNumaNode(nNumaNodeIn) {}
+};
+
+class MinerTemplateProducer;
+
+/**
+ * Start nThreads miner threads (all cores if negative), or stop mining if fGenerate is false.
+ * Running miner threads are joined first, and mining stops by itself once pwallet is unloaded.
+ * Returns false if no payout address could be reserved from the wallet.
+ */
+bool GenerateVerium(bool fGenerate, std::shared_ptr<CWallet> pwallet, int nThreads, CConnman* connman);
+
+void Miner(std::shared_ptr<MinerTemplateProducer> producer, CConnman* connman, std::shared_ptr<MinerThreadStats> stats);
 
-void Miner(CWallet *pwallet, CConnman* connman);
+/** Whether the built-in miner is running */
+bool IsGeneratingVerium();
 
-void updateHashrate(double nHashrate);
+/** Counters of the currently running miner threads */
+std::vector<std::shared_ptr<const MinerThreadStats>> GetMinerThreadStats();
 
-extern double hashrate;
+/** Sum of the hash rates of the running miner threads, in hashes per minute */
+double GetMinerHashrate();
 
 namespace boost {
     class thread_group;
 } // namespace boost
 
+/**
+ * Start -stakethreads threads staking the outputs of pwallet, on Vericoin.
+ * They stop with the rest of threadGroup, or once pwallet is unloaded.
+ */
 void MintStake(boost::thread_group& threadGroup, std::shared_ptr<CWallet> pwallet, CConnman* connman, CTxMemPool* mempool);
 
+/**
+ * Make the staker threads exit and drop the staker, so it no longer holds
+ * its wallet. Called on wallet unload and once threadGroup has been joined.
+ */
+void StopStakeMinter();
+
+/** Progress of the staker, see GetStakingInfo() */
+struct StakingInfo
+{
+    /** Whether the staker threads run */
+    bool fEnabled{false};
+    int nThreads{0};
+    /** Outputs being staked, and their value; none while the wallet is locked */
+    size_t nCandidates{0};
+    CAmount nWeight{0};
+    /** Kernel hashes tried since start, and per second over the last meter period */
+    uint64_t nKernels{0};
+    double dKernelsPerSec{0.0};
+    /** Expected seconds until a stake is found at the current target, 0 if never */
+    double dExpectedTime{0.0};
+    /** Blocks staked and accepted locally */
+    uint64_t nStakesFound{0};
+};
+
+StakingInfo GetStakingInfo();
+
 #endif // BITCOIN_MINER_H
@@ -127,7 +127,7 @@ PSBTAnalysis AnalyzePSBT(PartiallySignedTransaction psbtx)
             } else {
                 mtx.vin[i].scriptSig = input.final_script_sig;
                 mtx.vin[i].scriptWitness = input.final_script_witness;
-                newcoin.nHeight = 1;
+                newcoin.SetHeight(1);
                 view.AddCoin(psbtx.tx->vin[i].prevout, std::move(newcoin), true);
             }
         }
@@ -6,19 +6,18 @@
 
 #include <amount.h>
 #include <arith_uint256.h>
-#include <bignum.h>
 #include <chain.h>
-#include <index/txindex.h>
+#include <crypto/common.h>
+#include <hash.h>
 #include <net.h>
+#include <pow.h>
 #include <primitives/block.h>
+#include <script/sigcache.h>
 #include <validation.h>
 #include <uint256.h>
 
 double GetDifficulty(const CBlockIndex* blockindex = nullptr);
 
-static int nAverageStakeWeightHeightCached = 0;
-static double dAverageStakeWeightCached = 0;
-
 unsigned int GetNextTargetRequired(const CBlockIndex* pindexLast, const Consensus::Params& params)
 {
     arith_uint256 bnTargetLimit = pindexLast->IsProofOfWork() ? params.powLimit : params.posLimit;
@@ -45,66 +44,80 @@ unsigned int GetNextTargetRequired(const CBlockIndex* pindexLast, const Consensu
 
     // ppcoin: target change every block
     // ppcoin: retarget with exponential moving toward target spacing
-    CBigNum bnNew;
-    bnNew.SetCompact(pindexPrev->nBits);
-
+    // Protocol change, NextTargetV2: a target that is not positive is clamped too
     int64_t nInterval = params.nTargetTimespan / params.nStakeTargetSpacing;
-    bnNew *= ((nInterval - 1) * params.nStakeTargetSpacing + nActualSpacing + nActualSpacing);
-    bnNew /= ((nInterval + 1) * params.nStakeTargetSpacing);
-
-    // Protocol change, NextTargetV2. Split the if to be more readable
-    if (pindexLast->nHeight < params.NextTargetV2Height)
-    {
-        if (bnNew > CBigNum(ArithToUint256(bnTargetLimit)))
-            bnNew = CBigNum(ArithToUint256(bnTargetLimit));
-    }
-    else
-    {
-        if (bnNew <= 0 || bnNew > CBigNum(ArithToUint256(bnTargetLimit)))
-            bnNew = CBigNum(ArithToUint256(bnTargetLimit));
-    }
-
-    return bnNew.GetCompact();
+    return ScaleCompactTarget(pindexPrev->nBits, (nInterval - 1) * params.nStakeTargetSpacing + nActualSpacing + nActualSpacing,
+                              (nInterval + 1) * params.nStakeTargetSpacing, bnTargetLimit, pindexLast->nHeight >= params.NextTargetV2Height);
 }
 
-double GetPoSKernelPS(CBlockIndex* pindexPrev, const Consensus::Params& params)
+// Kernels tried per second over the last 72 proof-of-stake blocks up to and
+// including pindex.
+//
+// This walks the window again for every stake block instead of keeping a
+// running sum in CBlockIndex. The stake reward depends on the result bit for
+// bit, and the sum of doubles is rounded newest term first: a running sum
+// that adds the new block and subtracts the one leaving the window rounds
+// differently, and nodes would disagree on the reward. The walk is bounded by
+// the 72 stake blocks and done once per block, as UpdateStakeWeightStats()
+// stores the result.
+static double ComputePoSKernelPS(const CBlockIndex* pindex)
 {
     int nPoSInterval = 72;
     double dStakeKernelsTriedAvg = 0;
     int nStakesHandled = 0, nStakesTime = 0;
-
-    CBlockIndex* pindex = pindexBestHeader;
-    CBlockIndex* pindexPrevStake = NULL;
+    const CBlockIndex* pindexPrevStake = nullptr;
 
     while (pindex && nStakesHandled < nPoSInterval)
     {
-
-        if (pindexPrev->IsProofOfStake())
+        if (pindex->IsProofOfStake())
         {
-            dStakeKernelsTriedAvg += GetDifficulty(pindexPrev) * 4294967296.0;;
-            nStakesTime += pindexPrevStake ? (pindexPrevStake->nTime - pindexPrev->nTime) : 0;
-            pindexPrevStake = pindexPrev;
+            dStakeKernelsTriedAvg += GetDifficulty(pindex) * 4294967296.0;
+            nStakesTime += pindexPrevStake ? (pindexPrevStake->nTime - pindex->nTime) : 0;
+            pindexPrevStake = pindex;
             nStakesHandled++;
         }
 
-        pindexPrev = pindexPrev->pprev;
+        pindex = pindex->pprev;
     }
 
-   return nStakesTime ? dStakeKernelsTriedAvg / nStakesTime : 0;
+    return nStakesTime ? dStakeKernelsTriedAvg / nStakesTime : 0;
 }
 
-double GetPoSKernelPS(CBlockIndex* pindexPrev)
+void UpdateStakeWeightStats(CBlockIndex* pindex)
 {
-    const Consensus::Params& consensusParams = Params().GetConsensus();
+    // A proof-of-work block has the same last stakes as its parent
+    if (pindex->IsProofOfWork() && pindex->pprev)
+        pindex->dKernelPS = pindex->pprev->dKernelPS;
+    else
+        pindex->dKernelPS = ComputePoSKernelPS(pindex);
 
-    return GetPoSKernelPS(pindexPrev, consensusParams);
+    // Summed in the same order as ComputePoSKernelPS(), and walked for the
+    // same reason
+    double weightSum = 0;
+    const CBlockIndex* currentBlockIndex = pindex;
+    int i;
+    for (i = 0; currentBlockIndex && i < 60; i++)
+    {
+        weightSum += currentBlockIndex->dKernelPS;
+        currentBlockIndex = currentBlockIndex->pprev;
+    }
+    pindex->dAverageStakeWeight = (weightSum/i)+21;
 }
 
-double GetPoSKernelPS()
+double GetPoSKernelPS(CBlockIndex* pindexPrev, const Consensus::Params& params)
+{
+    return pindexPrev->dKernelPS;
+}
+
+double GetPoSKernelPS(CBlockIndex* pindexPrev)
 {
-    const Consensus::Params& consensusParams = Params().GetConsensus();
+    return pindexPrev->dKernelPS;
+}
 
-    return GetPoSKernelPS(pindexBestHeader, consensusParams);
+double GetPoSKernelPS()
+{
+    LOCK(cs_main);
+    return pindexBestHeader ? pindexBestHeader->dKernelPS : 0;
 }
 
 // get current inflation rate using average stake weight ~1.5-2.5% (measure of liquidity) PoST
@@ -128,33 +141,7 @@ double GetCurrentInterestRate(CBlockIndex* pindexPrev, const Consensus::Params&
 // get average stake weight of last 60 blocks PoST
 double GetAverageStakeWeight(CBlockIndex* pindexPrev)
 {
-    double weightSum = 0, weightAve = 0;
-    // XXX: Need to retrieve connman
-    //if (g_connman.GetBestHeight() < 1)
-    //    return weightAve;
-
-    // Use cached weight if it's still valid
-    if (pindexPrev->nHeight == nAverageStakeWeightHeightCached)
-    {
-        return dAverageStakeWeightCached;
-    }
-    nAverageStakeWeightHeightCached = pindexPrev->nHeight;
-
-
-    CBlockIndex* currentBlockIndex = pindexPrev;
-    int i;
-    for (i = 0; currentBlockIndex && i < 60; i++)
-    {
-        double tempWeight = GetPoSKernelPS(currentBlockIndex);
-        weightSum += tempWeight;
-        currentBlockIndex = currentBlockIndex->pprev;
-    }
-    weightAve = (weightSum/i)+21;
-
-    // Cache the stake weight value
-    dAverageStakeWeightCached = weightAve;
-
-    return weightAve;
+    return pindexPrev->dAverageStakeWeight;
 }
 
 // get stake time factored weight for reward and hash PoST
@@ -222,65 +209,48 @@ bool GetCoinAge(const CTransaction& tx, const CCoinsViewCache &view, uint64_t& n
     if (tx.IsCoinBase())
         return true;
 
-    // Transaction index is required to get to block header
-    if (!g_txindex)
-        return false;  // Transaction index not available
-
+    const Consensus::Params& params = Params().GetConsensus();
+    const bool fPrintCoinAge = gArgs.GetBoolArg("-printcoinage", false);
     for (const auto& txin : tx.vin)
     {
-        // First try finding the previous transaction in database
+        // The coin carries everything but the time of its block, which the
+        // block index has in memory
         const COutPoint &prevout = txin.prevout;
-        Coin coin;
+        const Coin& coin = view.AccessCoin(prevout);
 
-        if (!view.GetCoin(prevout, coin))
+        if (coin.IsSpent())
             continue;  // previous transaction not in main chain
         if (tx.nTime < coin.nTime)
             return false;  // Transaction timestamp violation
+        if (coin.GetHeight() > pindexPrev->nHeight)
+            return error("%s() : input %s not yet in a block in GetCoinAge()", __PRETTY_FUNCTION__, prevout.ToString());
+
+        const CBlockIndex* pindexFrom = pindexPrev->GetAncestor(coin.GetHeight());
+        if (pindexFrom->GetBlockTime() + params.nStakeMinAge > tx.nTime)
+            continue; // only count coins meeting min age requirement
 
-        CDiskTxPos postx;
-        CTransactionRef txPrev;
-        if (g_txindex->FindTxPosition(prevout.hash, postx))
+        int64_t nValueIn = coin.out.nValue;
+        int timeWeight = tx.nTime-coin.nTime;
+
+        if (pindexPrev->nHeight+1 > params.PoSTHeight )
         {
-            CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
-            CBlockHeader header;
-            try {
-                file >> header;
-                fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
-                file >> txPrev;
-            } catch (std::exception &e) {
-                return error("%s() : deserialize or I/O error in GetCoinAge()", __PRETTY_FUNCTION__);
-            }
-            if (txPrev->GetHash() != prevout.hash)
-                return error("%s() : txid mismatch in GetCoinAge()", __PRETTY_FUNCTION__);
-
-            if (header.GetBlockTime() + Params().GetConsensus().nStakeMinAge > tx.nTime)
-                continue; // only count coins meeting min age requirement
-
-            int64_t nValueIn = txPrev->vout[txin.prevout.n].nValue;
-            int timeWeight = tx.nTime-txPrev->nTime;
-
-            if (pindexPrev->nHeight+1 > Params().GetConsensus().PoSTHeight )
-            {
-                int64_t CoinDay = nValueIn * timeWeight / COIN / (24 * 60 * 60);
-                int64_t factoredTimeWeight = GetStakeTimeFactoredWeight(timeWeight, CoinDay, pindexPrev);
-                bnCoinDay += arith_uint256(nValueIn) * factoredTimeWeight / COIN / (24 * 60 * 60);
-            }
-            else
-            {
-                bnCentSecond += arith_uint256(nValueIn) * timeWeight / CENT;
-            }
-
-            if (gArgs.GetBoolArg("-printcoinage", false))
-                LogPrintf("coin age nValueIn=%-12lld nTimeDiff=%d bnCentSecond=%s\n", nValueIn, timeWeight, bnCentSecond.ToString());
+            int64_t CoinDay = nValueIn * timeWeight / COIN / (24 * 60 * 60);
+            int64_t factoredTimeWeight = GetStakeTimeFactoredWeight(timeWeight, CoinDay, pindexPrev);
+            bnCoinDay += arith_uint256(nValueIn) * factoredTimeWeight / COIN / (24 * 60 * 60);
         }
         else
-            return error("%s() : tx missing in tx index in GetCoinAge()", __PRETTY_FUNCTION__);
+        {
+            bnCentSecond += arith_uint256(nValueIn) * timeWeight / CENT;
+        }
+
+        if (fPrintCoinAge)
+            LogPrintf("coin age nValueIn=%-12lld nTimeDiff=%d bnCentSecond=%s\n", nValueIn, timeWeight, bnCentSecond.ToString());
     }
 
-    if ( pindexPrev->nHeight+1 <= Params().GetConsensus().PoSTHeight )
+    if ( pindexPrev->nHeight+1 <= params.PoSTHeight )
         bnCoinDay = bnCentSecond * CENT / COIN / (24 * 60 * 60);
 
-    if (gArgs.GetBoolArg("-printcoinage", false))
+    if (fPrintCoinAge)
         LogPrintf("coin age bnCoinDay=%s\n", bnCoinDay.ToString());
 
     nCoinAge = bnCoinDay.GetLow64();
@@ -321,9 +291,10 @@ bool CheckBlockSignature(const CBlock& block)
 
     const valtype& vchPubKey = vSolutions[0];
     CPubKey key(vchPubKey);
-    if (block.vchBlockSig.empty())
+    if (block.vchBlockSig.empty() || !key.IsValid())
         return false;
-    return key.Verify(block.GetHash(), block.vchBlockSig);
+    // Cached, so connecting the block again after a reorg does not verify it again
+    return CachingVerifySignature(block.vchBlockSig, key, block.GetHash(), true);
 }
 
 // Check whether the coinstake timestamp meets protocol
@@ -332,3 +303,67 @@ bool CheckCoinStakeTimestamp(int64_t nTimeBlock, int64_t nTimeTx)
     // v0.3 protocol
     return (nTimeBlock == nTimeTx);
 }
+
+CStakeKernelData::CStakeKernelData(uint64_t nStakeModifier, unsigned int nTimeBlockFrom, const COutPoint& prevout, unsigned int nTimeTxPrev)
+{
+    WriteLE64(m_data, nStakeModifier);
+    WriteLE32(m_data + 8, nTimeBlockFrom);
+    memcpy(m_data + 12, prevout.hash.begin(), 32);
+    WriteLE32(m_data + 44, nTimeTxPrev);
+    WriteLE32(m_data + 48, prevout.n);
+    WriteLE32(m_data + 52, 0);
+}
+
+uint256 CStakeKernelData::GetHash(unsigned int nTimeTx)
+{
+    WriteLE32(m_data + 52, nTimeTx);
+    uint256 hash;
+    CHash256().Write(m_data, SIZE).Finalize(hash.begin());
+    return hash;
+}
+
+arith_uint256 GetStakeKernelTarget(unsigned int nBits, CAmount nValueIn, unsigned int nTimeTxPrev, unsigned int nTimeTx, CBlockIndex* pindexPrev, const Consensus::Params& params)
+{
+    if (nTimeTx <= nTimeTxPrev)
+        return 0;
+
+    // Weighted as GetCoinAge() weighs the input
+    int64_t timeWeight = nTimeTx - nTimeTxPrev;
+    uint64_t nCoinDayWeight;
+    if (pindexPrev->nHeight+1 > params.PoSTHeight)
+    {
+        int64_t CoinDay = nValueIn * timeWeight / COIN / (24 * 60 * 60);
+        int64_t factoredTimeWeight = GetStakeTimeFactoredWeight(timeWeight, CoinDay, pindexPrev);
+        nCoinDayWeight = (arith_uint256(nValueIn) * factoredTimeWeight / COIN / (24 * 60 * 60)).GetLow64();
+    }
+    else
+    {
+        nCoinDayWeight = (arith_uint256(nValueIn) * timeWeight / COIN / (24 * 60 * 60)).GetLow64();
+    }
+    if (nCoinDayWeight == 0)
+        return 0;
+
+    arith_uint256 bnTargetPerCoinDay;
+    bool fNegative;
+    bool fOverflow;
+    bnTargetPerCoinDay.SetCompact(nBits, &fNegative, &fOverflow);
+    if (fNegative || fOverflow)
+        return 0;
+    const arith_uint256 bnCoinDayWeight(nCoinDayWeight);
+    const arith_uint256 bnMax = ~arith_uint256(0);
+    if (bnTargetPerCoinDay.bits() + bnCoinDayWeight.bits() > 256 && bnTargetPerCoinDay > bnMax / bnCoinDayWeight)
+        return bnMax;
+    return bnTargetPerCoinDay * bnCoinDayWeight;
+}
+
+bool CheckStakeKernelHash(unsigned int nBits, CBlockIndex* pindexPrev, const CBlockIndex* pindexFrom, const COutPoint& prevout, CAmount nValueIn, unsigned int nTimeTxPrev, unsigned int nTimeTx, uint256& hashProofOfStake)
+{
+    const Consensus::Params& params = Params().GetConsensus();
+    if (nTimeTx < nTimeTxPrev)
+        return error("%s : nTime violation", __func__);
+    if (pindexFrom->GetBlockTime() + params.nStakeMinAge > nTimeTx)
+        return error("%s : min age violation", __func__);
+
+    hashProofOfStake = CStakeKernelData(pindexPrev->nStakeModifier, pindexFrom->GetBlockTime(), prevout, nTimeTxPrev).GetHash(nTimeTx);
+    return UintToArith256(hashProofOfStake) <= GetStakeKernelTarget(nBits, nValueIn, nTimeTxPrev, nTimeTx, pindexPrev, params);
+}
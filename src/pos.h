@@ -6,18 +6,29 @@
 #ifndef BITCOIN_POS_H
 #define BITCOIN_POS_H
 
+#include <amount.h>
 #include <consensus/params.h>
+#include <uint256.h>
 
+class arith_uint256;
 class CBlockHeader;
 class CBlockIndex;
 class CBlock;
 class CWallet;
 class CTransaction;
 class CCoinsViewCache;
+class COutPoint;
 
 /** Get next required staking work **/
 unsigned int GetNextTargetRequired(const CBlockIndex* pindexLast, const Consensus::Params& params);
 
+/**
+ * Set the stake kernels per second and the average stake weight of a block
+ * index entry whose parent has them set already. Done once as the entry is
+ * added or loaded, so the reward and weight code only reads them.
+ */
+void UpdateStakeWeightStats(CBlockIndex* pindex);
+
 double GetPoSKernelPS(CBlockIndex* pindexPrev, const Consensus::Params& params);
 double GetPoSKernelPS(CBlockIndex* pindexPrev);
 double GetPoSKernelPS();
@@ -32,11 +43,43 @@ int64_t GetProofOfStakeReward(int64_t nCoinAge, int64_t nFees, CBlockIndex* pind
 
 bool GetCoinAge(const CTransaction& tx, const CCoinsViewCache &view, uint64_t& nCoinAge, CBlockIndex* pindexPre);
 bool SignBlock(CBlock& block, const CWallet& keystore);
+/** Verify the signature of a block by the key its coinstake pays to, through the signature cache */
 bool CheckBlockSignature(const CBlock& block);
 
 // Check whether the coinstake timestamp meets protocol
 bool CheckCoinStakeTimestamp(int64_t nTimeBlock, int64_t nTimeTx);
 
+/**
+ * What a stake kernel hashes of the staked output: the stake modifier, the
+ * time of the block and of the transaction that created the output, and the
+ * output itself. Serialized once per output, so that trying a timestamp
+ * only writes the timestamp and hashes.
+ */
+class CStakeKernelData
+{
+public:
+    static const size_t SIZE = 8 + 4 + 32 + 4 + 4 + 4;
+
+    CStakeKernelData(uint64_t nStakeModifier, unsigned int nTimeBlockFrom, const COutPoint& prevout, unsigned int nTimeTxPrev);
+
+    /** The kernel hash of staking the output at nTimeTx */
+    uint256 GetHash(unsigned int nTimeTx);
+
+private:
+    unsigned char m_data[SIZE];
+};
+
+/**
+ * The target the kernel hash of staking nValueIn, created at nTimeTxPrev, at
+ * nTimeTx on top of pindexPrev must meet: the target of nBits per coin-day,
+ * times the coin-day weight GetCoinAge() gives the output. Saturates rather
+ * than overflows.
+ */
+arith_uint256 GetStakeKernelTarget(unsigned int nBits, CAmount nValueIn, unsigned int nTimeTxPrev, unsigned int nTimeTx, CBlockIndex* pindexPrev, const Consensus::Params& params);
+
+/** Check the kernel of staking prevout at nTimeTx on top of pindexPrev, and return its hash */
+bool CheckStakeKernelHash(unsigned int nBits, CBlockIndex* pindexPrev, const CBlockIndex* pindexFrom, const COutPoint& prevout, CAmount nValueIn, unsigned int nTimeTxPrev, unsigned int nTimeTx, uint256& hashProofOfStake);
+
 
 static const double PI = 3.1415926535;
 
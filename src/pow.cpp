@@ -10,7 +10,6 @@
 #include <primitives/block.h>
 #include <uint256.h>
 #include <math.h>
-#include <bignum.h>
 #include <util/system.h>
 #include <timedata.h>
 #include <validation.h>
@@ -39,31 +38,110 @@ unsigned int GetNextWorkRequired(const CBlockIndex* pindexLast, const Consensus:
         targetTimespan = params.nPowTargetTimespan;
 
     // ppcoin: retarget with exponential moving toward target spacing (variable in Verium)
-    CBigNum bnNew;
-    bnNew.SetCompact(pindexPrev->nBits);
     int64_t nInterval = targetTimespan / nTargetSpacing;
-    bnNew *= ((nInterval - 1) * nTargetSpacing + nActualSpacing + nActualSpacing);
-    bnNew /= ((nInterval + 1) * nTargetSpacing);
+    return ScaleCompactTarget(pindexPrev->nBits, (nInterval - 1) * nTargetSpacing + nActualSpacing + nActualSpacing,
+                              (nInterval + 1) * nTargetSpacing, params.powLimit, false);
+}
 
-    if (bnNew > CBigNum(ArithToUint256(params.powLimit)))
-        bnNew = CBigNum(ArithToUint256(params.powLimit));
+// Divide with remainder. Retargets divide by timespans, which are below 2^32
+// and allow long division a word at a time; arith_uint256's division goes
+// bit by bit and would take most of the time of checking a header.
+static arith_uint256 DivideTarget(const arith_uint256& bnNum, uint64_t nDivisor, arith_uint256& bnRemainder)
+{
+    if (nDivisor > 0xffffffff) {
+        const arith_uint256 bnQuotient = bnNum / arith_uint256(nDivisor);
+        bnRemainder = bnNum - bnQuotient * arith_uint256(nDivisor);
+        return bnQuotient;
+    }
 
-    return bnNew.GetCompact();
+    arith_uint256 bnQuotient;
+    uint64_t nRemainder = 0;
+    for (int i = 7; i >= 0; i--) {
+        nRemainder = (nRemainder << 32) | ((bnNum >> (32 * i)).GetLow64() & 0xffffffff);
+        bnQuotient |= arith_uint256(nRemainder / nDivisor) << (32 * i);
+        nRemainder %= nDivisor;
+    }
+    bnRemainder = nRemainder;
+    return bnQuotient;
 }
 
+unsigned int ScaleCompactTarget(unsigned int nBits, int64_t nMultiplier, int64_t nDivisor, const arith_uint256& bnLimit, bool fClampNonPositive)
+{
+    assert(nDivisor > 0);
+
+    // The target is nWord * 2^nShift, see arith_uint256::SetCompact()
+    unsigned int nSize = nBits >> 24;
+    uint32_t nWord = nBits & 0x007fffff;
+    unsigned int nShift = 0;
+    if (nSize <= 3)
+        nWord >>= 8 * (3 - nSize);
+    else
+        nShift = 8 * (nSize - 3);
+    const bool fNegativeTarget = nWord != 0 && (nBits & 0x00800000) != 0;
+    const uint64_t nMultiplierAbs = nMultiplier < 0 ? (uint64_t)(-(nMultiplier + 1)) + 1 : nMultiplier;
+
+    // The product can be wider than 256 bits. Shift it as far as it fits and
+    // divide, which gives the quotient shifted right by the rest (flooring
+    // twice is flooring once). If the quotient has room, shift the rest into
+    // it and the remainder; otherwise its top bits are all it takes to
+    // encode it, or to see it is above the limit.
+    arith_uint256 bnProduct = arith_uint256(nWord) * arith_uint256(nMultiplierAbs);
+    unsigned int nDropped = 0;
+    if (bnProduct != 0) {
+        const unsigned int nFits = (256 - bnProduct.bits()) / 8 * 8;
+        if (nShift > nFits) {
+            nDropped = nShift - nFits;
+            nShift = nFits;
+        }
+    }
+    bnProduct <<= nShift;
+    arith_uint256 bnRemainder;
+    arith_uint256 bnNew = DivideTarget(bnProduct, nDivisor, bnRemainder);
+    if (nDropped > 0 && bnNew.bits() + nDropped <= 256) {
+        // bnProduct is at least 2^248 here, so bnNew has 185 bits or more
+        // and the remainder, below 2^63, can take the at most 71 bits left
+        bnNew = (bnNew << nDropped) + DivideTarget(bnRemainder << nDropped, nDivisor, bnRemainder);
+        nDropped = 0;
+    }
+
+    // Rounded toward zero, so the sign is the product's unless nothing is left
+    const bool fNegative = bnNew != 0 && (fNegativeTarget != (nMultiplier < 0));
+    if (!fNegative && (nDropped > 0 || bnNew > bnLimit))
+        return bnLimit.GetCompact();
+    if (fClampNonPositive && (fNegative || bnNew == 0))
+        return bnLimit.GetCompact();
+    if (nDropped == 0)
+        return bnNew.GetCompact(fNegative);
+
+    // A negative target too wide for 256 bits, encoded as OpenSSL's
+    // BN_bn2mpi() did, which includes wrapping around sizes above 255
+    unsigned int nBytes = (bnNew.bits() + 7) / 8;
+    unsigned int nCompact = (bnNew >> 8 * (nBytes - 3)).GetLow64();
+    nSize = nBytes + nDropped / 8;
+    if (nCompact & 0x00800000) {
+        nCompact >>= 8;
+        nSize++;
+    }
+    nCompact |= nSize << 24;
+    nCompact |= 0x00800000;
+    return nCompact;
+}
 
 // Check whether a block hash satisfies the proof-of-work requirement specified by nBits
 bool CheckProofOfWork(uint256 hash, unsigned int nBits, const Consensus::Params& params)
 {
-    CBigNum bnTarget;
-    bnTarget.SetCompact(nBits);
+    bool fNegative;
+    bool fOverflow;
+    arith_uint256 bnTarget;
+
+    bnTarget.SetCompact(nBits, &fNegative, &fOverflow);
 
     // Check range
-    if (bnTarget <= 0 || bnTarget > CBigNum(ArithToUint256(params.powLimit)))
+    if (fNegative || bnTarget == 0 || fOverflow || bnTarget > params.powLimit)
         return error("CheckProofOfWork() : nBits below minimum work");
 
     // Check proof of work matches claimed amount
-    if (UintToArith256(hash) > UintToArith256(bnTarget.getuint256()))
+    if (UintToArith256(hash) > bnTarget)
         return error("CheckProofOfWork() : hash doesn't match nBits");
 
     return true;
@@ -11,6 +11,7 @@
 
 #include <stdint.h>
 
+class arith_uint256;
 class CBlockHeader;
 class CBlockIndex;
 class uint256;
@@ -18,6 +19,15 @@ class uint256;
 /** Get next required mining work **/
 unsigned int GetNextWorkRequired(const CBlockIndex* pindexLast, const Consensus::Params& params);
 
+/**
+ * Scale the target nBits encodes by nMultiplier / nDivisor, clamping it to
+ * bnLimit, for proof-of-work and proof-of-stake retargeting. Rounds toward
+ * zero and keeps the sign of negative targets and multipliers, bit for bit
+ * like the OpenSSL bignum code it replaces; fClampNonPositive also clamps
+ * results that are not positive.
+ */
+unsigned int ScaleCompactTarget(unsigned int nBits, int64_t nMultiplier, int64_t nDivisor, const arith_uint256& bnLimit, bool fClampNonPositive);
+
 /** Check whether a block hash satisfies the proof-of-work requirement specified by nBits */
 bool CheckProofOfWork(uint256 hash, unsigned int nBits, const Consensus::Params&);
 
@@ -14,10 +14,15 @@ uint256 CBlockHeader::GetHash() const
     return SerializeHash(*this);
 }
 
+bool CBlockHeader::GetWorkHash(uint256& hashWork) const
+{
+    return scryptHash(BEGIN(nVersion), BEGIN(hashWork));
+}
+
 uint256 CBlockHeader::GetWorkHash() const
 {
     uint256 thash;
-    scryptHash(BEGIN(nVersion), BEGIN(thash));
+    GetWorkHash(thash);
     return thash;
 }
 std::string CBlock::ToString() const
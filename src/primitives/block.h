@@ -72,6 +72,9 @@ public:
     }
 
     uint256 GetHash() const;
+    //! Scrypt proof of work hash; false if it could not be computed, for lack of memory
+    bool GetWorkHash(uint256& hashWork) const;
+    //! As above, all ones when it could not be computed, so it meets no target
     uint256 GetWorkHash() const;
 
     int64_t GetBlockTime() const
@@ -10,6 +10,7 @@
 #include <consensus/params.h>
 #include <consensus/validation.h>
 #include <core_io.h>
+#include <crypto/scrypt.h>
 #include <key_io.h>
 #include <miner.h>
 #include <net.h>
@@ -30,6 +31,8 @@
 #include <util/system.h>
 #include <validation.h>
 #include <validationinterface.h>
+#include <wallet/rpcwallet.h>
+#include <wallet/wallet.h>
 #include <warnings.h>
 
 #include <memory>
@@ -224,6 +227,162 @@ static UniValue generatetoaddress(const JSONRPCRequest& request)
     return generateBlocks(mempool, coinbase_script, nGenerate, nMaxTries);
 }
 
+static UniValue setgenerate(const JSONRPCRequest& request)
+{
+            RPCHelpMan{"setgenerate",
+                "\nStart or stop the built-in Verium miner, paying to new addresses of the wallet.\n",
+                {
+                    {"generate", RPCArg::Type::BOOL, RPCArg::Optional::NO, "Set to true to turn on generation, false to turn off."},
+                    {"genproclimit", RPCArg::Type::NUM, /* default */ "-1", "The number of miner threads, -1 for one per core."},
+                },
+                RPCResult{RPCResult::Type::NONE, "", ""},
+                RPCExamples{
+                    "\nStart mining on 4 threads\n"
+                    + HelpExampleCli("setgenerate", "true 4") +
+                    "\nStop mining\n"
+                    + HelpExampleCli("setgenerate", "false")
+            + HelpExampleRpc("setgenerate", "true, 4")
+                },
+            }.Check(request);
+
+    bool fGenerate = request.params[0].get_bool();
+    int nGenProcLimit = request.params[1].isNull() ? -1 : request.params[1].get_int();
+    if (nGenProcLimit < -1)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid genproclimit, must be -1 or greater");
+
+    std::shared_ptr<CWallet> pwallet;
+    if (fGenerate) {
+        pwallet = GetWalletForJSONRPCRequest(request);
+        if (!EnsureWalletIsAvailable(pwallet.get(), request.fHelp))
+            return NullUniValue;
+        if (pwallet->IsWalletFlagSet(WALLET_FLAG_DISABLE_PRIVATE_KEYS))
+            throw JSONRPCError(RPC_WALLET_ERROR, "Error: Private keys are disabled for this wallet");
+        if (!g_rpc_node->connman)
+            throw JSONRPCError(RPC_CLIENT_P2P_DISABLED, "Error: Peer-to-peer functionality missing or disabled");
+    }
+
+    if (!GenerateVerium(fGenerate, pwallet, nGenProcLimit, g_rpc_node->connman.get()))
+        throw JSONRPCError(RPC_WALLET_KEYPOOL_RAN_OUT, "Error: Keypool ran out, please call keypoolrefill first");
+    return NullUniValue;
+}
+
+static UniValue getgenerate(const JSONRPCRequest& request)
+{
+            RPCHelpMan{"getgenerate",
+                "\nReturns whether the built-in Verium miner is running.\n",
+                {},
+                RPCResult{RPCResult::Type::BOOL, "", "true if the miner is running"},
+                RPCExamples{
+                    HelpExampleCli("getgenerate", "")
+            + HelpExampleRpc("getgenerate", "")
+                },
+            }.Check(request);
+
+    return IsGeneratingVerium();
+}
+
+static UniValue gethashrate(const JSONRPCRequest& request)
+{
+            RPCHelpMan{"gethashrate",
+                "\nReturns the hash rate of the built-in Verium miner, in total and per thread.\n"
+                "Rates are measured over 30 second periods and stay 0 until a thread completed one.\n",
+                {},
+                RPCResult{
+                    RPCResult::Type::OBJ, "", "",
+                    {
+                        {RPCResult::Type::BOOL, "generate", "whether the miner is running"},
+                        {RPCResult::Type::NUM, "hashespermin", "the hash rate of all miner threads, in hashes per minute"},
+                        {RPCResult::Type::ARR, "threads", "",
+                        {
+                            {RPCResult::Type::OBJ, "", "",
+                            {
+                                {RPCResult::Type::NUM, "thread", "the thread number"},
+                                {RPCResult::Type::ARR, "cpus", "the CPUs the thread is pinned to, see -minerthreads and -minernuma; empty if left to the scheduler",
+                                {
+                                    {RPCResult::Type::NUM, "", "a CPU number"},
+                                }},
+                                {RPCResult::Type::NUM, "numanode", /* optional */ true, "the NUMA node of those CPUs (only present if the thread is pinned)"},
+                                {RPCResult::Type::BOOL, "scratchpad", "whether the thread allocated its scrypt scratchpad; threads without one do not mine"},
+                                {RPCResult::Type::NUM, "hashespermin", "the hash rate of the thread, in hashes per minute"},
+                                {RPCResult::Type::NUM, "hashes", "the hashes done since the thread started"},
+                                {RPCResult::Type::NUM, "templateage", /* optional */ true, "seconds since the block template shared by the miner threads was assembled (only present once the thread has a block)"},
+                                {RPCResult::Type::NUM, "blocksfound", "the blocks found by the thread and accepted locally"},
+                            }},
+                        }},
+                    }},
+                RPCExamples{
+                    HelpExampleCli("gethashrate", "")
+            + HelpExampleRpc("gethashrate", "")
+                },
+            }.Check(request);
+
+    const int64_t nNow = GetTime();
+    double dHashrate = 0.0;
+    UniValue threads(UniValue::VARR);
+    for (const auto& stats : GetMinerThreadStats()) {
+        const double dThreadHashrate = stats->dHashesPerMin.load(std::memory_order_relaxed);
+        const int64_t nTemplateTime = stats->nTemplateTime.load(std::memory_order_relaxed);
+        UniValue entry(UniValue::VOBJ);
+        entry.pushKV("thread", stats->nThread);
+        UniValue cpus(UniValue::VARR);
+        if (stats->fPinned.load(std::memory_order_relaxed)) {
+            for (int cpu : stats->vCpus) cpus.push_back(cpu);
+        }
+        entry.pushKV("cpus", cpus);
+        if (!cpus.empty()) entry.pushKV("numanode", stats->nNumaNode);
+        entry.pushKV("scratchpad", stats->fScratchpad.load(std::memory_order_relaxed));
+        entry.pushKV("hashespermin", dThreadHashrate);
+        entry.pushKV("hashes", stats->nHashes.load(std::memory_order_relaxed));
+        if (nTemplateTime) entry.pushKV("templateage", nNow - nTemplateTime);
+        entry.pushKV("blocksfound", stats->nBlocksFound.load(std::memory_order_relaxed));
+        threads.push_back(entry);
+        dHashrate += dThreadHashrate;
+    }
+
+    UniValue obj(UniValue::VOBJ);
+    obj.pushKV("generate", IsGeneratingVerium());
+    obj.pushKV("hashespermin", dHashrate);
+    obj.pushKV("threads", threads);
+    return obj;
+}
+
+static UniValue getstakinginfo(const JSONRPCRequest& request)
+{
+            RPCHelpMan{"getstakinginfo",
+                "\nReturns the progress of the built-in Vericoin staker, see -stakegen and -stakethreads.\n"
+                "Kernel rates are measured over 30 second periods and stay 0 until a thread completed one.\n",
+                {},
+                RPCResult{
+                    RPCResult::Type::OBJ, "", "",
+                    {
+                        {RPCResult::Type::BOOL, "enabled", "whether the staker is running"},
+                        {RPCResult::Type::NUM, "threads", "the number of staker threads"},
+                        {RPCResult::Type::NUM, "candidates", "the wallet outputs being staked; none while the wallet is locked"},
+                        {RPCResult::Type::STR_AMOUNT, "weight", "the value of those outputs"},
+                        {RPCResult::Type::NUM, "kernelspersec", "the stake kernels tried per second, by all staker threads"},
+                        {RPCResult::Type::NUM, "kernels", "the stake kernels tried since the staker started"},
+                        {RPCResult::Type::NUM, "expectedtime", "the expected seconds until a stake is found at the current target, 0 if not staking"},
+                        {RPCResult::Type::NUM, "stakesfound", "the blocks staked and accepted locally"},
+                    }},
+                RPCExamples{
+                    HelpExampleCli("getstakinginfo", "")
+            + HelpExampleRpc("getstakinginfo", "")
+                },
+            }.Check(request);
+
+    const StakingInfo info = GetStakingInfo();
+    UniValue obj(UniValue::VOBJ);
+    obj.pushKV("enabled", info.fEnabled);
+    obj.pushKV("threads", info.nThreads);
+    obj.pushKV("candidates", (uint64_t)info.nCandidates);
+    obj.pushKV("weight", ValueFromAmount(info.nWeight));
+    obj.pushKV("kernelspersec", info.dKernelsPerSec);
+    obj.pushKV("kernels", info.nKernels);
+    obj.pushKV("expectedtime", info.dExpectedTime);
+    obj.pushKV("stakesfound", info.nStakesFound);
+    return obj;
+}
+
 static UniValue getmininginfo(const JSONRPCRequest& request)
 {
             RPCHelpMan{"getmininginfo",
@@ -239,6 +398,7 @@ static UniValue getmininginfo(const JSONRPCRequest& request)
                         {RPCResult::Type::NUM, "networkhashps", "The network hashes per second"},
                         {RPCResult::Type::NUM, "pooledtx", "The size of the mempool"},
                         {RPCResult::Type::STR, "chain", "current network name (main, test, regtest)"},
+                        {RPCResult::Type::STR, "scryptimplementation", "the scrypt implementation selected for this CPU"},
                         {RPCResult::Type::STR, "warnings", "any network and blockchain warnings"},
                     }},
                 RPCExamples{
@@ -258,6 +418,7 @@ static UniValue getmininginfo(const JSONRPCRequest& request)
     obj.pushKV("networkhashps",    getnetworkhashps(request));
     obj.pushKV("pooledtx",         (uint64_t)mempool.size());
     obj.pushKV("chain",            Params().NetworkIDString());
+    obj.pushKV("scryptimplementation", GetScryptImplementation());
     obj.pushKV("warnings",         GetWarnings(false));
     return obj;
 }
@@ -535,10 +696,16 @@ static UniValue getblocktemplate(const JSONRPCRequest& request)
         throw JSONRPCError(RPC_INVALID_PARAMETER, "getblocktemplate must be called with the segwit rule set (call with {\"rules\": [\"segwit\"]})");
     }
 
+    // NOTE: If at some point we support pre-segwit miners post-segwit-activation, this needs to take segwit support into consideration
+    const bool fPreSegWit = false;// (pindexPrev->nHeight + 1 < consensusParams.SegwitHeight);
+
     // Update block
     static CBlockIndex* pindexPrev;
     static int64_t nStart;
     static std::unique_ptr<CBlockTemplate> pblocktemplate;
+    // The template's transactions, encoded once for every caller (notably all
+    // longpolls woken by the same tip change) until the template is replaced
+    static UniValue transactions(UniValue::VARR);
     if (pindexPrev != ::ChainActive().Tip() ||
         (mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast && GetTime() - nStart > 5))
     {
@@ -556,6 +723,45 @@ static UniValue getblocktemplate(const JSONRPCRequest& request)
         if (!pblocktemplate)
             throw JSONRPCError(RPC_OUT_OF_MEMORY, "Out of memory");
 
+        // Encode the transactions once, they only change with the template
+        transactions = UniValue(UniValue::VARR);
+        std::map<uint256, int64_t> setTxIndex;
+        int i = 0;
+        for (const auto& it : pblocktemplate->block.vtx) {
+            const CTransaction& tx = *it;
+            uint256 txHash = tx.GetHash();
+            setTxIndex[txHash] = i++;
+
+            if (tx.IsCoinBase())
+                continue;
+
+            UniValue entry(UniValue::VOBJ);
+
+            entry.pushKV("data", EncodeHexTx(tx));
+            entry.pushKV("txid", txHash.GetHex());
+            entry.pushKV("hash", tx.GetWitnessHash().GetHex());
+
+            UniValue deps(UniValue::VARR);
+            for (const CTxIn &in : tx.vin)
+            {
+                if (setTxIndex.count(in.prevout.hash))
+                    deps.push_back(setTxIndex[in.prevout.hash]);
+            }
+            entry.pushKV("depends", deps);
+
+            int index_in_template = i - 1;
+            entry.pushKV("fee", pblocktemplate->vTxFees[index_in_template]);
+            int64_t nTxSigOps = pblocktemplate->vTxSigOpsCost[index_in_template];
+            if (fPreSegWit) {
+                CHECK_NONFATAL(nTxSigOps % WITNESS_SCALE_FACTOR == 0);
+                nTxSigOps /= WITNESS_SCALE_FACTOR;
+            }
+            entry.pushKV("sigops", nTxSigOps);
+            entry.pushKV("weight", GetTransactionWeight(tx));
+
+            transactions.push_back(entry);
+        }
+
         // Need to update only after we know CreateNewBlock succeeded
         pindexPrev = pindexPrevNew;
     }
@@ -567,49 +773,8 @@ static UniValue getblocktemplate(const JSONRPCRequest& request)
     UpdateTime(pblock, consensusParams, pindexPrev);
     pblock->nNonce = 0;
 
-    // NOTE: If at some point we support pre-segwit miners post-segwit-activation, this needs to take segwit support into consideration
-    const bool fPreSegWit = false;// (pindexPrev->nHeight + 1 < consensusParams.SegwitHeight);
-
     UniValue aCaps(UniValue::VARR); aCaps.push_back("proposal");
 
-    UniValue transactions(UniValue::VARR);
-    std::map<uint256, int64_t> setTxIndex;
-    int i = 0;
-    for (const auto& it : pblock->vtx) {
-        const CTransaction& tx = *it;
-        uint256 txHash = tx.GetHash();
-        setTxIndex[txHash] = i++;
-
-        if (tx.IsCoinBase())
-            continue;
-
-        UniValue entry(UniValue::VOBJ);
-
-        entry.pushKV("data", EncodeHexTx(tx));
-        entry.pushKV("txid", txHash.GetHex());
-        entry.pushKV("hash", tx.GetWitnessHash().GetHex());
-
-        UniValue deps(UniValue::VARR);
-        for (const CTxIn &in : tx.vin)
-        {
-            if (setTxIndex.count(in.prevout.hash))
-                deps.push_back(setTxIndex[in.prevout.hash]);
-        }
-        entry.pushKV("depends", deps);
-
-        int index_in_template = i - 1;
-        entry.pushKV("fee", pblocktemplate->vTxFees[index_in_template]);
-        int64_t nTxSigOps = pblocktemplate->vTxSigOpsCost[index_in_template];
-        if (fPreSegWit) {
-            CHECK_NONFATAL(nTxSigOps % WITNESS_SCALE_FACTOR == 0);
-            nTxSigOps /= WITNESS_SCALE_FACTOR;
-        }
-        entry.pushKV("sigops", nTxSigOps);
-        entry.pushKV("weight", GetTransactionWeight(tx));
-
-        transactions.push_back(entry);
-    }
-
     UniValue aux(UniValue::VOBJ);
 
     arith_uint256 hashTarget = arith_uint256().SetCompact(pblock->nBits);
@@ -853,6 +1018,10 @@ static const CRPCCommand commands[] =
 
     { "generating",         "generatetoaddress",      &generatetoaddress,      {"nblocks","address","maxtries"} },
     { "generating",         "generatetodescriptor",   &generatetodescriptor,   {"num_blocks","descriptor","maxtries"} },
+    { "generating",         "setgenerate",            &setgenerate,            {"generate","genproclimit"} },
+    { "generating",         "getgenerate",            &getgenerate,            {} },
+    { "generating",         "gethashrate",            &gethashrate,            {} },
+    { "generating",         "getstakinginfo",         &getstakinginfo,         {} },
 
     { "util",               "estimatesmartfee",       &estimatesmartfee,       {"conf_target", "estimate_mode"} },
 
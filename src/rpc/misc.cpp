@@ -3,6 +3,7 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <blockcache.h>
 #include <httpserver.h>
 #include <key_io.h>
 #include <node/context.h>
@@ -411,6 +412,18 @@ static UniValue RPCLockedMemoryInfo()
     return obj;
 }
 
+static UniValue RPCBlockCacheInfo()
+{
+    const CBlockCache::Stats stats = g_block_cache.GetStats();
+    UniValue obj(UniValue::VOBJ);
+    obj.pushKV("blocks", uint64_t(stats.entries));
+    obj.pushKV("usage", uint64_t(stats.usage));
+    obj.pushKV("max_usage", uint64_t(stats.max_usage));
+    obj.pushKV("hits", stats.hits);
+    obj.pushKV("misses", stats.misses);
+    return obj;
+}
+
 #ifdef HAVE_MALLOC_INFO
 static std::string RPCMallocInfo()
 {
@@ -455,6 +468,14 @@ static UniValue getmemoryinfo(const JSONRPCRequest& request)
                                 {RPCResult::Type::NUM, "chunks_used", "Number allocated chunks"},
                                 {RPCResult::Type::NUM, "chunks_free", "Number unused chunks"},
                             }},
+                            {RPCResult::Type::OBJ, "blockcache", "Information about the cache of recently used blocks",
+                            {
+                                {RPCResult::Type::NUM, "blocks", "Number of blocks in the cache"},
+                                {RPCResult::Type::NUM, "usage", "Number of bytes used"},
+                                {RPCResult::Type::NUM, "max_usage", "Number of bytes the cache may use (see -blockcachesize)"},
+                                {RPCResult::Type::NUM, "hits", "Number of block reads served from the cache"},
+                                {RPCResult::Type::NUM, "misses", "Number of block reads that went to disk"},
+                            }},
                         }
                     },
                     RPCResult{"mode \"mallocinfo\"",
@@ -471,6 +492,7 @@ static UniValue getmemoryinfo(const JSONRPCRequest& request)
     if (mode == "stats") {
         UniValue obj(UniValue::VOBJ);
         obj.pushKV("locked", RPCLockedMemoryInfo());
+        obj.pushKV("blockcache", RPCBlockCacheInfo());
         return obj;
     } else if (mode == "mallocinfo") {
 #ifdef HAVE_MALLOC_INFO
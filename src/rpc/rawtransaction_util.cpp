@@ -184,7 +184,7 @@ void ParsePrevouts(const UniValue& prevTxsUnival, FillableSigningProvider* keyst
                 if (prevOut.exists("amount")) {
                     newcoin.out.nValue = AmountFromValue(find_value(prevOut, "amount"));
                 }
-                newcoin.nHeight = 1;
+                newcoin.SetHeight(1);
                 coins[out] = std::move(newcoin);
             }
 
@@ -91,3 +91,16 @@ bool CachingTransactionSignatureChecker::VerifySignature(const std::vector<unsig
         signatureCache.Set(entry);
     return true;
 }
+
+bool CachingVerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& hash, bool store)
+{
+    uint256 entry;
+    signatureCache.ComputeEntry(entry, hash, vchSig, pubkey);
+    if (signatureCache.Get(entry, !store))
+        return true;
+    if (!pubkey.Verify(hash, vchSig))
+        return false;
+    if (store)
+        signatureCache.Set(entry);
+    return true;
+}
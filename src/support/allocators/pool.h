@@ -0,0 +1,176 @@
+// Copyright (c) 2020 The Vericonomy developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SUPPORT_ALLOCATORS_POOL_H
+#define BITCOIN_SUPPORT_ALLOCATORS_POOL_H
+
+#include <assert.h>
+#include <stddef.h>
+
+#include <memory>
+#include <new>
+#include <vector>
+
+/**
+ * Memory for node-based containers, which allocate their elements one at a
+ * time and all of the same few sizes.
+ *
+ * Blocks of up to the maximum block size are cut from large chunks, with no
+ * per-block header, and freed blocks go on a free list per size for the next
+ * allocation of that size. Larger blocks, such as the bucket array of an
+ * unordered_map, and blocks aligned beyond a pointer come from operator new.
+ * The chunks are only given back when the resource is destroyed, so a
+ * container that shrinks keeps the memory it had at its largest.
+ */
+class PoolResource
+{
+public:
+    //! Blocks are aligned to, and their sizes rounded up to, this many bytes
+    static constexpr size_t ELEM_ALIGN_BYTES = alignof(void*);
+    static constexpr size_t DEFAULT_CHUNK_SIZE_BYTES = 256 * 1024;
+
+private:
+    struct ListNode
+    {
+        ListNode* m_next;
+    };
+
+    const size_t m_max_block_size;
+    const size_t m_chunk_size;
+    //! Freed blocks, by size in units of ELEM_ALIGN_BYTES
+    std::vector<ListNode*> m_free_lists;
+    std::vector<std::unique_ptr<char[]>> m_chunks;
+    //! The part of the last chunk that was not handed out yet
+    char* m_available_begin{nullptr};
+    char* m_available_end{nullptr};
+
+    static size_t NumElemAlignBytes(size_t bytes)
+    {
+        return (bytes + ELEM_ALIGN_BYTES - 1) / ELEM_ALIGN_BYTES;
+    }
+
+    bool IsFreeListUsable(size_t bytes, size_t alignment) const
+    {
+        return bytes > 0 && bytes <= m_max_block_size && alignment <= ELEM_ALIGN_BYTES;
+    }
+
+    void PlaceOnFreeList(void* p, size_t num_alignments)
+    {
+        ListNode* node = new (p) ListNode{m_free_lists[num_alignments]};
+        m_free_lists[num_alignments] = node;
+    }
+
+    void AllocateChunk()
+    {
+        // What is left of the last chunk is too small for this block, but
+        // maybe not for a smaller one
+        const size_t remaining = m_available_end - m_available_begin;
+        if (remaining > 0)
+            PlaceOnFreeList(m_available_begin, remaining / ELEM_ALIGN_BYTES);
+
+        m_chunks.emplace_back(new char[m_chunk_size]);
+        m_available_begin = m_chunks.back().get();
+        m_available_end = m_available_begin + m_chunk_size;
+    }
+
+public:
+    explicit PoolResource(size_t max_block_size, size_t chunk_size = DEFAULT_CHUNK_SIZE_BYTES) :
+        m_max_block_size(NumElemAlignBytes(max_block_size) * ELEM_ALIGN_BYTES),
+        m_chunk_size(chunk_size / ELEM_ALIGN_BYTES * ELEM_ALIGN_BYTES),
+        m_free_lists(NumElemAlignBytes(max_block_size) + 1, nullptr)
+    {
+        assert(m_chunk_size >= m_max_block_size);
+    }
+
+    PoolResource(const PoolResource&) = delete;
+    PoolResource& operator=(const PoolResource&) = delete;
+
+    void* Allocate(size_t bytes, size_t alignment)
+    {
+        if (!IsFreeListUsable(bytes, alignment))
+            return ::operator new(bytes);
+
+        const size_t num_alignments = NumElemAlignBytes(bytes);
+        ListNode*& free_list = m_free_lists[num_alignments];
+        if (free_list) {
+            ListNode* node = free_list;
+            free_list = node->m_next;
+            node->~ListNode();
+            return node;
+        }
+
+        const size_t round_bytes = num_alignments * ELEM_ALIGN_BYTES;
+        if (round_bytes > size_t(m_available_end - m_available_begin))
+            AllocateChunk();
+        void* p = m_available_begin;
+        m_available_begin += round_bytes;
+        return p;
+    }
+
+    void Deallocate(void* p, size_t bytes, size_t alignment) noexcept
+    {
+        if (!IsFreeListUsable(bytes, alignment)) {
+            ::operator delete(p);
+            return;
+        }
+        PlaceOnFreeList(p, NumElemAlignBytes(bytes));
+    }
+
+    size_t NumAllocatedChunks() const { return m_chunks.size(); }
+    size_t ChunkSizeBytes() const { return m_chunk_size; }
+    size_t MaxBlockSizeBytes() const { return m_max_block_size; }
+};
+
+/**
+ * Allocator of a container whose memory comes from a PoolResource. Several
+ * containers may share a resource, but not across threads. Without a
+ * resource it uses operator new, like std::allocator.
+ */
+template <typename T>
+class PoolAllocator
+{
+private:
+    PoolResource* m_resource;
+
+    template <typename U>
+    friend class PoolAllocator;
+
+public:
+    typedef T value_type;
+
+    template <typename U>
+    struct rebind {
+        typedef PoolAllocator<U> other;
+    };
+
+    PoolAllocator() noexcept : m_resource(nullptr) {}
+    explicit PoolAllocator(PoolResource* resource) noexcept : m_resource(resource) {}
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U>& other) noexcept : m_resource(other.m_resource) {}
+
+    T* allocate(size_t n)
+    {
+        if (!m_resource)
+            return static_cast<T*>(::operator new(n * sizeof(T)));
+        return static_cast<T*>(m_resource->Allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T* p, size_t n) noexcept
+    {
+        if (!m_resource) {
+            ::operator delete(p);
+            return;
+        }
+        m_resource->Deallocate(p, n * sizeof(T), alignof(T));
+    }
+
+    PoolResource* resource() const noexcept { return m_resource; }
+
+    template <typename U>
+    bool operator==(const PoolAllocator<U>& other) const noexcept { return m_resource == other.m_resource; }
+    template <typename U>
+    bool operator!=(const PoolAllocator<U>& other) const noexcept { return m_resource != other.m_resource; }
+};
+
+#endif // BITCOIN_SUPPORT_ALLOCATORS_POOL_H
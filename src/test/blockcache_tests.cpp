@@ -0,0 +1,105 @@
+// Copyright (c) 2020 The Vericonomy developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockcache.h>
+#include <primitives/transaction.h>
+#include <test/util/setup_common.h>
+
+#include <memory>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockcache_tests, BasicTestingSetup)
+
+static std::shared_ptr<const CBlock> MakeBlock(size_t nTx)
+{
+    std::shared_ptr<CBlock> block = std::make_shared<CBlock>();
+    block->nNonce = InsecureRand32();
+    for (size_t i = 0; i < nTx; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(InsecureRand256(), 0);
+        tx.vout.emplace_back(1, CScript() << OP_TRUE);
+        block->vtx.push_back(MakeTransactionRef(std::move(tx)));
+    }
+    return block;
+}
+
+BOOST_AUTO_TEST_CASE(blockcache_lru)
+{
+    std::vector<std::shared_ptr<const CBlock>> blocks;
+    for (int i = 0; i < 4; i++)
+        blocks.push_back(MakeBlock(10));
+
+    // Find how much one block takes, then make room for three
+    CBlockCache probe(1 << 20);
+    probe.Insert(blocks[0]->GetHash(), blocks[0]);
+    const size_t usage = probe.GetStats().usage;
+    BOOST_CHECK(usage > 0);
+
+    CBlockCache cache(3 * usage);
+    BOOST_CHECK(!cache.Get(blocks[0]->GetHash()));
+    for (int i = 0; i < 3; i++)
+        cache.Insert(blocks[i]->GetHash(), blocks[i]);
+    BOOST_CHECK_EQUAL(cache.GetStats().entries, 3U);
+    BOOST_CHECK_EQUAL(cache.GetStats().usage, 3 * usage);
+
+    // Readers share the cached block
+    BOOST_CHECK(cache.Get(blocks[0]->GetHash()) == blocks[0]);
+
+    // The least recently used block goes first, which is now the second one
+    cache.Insert(blocks[3]->GetHash(), blocks[3]);
+    BOOST_CHECK_EQUAL(cache.GetStats().entries, 3U);
+    BOOST_CHECK(!cache.Get(blocks[1]->GetHash()));
+    BOOST_CHECK(cache.Get(blocks[0]->GetHash()) == blocks[0]);
+    BOOST_CHECK(cache.Get(blocks[2]->GetHash()) == blocks[2]);
+    BOOST_CHECK(cache.Get(blocks[3]->GetHash()) == blocks[3]);
+
+    // Inserting a block again only makes it the most recent
+    cache.Insert(blocks[0]->GetHash(), blocks[0]);
+    cache.Insert(blocks[1]->GetHash(), blocks[1]);
+    BOOST_CHECK(!cache.Get(blocks[2]->GetHash()));
+    BOOST_CHECK(cache.Get(blocks[0]->GetHash()) == blocks[0]);
+
+    CBlockCache::Stats stats = cache.GetStats();
+    BOOST_CHECK_EQUAL(stats.hits, 5U);
+    BOOST_CHECK_EQUAL(stats.misses, 3U);
+    BOOST_CHECK_EQUAL(stats.usage, 3 * usage);
+    BOOST_CHECK_EQUAL(stats.max_usage, 3 * usage);
+
+    // Shrinking drops the oldest blocks, and a limit of 0 disables the cache
+    cache.SetMaxUsage(usage);
+    BOOST_CHECK_EQUAL(cache.GetStats().entries, 1U);
+    BOOST_CHECK(cache.Get(blocks[0]->GetHash()) == blocks[0]);
+    cache.SetMaxUsage(0);
+    BOOST_CHECK_EQUAL(cache.GetStats().entries, 0U);
+    BOOST_CHECK_EQUAL(cache.GetStats().usage, 0U);
+    cache.Insert(blocks[0]->GetHash(), blocks[0]);
+    BOOST_CHECK(!cache.Get(blocks[0]->GetHash()));
+}
+
+BOOST_AUTO_TEST_CASE(blockcache_usage)
+{
+    // Larger blocks are accounted as larger, and a block larger than the
+    // whole cache is not kept
+    std::shared_ptr<const CBlock> small = MakeBlock(1);
+    std::shared_ptr<const CBlock> large = MakeBlock(100);
+    CBlockCache cache(1 << 20);
+    cache.Insert(small->GetHash(), small);
+    const size_t small_usage = cache.GetStats().usage;
+    cache.Clear();
+    cache.Insert(large->GetHash(), large);
+    const size_t large_usage = cache.GetStats().usage;
+    BOOST_CHECK(large_usage > 20 * small_usage);
+
+    cache.SetMaxUsage(large_usage - 1);
+    cache.Insert(small->GetHash(), small);
+    cache.Insert(large->GetHash(), large);
+    BOOST_CHECK(cache.Get(small->GetHash()) == small);
+    BOOST_CHECK(!cache.Get(large->GetHash()));
+    BOOST_CHECK_EQUAL(cache.GetStats().usage, small_usage);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
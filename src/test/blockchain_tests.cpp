@@ -7,10 +7,14 @@
 #include <stdlib.h>
 
 #include <chain.h>
+#include <chainparams.h>
 #include <rpc/blockchain.h>
+#include <txdb.h>
 #include <util/string.h>
 #include <test/util/setup_common.h>
 
+#include <map>
+
 /* Equality between doubles is imprecise. Comparison should be done
  * with a small threshold of tolerance, rather than exact equality.
  */
@@ -74,4 +78,38 @@ BOOST_AUTO_TEST_CASE(get_difficulty_for_very_high_target)
     TestDifficulty(0x12345678, 5913134931067755359633408.0);
 }
 
+BOOST_AUTO_TEST_CASE(block_tree_work_hash)
+{
+    CBlockTreeDB db(1 << 20, true);
+
+    CBlockIndex verified;
+    verified.nBits = Params().GetConsensus().powLimit.GetCompact();
+    verified.nStatus = BLOCK_VALID_TREE | BLOCK_POW_VERIFIED;
+    verified.hashWork = uint256S("1234");
+    const uint256 hash_verified = verified.GetBlockHeader().GetHash();
+    verified.phashBlock = &hash_verified;
+    BOOST_CHECK(db.WriteBatchSync({}, 0, {&verified}));
+
+    // An older version rewrites the entry with the bit it doesn't know about,
+    // and may have left the bit set on an entry whose hash was never recorded
+    CBlockIndex unrecorded(verified);
+    unrecorded.nNonce = 1;
+    const uint256 hash_unrecorded = unrecorded.GetBlockHeader().GetHash();
+    unrecorded.phashBlock = &hash_unrecorded;
+    BOOST_CHECK(db.Write(std::make_pair('b', hash_verified), CDiskBlockIndex(&verified)));
+    BOOST_CHECK(db.Write(std::make_pair('b', hash_unrecorded), CDiskBlockIndex(&unrecorded)));
+
+    std::map<uint256, std::unique_ptr<CBlockIndex>> index;
+    BOOST_CHECK(db.LoadBlockIndexGuts(Params().GetConsensus(), [&index](const uint256& hash) {
+        if (hash.IsNull()) return (CBlockIndex*)nullptr;
+        std::unique_ptr<CBlockIndex>& entry = index[hash];
+        if (!entry) entry.reset(new CBlockIndex());
+        return entry.get();
+    }));
+    BOOST_CHECK(index.at(hash_verified)->nStatus & BLOCK_POW_VERIFIED);
+    BOOST_CHECK(index.at(hash_verified)->hashWork == verified.hashWork);
+    BOOST_CHECK(!(index.at(hash_unrecorded)->nStatus & BLOCK_POW_VERIFIED));
+    BOOST_CHECK(index.at(hash_unrecorded)->hashWork.IsNull());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
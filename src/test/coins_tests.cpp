@@ -27,7 +27,7 @@ bool operator==(const Coin &a, const Coin &b) {
     // Empty Coin objects are always equal.
     if (a.IsSpent() && b.IsSpent()) return true;
     return a.fCoinBase == b.fCoinBase &&
-           a.nHeight == b.nHeight &&
+           a.GetHeight() == b.GetHeight() &&
            a.out == b.out;
 }
 
@@ -162,7 +162,7 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
             if (InsecureRandRange(5) == 0 || coin.IsSpent()) {
                 Coin newcoin;
                 newcoin.out.nValue = InsecureRand32();
-                newcoin.nHeight = 1;
+                newcoin.SetHeight(1);
                 if (InsecureRandRange(16) == 0 && coin.IsSpent()) {
                     newcoin.out.scriptPubKey.assign(1 + InsecureRandBits(6), OP_RETURN);
                     BOOST_CHECK(newcoin.out.scriptPubKey.IsUnspendable());
@@ -486,7 +486,7 @@ BOOST_AUTO_TEST_CASE(ccoins_serialization)
     Coin cc1;
     ss1 >> cc1;
     BOOST_CHECK_EQUAL(cc1.fCoinBase, false);
-    BOOST_CHECK_EQUAL(cc1.nHeight, 203998U);
+    BOOST_CHECK_EQUAL(cc1.GetHeight(), 203998);
     BOOST_CHECK_EQUAL(cc1.out.nValue, CAmount{60000000000});
     BOOST_CHECK_EQUAL(HexStr(cc1.out.scriptPubKey), HexStr(GetScriptForDestination(PKHash(uint160(ParseHex("816115944e077fe7c803cfa57f29b36bf87c1d35"))))));
 
@@ -495,7 +495,7 @@ BOOST_AUTO_TEST_CASE(ccoins_serialization)
     Coin cc2;
     ss2 >> cc2;
     BOOST_CHECK_EQUAL(cc2.fCoinBase, true);
-    BOOST_CHECK_EQUAL(cc2.nHeight, 120891U);
+    BOOST_CHECK_EQUAL(cc2.GetHeight(), 120891);
     BOOST_CHECK_EQUAL(cc2.out.nValue, 110397);
     BOOST_CHECK_EQUAL(HexStr(cc2.out.scriptPubKey), HexStr(GetScriptForDestination(PKHash(uint160(ParseHex("8c988f1a4a4de2161e0f50aac7f17e7f9555caa4"))))));
 
@@ -504,7 +504,7 @@ BOOST_AUTO_TEST_CASE(ccoins_serialization)
     Coin cc3;
     ss3 >> cc3;
     BOOST_CHECK_EQUAL(cc3.fCoinBase, false);
-    BOOST_CHECK_EQUAL(cc3.nHeight, 0U);
+    BOOST_CHECK_EQUAL(cc3.GetHeight(), 0);
     BOOST_CHECK_EQUAL(cc3.out.nValue, 0);
     BOOST_CHECK_EQUAL(cc3.out.scriptPubKey.size(), 0U);
 
@@ -553,7 +553,7 @@ static void SetCoinsValue(CAmount value, Coin& coin)
     assert(coin.IsSpent());
     if (value != PRUNED) {
         coin.out.nValue = value;
-        coin.nHeight = 1;
+        coin.SetHeight(1);
         assert(!coin.IsSpent());
     }
 }
@@ -776,6 +776,44 @@ BOOST_AUTO_TEST_CASE(ccoins_add)
     CheckAddCoin(VALUE2, VALUE3, VALUE3, DIRTY|FRESH, DIRTY|FRESH, true );
 }
 
+static void CheckAddFetchedCoin(CAmount cache_value, CAmount fetch_value, CAmount expected_value, char cache_flags, char expected_flags)
+{
+    SingleEntryCacheTest test(ABSENT, cache_value, cache_flags);
+
+    Coin coin;
+    if (fetch_value != PRUNED) {
+        coin.out.nValue = fetch_value;
+        coin.SetHeight(1);
+    }
+    test.cache.AddFetchedCoin(OUTPOINT, std::move(coin));
+    test.cache.SelfTest();
+
+    CAmount result_value;
+    char result_flags;
+    GetCoinsMapEntry(test.cache.map(), result_value, result_flags);
+    BOOST_CHECK_EQUAL(result_value, expected_value);
+    BOOST_CHECK_EQUAL(result_flags, expected_flags);
+}
+
+BOOST_AUTO_TEST_CASE(ccoins_add_fetched)
+{
+    /* Check AddFetchedCoin behavior, adding a coin read from the backing view
+     * by the input prefetcher. It is cached as FetchCoin() would have cached
+     * it, and never replaces an entry the cache already has.
+     *
+     *                  Cache   Fetch   Result  Cache        Result
+     *                  Value   Value   Value   Flags        Flags
+     */
+    CheckAddFetchedCoin(ABSENT, PRUNED, ABSENT, NO_ENTRY   , NO_ENTRY   );
+    CheckAddFetchedCoin(ABSENT, VALUE3, VALUE3, NO_ENTRY   , 0          );
+    CheckAddFetchedCoin(PRUNED, VALUE3, PRUNED, 0          , 0          );
+    CheckAddFetchedCoin(PRUNED, VALUE3, PRUNED, DIRTY      , DIRTY      );
+    CheckAddFetchedCoin(PRUNED, VALUE3, PRUNED, DIRTY|FRESH, DIRTY|FRESH);
+    CheckAddFetchedCoin(VALUE2, VALUE3, VALUE2, 0          , 0          );
+    CheckAddFetchedCoin(VALUE2, VALUE3, VALUE2, DIRTY      , DIRTY      );
+    CheckAddFetchedCoin(VALUE2, VALUE3, VALUE2, DIRTY|FRESH, DIRTY|FRESH);
+}
+
 void CheckWriteCoins(CAmount parent_value, CAmount child_value, CAmount expected_value, char parent_flags, char child_flags, char expected_flags)
 {
     SingleEntryCacheTest test(ABSENT, parent_value, parent_flags);
@@ -2,10 +2,12 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <consensus/consensus.h>
 #include <policy/policy.h>
 #include <txmempool.h>
 #include <util/system.h>
 #include <util/time.h>
+#include <validation.h>
 
 #include <test/util/setup_common.h>
 
@@ -788,4 +790,26 @@ BOOST_AUTO_TEST_CASE(MempoolAncestryTests)
     BOOST_CHECK_EQUAL(descendants, 4ULL);
 }
 
+BOOST_AUTO_TEST_CASE(MempoolTimeLockedChildTest)
+{
+    CTxMemPool pool;
+    LOCK2(cs_main, pool.cs);
+    TestMemPoolEntryHelper entry;
+
+    // An unconfirmed parent, whose coins the mempool view reports at MEMPOOL_HEIGHT
+    CTransactionRef parent = make_tx(/* output_values */ {10 * COIN});
+    pool.addUnchecked(entry.Fee(10000LL).FromTx(parent));
+    CCoinsViewMemPool view(&::ChainstateActive().CoinsTip(), pool);
+    Coin coin;
+    BOOST_CHECK(view.GetCoin(COutPoint(parent->GetHash(), 0), coin));
+    BOOST_CHECK_EQUAL(coin.GetHeight(), (int)MEMPOOL_HEIGHT);
+
+    // A child with a time-based relative lock on it is taken to spend a coin
+    // of the next block, so its lock is not met yet
+    CMutableTransaction child(*make_tx(/* output_values */ {5 * COIN}, /* inputs */ {parent}));
+    child.nVersion = 2;
+    child.vin[0].nSequence = CTxIn::SEQUENCE_LOCKTIME_TYPE_FLAG | 1;
+    BOOST_CHECK(!CheckSequenceLocks(pool, CTransaction(child), LOCKTIME_VERIFY_SEQUENCE));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
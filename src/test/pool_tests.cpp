@@ -0,0 +1,107 @@
+// Copyright (c) 2020 The Vericonomy developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <coins.h>
+#include <memusage.h>
+#include <support/allocators/pool.h>
+#include <test/util/setup_common.h>
+
+#include <set>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(pool_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(pool_reuses_freed_blocks)
+{
+    PoolResource resource(64, 1024);
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 0U);
+
+    // Blocks of one size come out of the chunk one after the other
+    void* a = resource.Allocate(24, alignof(void*));
+    void* b = resource.Allocate(24, alignof(void*));
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 1U);
+    BOOST_CHECK_EQUAL((char*)b - (char*)a, 24);
+
+    // A freed block is handed out again for a block of the same rounded size
+    resource.Deallocate(a, 24, alignof(void*));
+    BOOST_CHECK(resource.Allocate(24 - PoolResource::ELEM_ALIGN_BYTES + 1, alignof(void*)) == a);
+
+    // Blocks too large or too aligned for the pool come from the heap
+    void* large = resource.Allocate(65, alignof(void*));
+    void* aligned = resource.Allocate(16, 2 * PoolResource::ELEM_ALIGN_BYTES);
+    resource.Deallocate(large, 65, alignof(void*));
+    resource.Deallocate(aligned, 16, 2 * PoolResource::ELEM_ALIGN_BYTES);
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 1U);
+
+    // Running out of the chunk takes another one, and what was left of the
+    // first one still serves smaller blocks
+    std::set<void*> blocks{b};
+    for (int i = 0; i < 1024 / 64; i++) {
+        void* p = resource.Allocate(64, alignof(void*));
+        BOOST_CHECK((uintptr_t)p % PoolResource::ELEM_ALIGN_BYTES == 0);
+        BOOST_CHECK(blocks.insert(p).second);
+    }
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 2U);
+    for (void* p : blocks)
+        resource.Deallocate(p, p == b ? 24 : 64, alignof(void*));
+}
+
+BOOST_AUTO_TEST_CASE(pool_coins_map_usage)
+{
+    PoolResource resource(COINS_MAP_POOL_BLOCK_SIZE);
+    CCoinsMap map(0, SaltedOutpointHasher(), std::equal_to<COutPoint>(), CCoinsMapAllocator(&resource));
+    const size_t empty_usage = memusage::DynamicUsage(map);
+
+    // The map is accounted by the chunks of its pool, which only grow
+    std::vector<COutPoint> outpoints;
+    for (int i = 0; i < 10000; i++) {
+        outpoints.emplace_back(InsecureRand256(), i);
+        map.emplace(outpoints.back(), CCoinsCacheEntry());
+    }
+    BOOST_CHECK(resource.NumAllocatedChunks() > 0);
+    const size_t full_usage = memusage::DynamicUsage(map);
+    BOOST_CHECK(full_usage >= memusage::DynamicUsage(resource) + empty_usage);
+    BOOST_CHECK(full_usage >= resource.NumAllocatedChunks() * resource.ChunkSizeBytes());
+
+    // Apart from the chunk still being filled, its nodes take less than they
+    // would from the heap
+    BOOST_CHECK(memusage::DynamicUsage(resource) - resource.ChunkSizeBytes() < memusage::MallocUsage(sizeof(memusage::unordered_node<CCoinsMap::value_type>)) * map.size());
+
+    // Erasing and inserting as many again reuses the freed nodes
+    const size_t chunks = resource.NumAllocatedChunks();
+    for (const COutPoint& outpoint : outpoints)
+        map.erase(outpoint);
+    for (const COutPoint& outpoint : outpoints)
+        map.emplace(COutPoint(outpoint.hash, outpoint.n + 1), CCoinsCacheEntry());
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), chunks);
+
+    // A map without a pool is accounted per node, as before
+    CCoinsMap map_heap;
+    map_heap.emplace(outpoints.front(), CCoinsCacheEntry());
+    BOOST_CHECK_EQUAL(memusage::DynamicUsage(map_heap), memusage::MallocUsage(sizeof(memusage::unordered_node<CCoinsMap::value_type>)) + memusage::MallocUsage(sizeof(void*) * map_heap.bucket_count()));
+}
+
+BOOST_AUTO_TEST_CASE(coin_layout)
+{
+    // The coinstake flag and the timestamp add no padding to a coin
+    BOOST_CHECK_EQUAL(sizeof(Coin), sizeof(CTxOut) + 8);
+
+    Coin coin(CTxOut(COIN, CScript()), (1 << 30) - 2, true, true, 0xffffffff);
+    BOOST_CHECK_EQUAL(coin.GetHeight(), (1 << 30) - 2);
+    BOOST_CHECK(coin.IsCoinBase());
+    BOOST_CHECK(coin.IsCoinStake());
+    BOOST_CHECK_EQUAL(coin.nTime, 0xffffffffU);
+
+    // A coin of the mempool keeps its height marker, which does not fit in
+    // the height bits
+    coin.SetHeight(MEMPOOL_HEIGHT);
+    BOOST_CHECK_EQUAL(coin.GetHeight(), (int)MEMPOOL_HEIGHT);
+    BOOST_CHECK(coin.IsCoinBase());
+    coin.Clear();
+    BOOST_CHECK_EQUAL(coin.GetHeight(), 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,273 @@
+// Copyright (c) 2020 The Vericonomy developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <arith_uint256.h>
+#include <chain.h>
+#include <consensus/merkle.h>
+#include <consensus/validation.h>
+#include <hash.h>
+#include <key.h>
+#include <pos.h>
+#include <primitives/block.h>
+#include <primitives/transaction.h>
+#include <rpc/blockchain.h>
+#include <script/standard.h>
+#include <test/util/setup_common.h>
+#include <validation.h>
+
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(pos_tests, BasicTestingSetup)
+
+/** Stake kernels per second as GetPoSKernelPS() used to walk them on every call */
+static double KernelPSByWalk(const CBlockIndex* pindex)
+{
+    double dStakeKernelsTriedAvg = 0;
+    int nStakesHandled = 0, nStakesTime = 0;
+    const CBlockIndex* pindexPrevStake = nullptr;
+    for (; pindex && nStakesHandled < 72; pindex = pindex->pprev) {
+        if (pindex->IsProofOfStake()) {
+            dStakeKernelsTriedAvg += GetDifficulty(pindex) * 4294967296.0;
+            nStakesTime += pindexPrevStake ? (pindexPrevStake->nTime - pindex->nTime) : 0;
+            pindexPrevStake = pindex;
+            nStakesHandled++;
+        }
+    }
+    return nStakesTime ? dStakeKernelsTriedAvg / nStakesTime : 0;
+}
+
+/** The average of the above over 60 blocks, as GetAverageStakeWeight() computed it */
+static double AverageStakeWeightByWalk(const CBlockIndex* pindex)
+{
+    double weightSum = 0;
+    int i;
+    for (i = 0; pindex && i < 60; i++, pindex = pindex->pprev)
+        weightSum += KernelPSByWalk(pindex);
+    return (weightSum / i) + 21;
+}
+
+/** Extend a chain from pindexFork with blocks of random type, difficulty and spacing */
+static void BuildBranch(std::vector<CBlockIndex>& branch, CBlockIndex* pindexFork)
+{
+    for (size_t i = 0; i < branch.size(); i++) {
+        CBlockIndex& index = branch[i];
+        index.pprev = i ? &branch[i - 1] : pindexFork;
+        index.nHeight = index.pprev ? index.pprev->nHeight + 1 : 0;
+        index.nTime = index.pprev ? index.pprev->nTime + 1 + InsecureRandRange(240) : 1400000000;
+        index.nBits = 0x1c000000 | (0x010000 + InsecureRandRange(0xf00000));
+        if (InsecureRandRange(3) != 0)
+            index.SetProofOfStake();
+        index.BuildSkip();
+        index.BuildLastBlockIndex();
+        UpdateStakeWeightStats(&index);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(stake_weight_stats_match_walk)
+{
+    std::vector<CBlockIndex> chain(400);
+    BuildBranch(chain, nullptr);
+
+    // A competing branch from height 300 gets its own figures, and leaves the
+    // ones of the blocks it replaces alone
+    std::vector<CBlockIndex> fork(150);
+    BuildBranch(fork, &chain[299]);
+
+    for (const std::vector<CBlockIndex>* branch : {&chain, &fork}) {
+        for (const CBlockIndex& index : *branch) {
+            CBlockIndex* pindex = const_cast<CBlockIndex*>(&index);
+            BOOST_CHECK_EQUAL(GetPoSKernelPS(pindex), KernelPSByWalk(pindex));
+            BOOST_CHECK_EQUAL(GetAverageStakeWeight(pindex), AverageStakeWeightByWalk(pindex));
+        }
+    }
+    BOOST_CHECK(GetAverageStakeWeight(&chain.back()) > 21);
+}
+
+BOOST_AUTO_TEST_CASE(stake_weight_stats_without_stakes)
+{
+    // A chain with fewer stakes than the window, or none at all
+    std::vector<CBlockIndex> chain(100);
+    for (size_t i = 0; i < chain.size(); i++) {
+        chain[i].pprev = i ? &chain[i - 1] : nullptr;
+        chain[i].nHeight = i;
+        chain[i].nTime = 1400000000 + i * 60;
+        chain[i].nBits = 0x1d00ffff;
+        if (i == 50 || i == 80)
+            chain[i].SetProofOfStake();
+        UpdateStakeWeightStats(&chain[i]);
+    }
+    BOOST_CHECK_EQUAL(GetPoSKernelPS(&chain[49]), 0);
+    BOOST_CHECK_EQUAL(GetAverageStakeWeight(&chain[49]), 21);
+    BOOST_CHECK_EQUAL(GetPoSKernelPS(&chain[79]), 0);
+    BOOST_CHECK_EQUAL(GetPoSKernelPS(&chain[99]), KernelPSByWalk(&chain[99]));
+    BOOST_CHECK(GetPoSKernelPS(&chain[99]) > 0);
+    BOOST_CHECK_EQUAL(GetAverageStakeWeight(&chain[99]), AverageStakeWeightByWalk(&chain[99]));
+}
+
+/** The nearest block of a type as GetLastBlockIndex() used to walk to it */
+static const CBlockIndex* LastBlockIndexByWalk(const CBlockIndex* pindex, bool fProofOfStake)
+{
+    while (pindex && pindex->pprev && (pindex->IsProofOfStake() != fProofOfStake))
+        pindex = pindex->pprev;
+    return pindex;
+}
+
+BOOST_AUTO_TEST_CASE(last_block_index_matches_walk)
+{
+    std::vector<CBlockIndex> chain(400);
+    BuildBranch(chain, nullptr);
+    std::vector<CBlockIndex> fork(150);
+    BuildBranch(fork, &chain[299]);
+
+    // Long runs of one type, and a proof-of-work genesis block followed by stakes only
+    for (size_t i = 0; i < chain.size(); i++) {
+        chain[i].nFlags = (i == 0 || (i >= 100 && i < 200)) ? 0 : CBlockIndex::BLOCK_PROOF_OF_STAKE;
+        chain[i].BuildLastBlockIndex();
+    }
+    for (CBlockIndex& index : fork)
+        index.BuildLastBlockIndex();
+
+    for (const std::vector<CBlockIndex>* branch : {&chain, &fork}) {
+        for (const CBlockIndex& index : *branch) {
+            for (bool fProofOfStake : {false, true}) {
+                BOOST_CHECK(GetLastBlockIndex(&index, fProofOfStake) == LastBlockIndexByWalk(&index, fProofOfStake));
+            }
+        }
+    }
+    BOOST_CHECK(GetLastBlockIndex(&chain[50], false) == &chain[0]);
+    BOOST_CHECK(GetLastBlockIndex(&chain[250], false) == &chain[199]);
+    BOOST_CHECK(GetLastBlockIndex(&chain[150], true) == &chain[99]);
+    BOOST_CHECK(GetLastBlockIndex(nullptr, true) == nullptr);
+
+    // An entry outside the block index, without pointers of its own
+    CBlockIndex index;
+    index.pprev = &chain[150];
+    index.nHeight = 151;
+    index.SetProofOfStake();
+    BOOST_CHECK(GetLastBlockIndex(&index, false) == &chain[150]);
+    BOOST_CHECK(GetLastBlockIndex(&index, true) == &index);
+}
+
+BOOST_AUTO_TEST_CASE(stake_kernel_hash_matches_serialization)
+{
+    for (int i = 0; i < 100; i++) {
+        const uint64_t nStakeModifier = InsecureRandBits(64);
+        const unsigned int nTimeBlockFrom = InsecureRand32();
+        const COutPoint prevout(InsecureRand256(), InsecureRand32());
+        const unsigned int nTimeTxPrev = InsecureRand32();
+        CStakeKernelData kernel(nStakeModifier, nTimeBlockFrom, prevout, nTimeTxPrev);
+
+        // Trying one timestamp after the other leaves nothing of the previous one behind
+        for (int j = 0; j < 3; j++) {
+            const unsigned int nTimeTx = InsecureRand32();
+            CHashWriter ss(SER_GETHASH, 0);
+            ss << nStakeModifier << nTimeBlockFrom << prevout.hash << nTimeTxPrev << prevout.n << nTimeTx;
+            BOOST_CHECK_EQUAL(kernel.GetHash(nTimeTx), ss.GetHash());
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(stake_kernel_target)
+{
+    std::vector<CBlockIndex> chain(10);
+    BuildBranch(chain, nullptr);
+    CBlockIndex* pindexPrev = &chain.back();
+    Consensus::Params params;
+    params.PoSTHeight = std::numeric_limits<int>::max();
+
+    const unsigned int nBits = 0x1d00ffff;
+    const arith_uint256 bnTargetPerCoinDay = arith_uint256().SetCompact(nBits);
+    const unsigned int nTimeTxPrev = 1500000000;
+
+    // The target grows with the coin-days of the output, which start at zero
+    BOOST_CHECK(GetStakeKernelTarget(nBits, 100 * COIN, nTimeTxPrev, nTimeTxPrev, pindexPrev, params) == 0);
+    BOOST_CHECK(GetStakeKernelTarget(nBits, 100 * COIN, nTimeTxPrev, nTimeTxPrev - 1, pindexPrev, params) == 0);
+    BOOST_CHECK(GetStakeKernelTarget(nBits, COIN, nTimeTxPrev, nTimeTxPrev + 60, pindexPrev, params) == 0);
+    BOOST_CHECK(GetStakeKernelTarget(nBits, 100 * COIN, nTimeTxPrev, nTimeTxPrev + 24 * 60 * 60, pindexPrev, params) == bnTargetPerCoinDay * 100);
+    BOOST_CHECK(GetStakeKernelTarget(nBits, 100 * COIN, nTimeTxPrev, nTimeTxPrev + 3 * 24 * 60 * 60, pindexPrev, params) == bnTargetPerCoinDay * 300);
+
+    // And saturates rather than wraps around
+    const unsigned int nBitsHuge = 0x2100ffff;
+    BOOST_CHECK(GetStakeKernelTarget(nBitsHuge, 1000000 * COIN, nTimeTxPrev, nTimeTxPrev + 365 * 24 * 60 * 60, pindexPrev, params) == ~arith_uint256(0));
+    BOOST_CHECK(GetStakeKernelTarget(0x01810000, 100 * COIN, nTimeTxPrev, nTimeTxPrev + 24 * 60 * 60, pindexPrev, params) == 0);
+}
+
+/** A proof-of-stake block whose coinstake pays to key, signed by it */
+static CBlock MakeStakeBlock(const CKey& key)
+{
+    CMutableTransaction coinbase;
+    coinbase.nTime = 1500000000;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].prevout.SetNull();
+    coinbase.vin[0].scriptSig = CScript() << OP_1 << OP_2;
+    coinbase.vout.resize(1);
+    coinbase.vout[0].SetEmpty();
+
+    CMutableTransaction coinstake;
+    coinstake.nTime = coinbase.nTime;
+    coinstake.vin.emplace_back(COutPoint(InsecureRand256(), 0));
+    coinstake.vout.resize(2);
+    coinstake.vout[0].SetEmpty();
+    coinstake.vout[1] = CTxOut(100 * COIN, GetScriptForRawPubKey(key.GetPubKey()));
+
+    CBlock block;
+    block.nTime = 1500000000;
+    block.vtx.push_back(MakeTransactionRef(coinbase));
+    block.vtx.push_back(MakeTransactionRef(coinstake));
+    block.hashMerkleRoot = BlockMerkleRoot(block);
+    BOOST_CHECK(block.IsProofOfStake());
+    BOOST_CHECK(key.Sign(block.GetHash(), block.vchBlockSig));
+    return block;
+}
+
+BOOST_AUTO_TEST_CASE(check_block_signature)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    CBlock block = MakeStakeBlock(key);
+
+    // Once from scratch, and once more from the signature cache
+    BOOST_CHECK(CheckBlockSignature(block));
+    BOOST_CHECK(CheckBlockSignature(block));
+
+    // Signed by another key, or with a signature of another block
+    CKey keyOther;
+    keyOther.MakeNewKey(true);
+    CBlock blockOther = MakeStakeBlock(keyOther);
+    blockOther.vchBlockSig = block.vchBlockSig;
+    BOOST_CHECK(!CheckBlockSignature(blockOther));
+    blockOther.vchBlockSig.clear();
+    BOOST_CHECK(!CheckBlockSignature(blockOther));
+    CBlock blockLater = block;
+    blockLater.nTime++;
+    BOOST_CHECK(!CheckBlockSignature(blockLater));
+}
+
+BOOST_AUTO_TEST_CASE(check_block_rejects_bad_signature_as_mutated)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    const CBlock block = MakeStakeBlock(key);
+    const Consensus::Params params{};
+
+    BlockValidationState state;
+    BOOST_CHECK(CheckBlock(block, state, params, false, true));
+
+    // The signature is not part of the block hash, so a copy of the block
+    // with another signature is only a corrupted copy, not an invalid block
+    CBlock tampered = block;
+    tampered.fChecked = false;
+    tampered.vchBlockSig.back() ^= 1;
+    BlockValidationState tampered_state;
+    BOOST_CHECK(!CheckBlock(tampered, tampered_state, params, false, true));
+    BOOST_CHECK(tampered_state.GetResult() == BlockValidationResult::BLOCK_MUTATED);
+    BOOST_CHECK_EQUAL(tampered_state.GetRejectReason(), "bad-blk-sign");
+    BOOST_CHECK(!tampered.fChecked);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
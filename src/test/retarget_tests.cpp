@@ -0,0 +1,102 @@
+// Copyright (c) 2020 The Vericonomy developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <arith_uint256.h>
+#include <bignum.h>
+#include <pow.h>
+#include <test/util/setup_common.h>
+#include <tinyformat.h>
+
+#include <limits>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(retarget_tests, BasicTestingSetup)
+
+/** Retargeting as GetNextWorkRequired() and GetNextTargetRequired() did it with OpenSSL bignums */
+static unsigned int ScaleCompactTargetBigNum(unsigned int nBits, int64_t nMultiplier, int64_t nDivisor, const arith_uint256& bnLimit, bool fClampNonPositive)
+{
+    CBigNum bnNew;
+    bnNew.SetCompact(nBits);
+    bnNew *= nMultiplier;
+    bnNew /= nDivisor;
+
+    if (fClampNonPositive ? (bnNew <= 0 || bnNew > CBigNum(ArithToUint256(bnLimit))) : bnNew > CBigNum(ArithToUint256(bnLimit)))
+        bnNew = CBigNum(ArithToUint256(bnLimit));
+
+    return bnNew.GetCompact();
+}
+
+static void CheckScale(unsigned int nBits, int64_t nMultiplier, int64_t nDivisor)
+{
+    for (const arith_uint256& bnLimit : {~arith_uint256(0) >> 11, ~arith_uint256(0) >> 20}) {
+        for (bool fClampNonPositive : {false, true}) {
+            const unsigned int nExpected = ScaleCompactTargetBigNum(nBits, nMultiplier, nDivisor, bnLimit, fClampNonPositive);
+            const unsigned int nResult = ScaleCompactTarget(nBits, nMultiplier, nDivisor, bnLimit, fClampNonPositive);
+            if (nResult != nExpected) {
+                BOOST_ERROR(strprintf("nBits=%08x * %d / %d, limit %s%s: %08x, expected %08x", nBits, nMultiplier, nDivisor,
+                    bnLimit.GetHex(), fClampNonPositive ? ", clamping non-positive" : "", nResult, nExpected));
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(retarget_matches_bignum_on_chain_transitions)
+{
+    // The targets both chains have seen, from their limits down to well past
+    // their hardest blocks
+    std::vector<unsigned int> vBits = {0x1f1fffff, 0x1e0fffff, 0x1e00ffff, 0x1d7fffff, 0x1d00ffff, 0x1c7fffff, 0x1c05a3f4, 0x1b0404cb, 0x1a05db8b};
+    for (int i = 0; i < 200; i++)
+        vBits.push_back((0x18 + InsecureRandRange(8)) << 24 | (0x8000 + InsecureRandRange(0x7f8000)));
+
+    // Verium: two hour, then two day timespans, with block times from 15s up.
+    // Vericoin: proof-of-stake spacing. Spacings between the previous blocks
+    // are anything from timestamps running backwards to a stalled chain.
+    const std::vector<std::pair<int64_t, int64_t>> vSchedules = {{2 * 60 * 60, 15}, {2 * 60 * 60, 180}, {2 * 24 * 60 * 60, 15}, {2 * 24 * 60 * 60, 300}, {16 * 60, 60}, {7 * 24 * 60 * 60, 600}};
+    const std::vector<int64_t> vSpacings = {-7 * 24 * 60 * 60, -24 * 60 * 60, -3600, -61, -1, 0, 1, 15, 59, 60, 61, 180, 599, 3600, 24 * 60 * 60, 30 * 24 * 60 * 60};
+
+    for (unsigned int nBits : vBits) {
+        for (const auto& schedule : vSchedules) {
+            const int64_t nInterval = schedule.first / schedule.second;
+            for (int64_t nActualSpacing : vSpacings) {
+                CheckScale(nBits, (nInterval - 1) * schedule.second + nActualSpacing + nActualSpacing, (nInterval + 1) * schedule.second);
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(retarget_matches_bignum_on_edge_encodings)
+{
+    // Every size, with mantissas at the byte boundaries, the sign bit set or
+    // not, and products far wider than 256 bits either way
+    const std::vector<uint32_t> vMantissas = {0, 0x80, 0xffff, 0x123456, 0x7fffff};
+    const std::vector<int64_t> vMultipliers = {0, -1, 1000, std::numeric_limits<int64_t>::max(), std::numeric_limits<int64_t>::min()};
+    const std::vector<int64_t> vDivisors = {1, 7200, std::numeric_limits<int64_t>::max()};
+
+    for (unsigned int nSize = 0; nSize < 256; nSize++) {
+        for (uint32_t nMantissa : vMantissas) {
+            for (bool fSign : {false, true}) {
+                const unsigned int nBits = (nSize << 24) | nMantissa | (fSign ? 0x00800000 : 0);
+                for (int64_t nMultiplier : vMultipliers) {
+                    for (int64_t nDivisor : vDivisors) {
+                        CheckScale(nBits, nMultiplier, nDivisor);
+                    }
+                }
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(retarget_matches_bignum_random)
+{
+    for (int i = 0; i < 5000; i++) {
+        const unsigned int nBits = InsecureRand32();
+        const int64_t nMultiplier = (int64_t)InsecureRandBits(1 + InsecureRandRange(63));
+        const int64_t nDivisor = 1 + (int64_t)InsecureRandBits(InsecureRandRange(63));
+        CheckScale(nBits, InsecureRandBool() ? -nMultiplier : nMultiplier, nDivisor);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
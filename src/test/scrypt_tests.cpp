@@ -0,0 +1,92 @@
+// Copyright (c) 2020 The Vericonomy developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <crypto/scrypt.h>
+#include <test/util/setup_common.h>
+#include <tinyformat.h>
+#include <uint256.h>
+
+#include <thread>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(scrypt_tests, BasicTestingSetup)
+
+/** Distinct, deterministic 80-byte headers. */
+static std::vector<unsigned char> TestHeaders(int count)
+{
+    std::vector<unsigned char> headers(count * 80);
+    for (size_t i = 0; i < headers.size(); i++)
+        headers[i] = (i * 7 + 3) ^ (i / 80);
+    return headers;
+}
+
+BOOST_AUTO_TEST_CASE(scrypt_known_answers)
+{
+    const std::vector<unsigned char> headers = TestHeaders(2);
+    uint256 hash;
+    scryptHash(&headers[0], (char*)hash.begin());
+    BOOST_CHECK_EQUAL(hash.GetHex(), "ff47a5e2b68a720387f5bb14c73d3d0ab91fc16e965f7ea456a255d1b1257774");
+    scryptHash(&headers[80], (char*)hash.begin());
+    BOOST_CHECK_EQUAL(hash.GetHex(), "5e1c8d5d44b5c49287bf0f4f556f06db6fb3fd011a2f655095817eb1f9aaba37");
+}
+
+BOOST_AUTO_TEST_CASE(scrypt_multiway_kernels)
+{
+    // Every lane of every kernel this CPU supports must match the single-way hash
+    const int count = 24;
+    const std::vector<unsigned char> headers = TestHeaders(count);
+    std::vector<uint256> expected(count);
+    for (int i = 0; i < count; i++)
+        scryptHash(&headers[i * 80], (char*)expected[i].begin());
+
+    for (int throughput : ScryptSupportedThroughputs()) {
+        std::vector<uint256> hashes(count);
+        scryptHashBatch(headers.data(), (char*)hashes.data(), count, throughput);
+        for (int i = 0; i < count; i++)
+            BOOST_CHECK_MESSAGE(hashes[i] == expected[i], strprintf("%d-way kernel, header %d", throughput, i));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(scrypt_scratchpad_pool)
+{
+    // With room for a single scratchpad, threads take turns with it, for
+    // batches and single hashes alike, and still get the right hashes
+    const int count = 2;
+    const int threads = 3;
+    const std::vector<unsigned char> headers = TestHeaders(count * threads);
+    std::vector<uint256> expected(count * threads);
+    for (int i = 0; i < count * threads; i++)
+        scryptHash(&headers[i * 80], (char*)expected[i].begin());
+
+    ScryptSetMemoryBudget((size_t)N * 128);
+    // Only the kernels on a single-way scrypt core fit in that budget
+    const int throughput = ScryptBatchThroughput();
+    BOOST_CHECK(throughput == 1 || throughput == 4);
+    std::vector<uint256> hashes(count * threads);
+    // Boost checks are not thread safe, so the workers only record their results
+    std::vector<char> hashed(threads);
+    std::vector<uint256> singles(threads);
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++) {
+        workers.emplace_back([&, t] {
+            hashed[t] = scryptHashBatch(&headers[t * count * 80], (char*)hashes[t * count].begin(), count) &&
+                        scryptHash(&headers[t * count * 80], (char*)singles[t].begin());
+        });
+    }
+    for (std::thread& worker : workers)
+        worker.join();
+    ScryptSetMemoryBudget((size_t)DEFAULT_SCRYPT_MEMORY << 20);
+    ScryptReleaseScratchpads();
+
+    for (int t = 0; t < threads; t++)
+        BOOST_CHECK(hashed[t]);
+    for (int i = 0; i < count * threads; i++)
+        BOOST_CHECK_MESSAGE(hashes[i] == expected[i], strprintf("header %d", i));
+    for (int t = 0; t < threads; t++)
+        BOOST_CHECK(singles[t] == expected[t * count]);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -436,7 +436,7 @@ BOOST_AUTO_TEST_CASE(test_big_witness_transaction)
     std::vector<Coin> coins;
     for(uint32_t i = 0; i < mtx.vin.size(); i++) {
         Coin coin;
-        coin.nHeight = 1;
+        coin.SetHeight(1);
         coin.fCoinBase = false;
         coin.out.nValue = 1000;
         coin.out.scriptPubKey = scriptPubKey;
@@ -5,10 +5,12 @@
 #include <test/util/setup_common.h>
 
 #include <banman.h>
+#include <blockcache.h>
 #include <chainparams.h>
 #include <consensus/consensus.h>
 #include <consensus/params.h>
 #include <consensus/validation.h>
+#include <crypto/scrypt.h>
 #include <crypto/sha256.h>
 #include <init.h>
 #include <miner.h>
@@ -76,6 +78,7 @@ BasicTestingSetup::BasicTestingSetup(const std::string& chainName)
     InitLogging();
     LogInstance().StartLogging();
     SHA256AutoDetect();
+    ScryptAutoDetect();
     ECC_Start();
     SetupEnvironment();
     SetupNetworking();
@@ -131,6 +134,7 @@ TestingSetup::TestingSetup(const std::string& chainName) : BasicTestingSetup(cha
     constexpr int script_check_threads = 2;
     for (int i = 0; i < script_check_threads; ++i) {
         threadGroup.create_thread([i]() { return ThreadScriptCheck(i); });
+        threadGroup.create_thread([i]() { return ThreadBlockCheck(i); });
     }
     g_parallel_script_checks = true;
 
@@ -161,6 +165,7 @@ TestingSetup::~TestingSetup()
     UnloadBlockIndex();
     g_chainstate.reset();
     pblocktree.reset();
+    g_block_cache.Clear();
 }
 
 TestChain100Setup::TestChain100Setup()
@@ -4,6 +4,7 @@
 //
 #include <sync.h>
 #include <test/util/setup_common.h>
+#include <txdb.h>
 #include <txmempool.h>
 #include <validation.h>
 
@@ -34,7 +35,7 @@ BOOST_AUTO_TEST_CASE(getcoinscachesizestate)
         Coin newcoin;
         uint256 txid = InsecureRand256();
         COutPoint outp{txid, 0};
-        newcoin.nHeight = 1;
+        newcoin.SetHeight(1);
         newcoin.out.nValue = InsecureRand32();
         newcoin.out.scriptPubKey.assign((uint32_t)56, 1);
         coins_view.AddCoin(outp, std::move(newcoin), false);
@@ -81,63 +82,46 @@ BOOST_AUTO_TEST_CASE(getcoinscachesizestate)
     print_view_mem_usage(view);
     BOOST_CHECK_EQUAL(view.DynamicMemoryUsage(), is_64_bit ? 32 : 16);
 
-    // We should be able to add COINS_UNTIL_CRITICAL coins to the cache before going CRITICAL.
-    // This is contingent not only on the dynamic memory usage of the Coins
-    // that we're adding (COIN_SIZE bytes per), but also on how much memory the
-    // cacheCoins (unordered_map) preallocates.
-    constexpr int COINS_UNTIL_CRITICAL{3};
-
-    for (int i{0}; i < COINS_UNTIL_CRITICAL; ++i) {
-        COutPoint res = add_coin(view);
-        print_view_mem_usage(view);
-        BOOST_CHECK_EQUAL(view.AccessCoin(res).DynamicMemoryUsage(), COIN_SIZE);
-        BOOST_CHECK_EQUAL(
-            chainstate.GetCoinsCacheSizeState(tx_pool, MAX_COINS_CACHE_BYTES, /*max_mempool_size_bytes*/ 0),
-            CoinsCacheSizeState::OK);
-    }
-
-    // Adding some additional coins will push us over the edge to CRITICAL.
-    for (int i{0}; i < 4; ++i) {
-        add_coin(view);
-        print_view_mem_usage(view);
-        if (chainstate.GetCoinsCacheSizeState(tx_pool, MAX_COINS_CACHE_BYTES, /*max_mempool_size_bytes*/ 0) ==
-            CoinsCacheSizeState::CRITICAL) {
-            break;
-        }
-    }
-
+    // The entries of cacheCoins are cut from chunks of its memory pool, so
+    // the first coin takes the usage up by a whole chunk, and the coins after
+    // it only by their own heap data until the chunk is full.
+    constexpr size_t POOL_CHUNK_BYTES = PoolResource::DEFAULT_CHUNK_SIZE_BYTES;
+    add_coin(view);
+    print_view_mem_usage(view);
+    BOOST_CHECK(view.DynamicMemoryUsage() > POOL_CHUNK_BYTES);
     BOOST_CHECK_EQUAL(
         chainstate.GetCoinsCacheSizeState(tx_pool, MAX_COINS_CACHE_BYTES, /*max_mempool_size_bytes*/ 0),
         CoinsCacheSizeState::CRITICAL);
 
     // Passing non-zero max mempool usage should allow us more headroom.
     BOOST_CHECK_EQUAL(
-        chainstate.GetCoinsCacheSizeState(tx_pool, MAX_COINS_CACHE_BYTES, /*max_mempool_size_bytes*/ 1 << 10),
+        chainstate.GetCoinsCacheSizeState(tx_pool, MAX_COINS_CACHE_BYTES, /*max_mempool_size_bytes*/ 4 * POOL_CHUNK_BYTES),
         CoinsCacheSizeState::OK);
 
-    for (int i{0}; i < 3; ++i) {
-        add_coin(view);
-        print_view_mem_usage(view);
+    // With room for a few chunks, the cache goes from OK to LARGE past 90% of
+    // it, and to CRITICAL once it is full.
+    constexpr size_t MAX_POOLED_CACHE_BYTES = 4 * POOL_CHUNK_BYTES;
+    constexpr size_t LARGE_POOLED_CACHE_BYTES = 9 * MAX_POOLED_CACHE_BYTES / 10;
+    constexpr int MAX_ATTEMPTS = 100000;
+    int i = 0;
+    for (; i < MAX_ATTEMPTS && view.DynamicMemoryUsage() <= LARGE_POOLED_CACHE_BYTES; ++i) {
         BOOST_CHECK_EQUAL(
-            chainstate.GetCoinsCacheSizeState(tx_pool, MAX_COINS_CACHE_BYTES, /*max_mempool_size_bytes*/ 1 << 10),
+            chainstate.GetCoinsCacheSizeState(tx_pool, MAX_POOLED_CACHE_BYTES, /*max_mempool_size_bytes*/ 0),
             CoinsCacheSizeState::OK);
+        COutPoint res = add_coin(view);
+        BOOST_CHECK_EQUAL(view.AccessCoin(res).DynamicMemoryUsage(), COIN_SIZE);
     }
-
-    // Adding another coin with the additional mempool room will put us >90%
-    // but not yet critical.
-    add_coin(view);
-    print_view_mem_usage(view);
-
-    // Only perform these checks on 64 bit hosts; I haven't done the math for 32.
-    if (is_64_bit) {
-        float usage_percentage = (float)view.DynamicMemoryUsage() / (MAX_COINS_CACHE_BYTES + (1 << 10));
-        BOOST_TEST_MESSAGE("CoinsTip usage percentage: " << usage_percentage);
-        BOOST_CHECK(usage_percentage >= 0.9);
-        BOOST_CHECK(usage_percentage < 1);
+    for (; i < MAX_ATTEMPTS && view.DynamicMemoryUsage() <= MAX_POOLED_CACHE_BYTES; ++i) {
         BOOST_CHECK_EQUAL(
-            chainstate.GetCoinsCacheSizeState(tx_pool, MAX_COINS_CACHE_BYTES, 1 << 10),
+            chainstate.GetCoinsCacheSizeState(tx_pool, MAX_POOLED_CACHE_BYTES, /*max_mempool_size_bytes*/ 0),
             CoinsCacheSizeState::LARGE);
+        add_coin(view);
     }
+    print_view_mem_usage(view);
+    BOOST_CHECK(i < MAX_ATTEMPTS);
+    BOOST_CHECK_EQUAL(
+        chainstate.GetCoinsCacheSizeState(tx_pool, MAX_POOLED_CACHE_BYTES, /*max_mempool_size_bytes*/ 0),
+        CoinsCacheSizeState::CRITICAL);
 
     // Using the default max_* values permits way more coins to be added.
     for (int i{0}; i < 1000; ++i) {
@@ -147,9 +131,8 @@ BOOST_AUTO_TEST_CASE(getcoinscachesizestate)
             CoinsCacheSizeState::OK);
     }
 
-    // Flushing the view doesn't take us back to OK because cacheCoins has
-    // preallocated memory that doesn't get reclaimed even after flush.
-
+    // Flushing the view gives the memory of its pool back, which takes us
+    // back to OK.
     BOOST_CHECK_EQUAL(
         chainstate.GetCoinsCacheSizeState(tx_pool, MAX_COINS_CACHE_BYTES, 0),
         CoinsCacheSizeState::CRITICAL);
@@ -158,9 +141,62 @@ BOOST_AUTO_TEST_CASE(getcoinscachesizestate)
     BOOST_CHECK(view.Flush());
     print_view_mem_usage(view);
 
+    BOOST_CHECK_EQUAL(view.DynamicMemoryUsage(), is_64_bit ? 32 : 16);
     BOOST_CHECK_EQUAL(
         chainstate.GetCoinsCacheSizeState(tx_pool, MAX_COINS_CACHE_BYTES, 0),
-        CoinsCacheSizeState::CRITICAL);
+        CoinsCacheSizeState::OK);
+}
+
+//! Test that flushes handed over to CCoinsViewBackgroundFlush stay readable
+//! through it, and leave the database consistent with the last block flushed.
+BOOST_AUTO_TEST_CASE(background_flush)
+{
+    CCoinsViewDB db{"test_chainstate", /*nCacheSize*/ 1 << 20, /*fMemory*/ true, /*fWipe*/ false};
+    CCoinsViewBackgroundFlush flush_view{db};
+    CCoinsViewCache view{&flush_view};
+
+    std::vector<COutPoint> outpoints;
+    for (int i{0}; i < 1000; ++i) {
+        outpoints.emplace_back(InsecureRand256(), 0);
+        view.AddCoin(outpoints.back(), Coin(CTxOut(COIN, CScript() << OP_TRUE), 1, false, false, 0), false);
+    }
+    const uint256 first_block = InsecureRand256();
+    view.SetBestBlock(first_block);
+
+    // The cache starts over empty, but still sees the coins it handed over
+    BOOST_CHECK(flush_view.WriteInBackground(view.TakeBatch()));
+    BOOST_CHECK_EQUAL(view.GetCacheSize(), 0U);
+    BOOST_CHECK_EQUAL(view.GetBestBlock(), first_block);
+    BOOST_CHECK_EQUAL(flush_view.GetBestBlock(), first_block);
+    for (const COutPoint& outpoint : outpoints)
+        BOOST_CHECK(view.HaveCoin(outpoint));
+
+    // A second flush waits for the first one to be written
+    BOOST_CHECK(view.SpendCoin(outpoints[0]));
+    const COutPoint added{InsecureRand256(), 0};
+    view.AddCoin(added, Coin(CTxOut(COIN, CScript() << OP_TRUE), 2, false, false, 0), false);
+    const uint256 second_block = InsecureRand256();
+    view.SetBestBlock(second_block);
+    // The callback runs once the batch is on disk
+    uint256 written_block;
+    BOOST_CHECK(flush_view.WriteInBackground(view.TakeBatch(), [&] { written_block = db.GetBestBlock(); }));
+    BOOST_CHECK(!view.HaveCoin(outpoints[0]));
+    BOOST_CHECK(view.HaveCoin(added));
+
+    BOOST_CHECK(flush_view.Wait());
+    BOOST_CHECK_EQUAL(db.GetBestBlock(), second_block);
+    BOOST_CHECK_EQUAL(written_block, second_block);
+    BOOST_CHECK(db.GetHeadBlocks().empty());
+    BOOST_CHECK(!db.HaveCoin(outpoints[0]));
+    BOOST_CHECK(db.HaveCoin(outpoints[1]));
+    BOOST_CHECK(db.HaveCoin(added));
+
+    // Synchronous flushes go through as before
+    BOOST_CHECK(view.SpendCoin(added));
+    view.SetBestBlock(first_block);
+    BOOST_CHECK(view.Flush());
+    BOOST_CHECK(!db.HaveCoin(added));
+    BOOST_CHECK_EQUAL(db.GetBestBlock(), first_block);
 }
 
 BOOST_AUTO_TEST_SUITE_END()
@@ -3,6 +3,8 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <chainparams.h>
+#include <consensus/merkle.h>
+#include <consensus/validation.h>
 #include <net.h>
 #include <validation.h>
 
@@ -50,4 +52,90 @@ BOOST_AUTO_TEST_CASE(test_combiner_all)
     Test.disconnect(&ReturnTrue);
     BOOST_CHECK(Test());
 }
+static CBlock MakeCheckBlockTestBlock(size_t nTx)
+{
+    CBlock block;
+    block.nTime = 1600000000;
+
+    CMutableTransaction coinbase;
+    coinbase.nTime = block.nTime;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].scriptSig = CScript() << OP_1 << OP_2;
+    coinbase.vout.emplace_back(COIN, CScript() << OP_TRUE);
+    block.vtx.push_back(MakeTransactionRef(coinbase));
+
+    while (block.vtx.size() < nTx) {
+        CMutableTransaction tx;
+        tx.nTime = block.nTime;
+        tx.vin.emplace_back(COutPoint(InsecureRand256(), 0));
+        tx.vout.emplace_back(COIN, CScript() << OP_TRUE);
+        block.vtx.push_back(MakeTransactionRef(tx));
+    }
+    block.hashMerkleRoot = BlockMerkleRoot(block);
+    return block;
+}
+
+static std::string CheckBlockBothWays(const CBlock& block, bool fExpectValid)
+{
+    const auto chainParams = CreateChainParams(CBaseChainParams::MAIN);
+    BlockValidationState states[2];
+    bool results[2];
+    for (bool fParallel : {false, true}) {
+        g_parallel_script_checks = fParallel;
+        block.fChecked = false;
+        results[fParallel] = CheckBlock(block, states[fParallel], chainParams->GetConsensus(), false, true);
+    }
+    g_parallel_script_checks = true;
+
+    BOOST_CHECK_EQUAL(results[0], fExpectValid);
+    BOOST_CHECK_EQUAL(results[1], results[0]);
+    BOOST_CHECK_EQUAL(states[1].GetRejectReason(), states[0].GetRejectReason());
+    BOOST_CHECK_EQUAL(states[1].GetDebugMessage(), states[0].GetDebugMessage());
+    return states[0].GetRejectReason();
+}
+
+BOOST_AUTO_TEST_CASE(checkblock_parallel_matches_serial)
+{
+    // Around the sizes of the runs the block check threads take, the checks
+    // and the merkle root come out the same as on the calling thread
+    for (size_t nTx : {1, 2, 3, 15, 16, 17, 31, 32, 33, 47, 100, 255, 256, 257}) {
+        const CBlock block = MakeCheckBlockTestBlock(nTx);
+        CheckBlockBothWays(block, true);
+
+        // Repeating the last transactions keeps the merkle root, but is
+        // caught as a mutation whichever run the repeat falls in
+        for (size_t nRepeat : {1, 2, 16}) {
+            if (nRepeat > nTx) continue;
+            CBlock repeated = block;
+            for (size_t i = nTx - nRepeat; i < nTx; i++)
+                repeated.vtx.push_back(block.vtx[i]);
+            bool mutated;
+            repeated.hashMerkleRoot = BlockMerkleRoot(repeated, &mutated);
+            CheckBlockBothWays(repeated, !mutated);
+        }
+
+        CBlock bad_root = block;
+        bad_root.hashMerkleRoot = uint256();
+        CheckBlockBothWays(bad_root, false);
+
+        // Of several invalid transactions, the first one is reported
+        if (nTx > 2) {
+            CBlock bad_txs = block;
+            CMutableTransaction negative(*bad_txs.vtx[nTx - 1]);
+            negative.vout[0].nValue = -1;
+            bad_txs.vtx[nTx - 1] = MakeTransactionRef(negative);
+            CMutableTransaction duplicate(*bad_txs.vtx[nTx / 2]);
+            duplicate.vin.push_back(duplicate.vin[0]);
+            bad_txs.vtx[nTx / 2] = MakeTransactionRef(duplicate);
+            bad_txs.hashMerkleRoot = BlockMerkleRoot(bad_txs);
+            BOOST_CHECK_EQUAL(CheckBlockBothWays(bad_txs, false), "bad-txns-inputs-duplicate");
+
+            // Transactions that do not match the header make the block
+            // mutated, which is checked before any of them
+            bad_txs.hashMerkleRoot = block.hashMerkleRoot;
+            BOOST_CHECK_EQUAL(CheckBlockBothWays(bad_txs, false), "bad-txnmrklroot");
+        }
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
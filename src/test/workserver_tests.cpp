@@ -0,0 +1,282 @@
+// Copyright (c) 2020 The Vericonomy developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <arith_uint256.h>
+#include <consensus/merkle.h>
+#include <crypto/common.h>
+#include <hash.h>
+#include <key_io.h>
+#include <primitives/block.h>
+#include <primitives/transaction.h>
+#include <test/util/setup_common.h>
+#include <timedata.h>
+#include <tinyformat.h>
+#include <univalue.h>
+#include <util/strencodings.h>
+#include <util/time.h>
+#include <workserver.h>
+
+#include <map>
+#include <string.h>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(workserver_tests, BasicTestingSetup)
+
+/** The client side of the protocol, as an external miner implements it */
+struct DummyMiner
+{
+    std::vector<UniValue> replies;
+    std::string extranonce1;
+    UniValue job;
+    arith_uint256 shareTarget;
+
+    void Receive(const std::string& line)
+    {
+        UniValue message;
+        BOOST_REQUIRE(message.read(line));
+        const UniValue& method = find_value(message, "method");
+        if (method.isNull()) {
+            replies.push_back(message);
+            const UniValue& result = find_value(message, "result");
+            // The reply to mining.subscribe
+            if (result.isArray() && result.size() == 3) {
+                extranonce1 = result[1].get_str();
+                BOOST_CHECK_EQUAL(result[2].get_int(), WORKSERVER_EXTRANONCE2_SIZE);
+            }
+        } else if (method.get_str() == "mining.notify") {
+            job = find_value(message, "params");
+        } else if (method.get_str() == "mining.set_target") {
+            shareTarget = UintToArith256(uint256S(find_value(message, "params")[0].get_str()));
+        }
+    }
+
+    UniValue LastReply() const { return replies.back(); }
+
+    /** Build the header for the current job like a stratum miner would */
+    CBlockHeader Header(const std::string& extranonce2, uint32_t nNonce) const
+    {
+        const std::vector<unsigned char> coinbase = ParseHex(job[2].get_str() + extranonce1 + extranonce2 + job[3].get_str());
+        uint256 root = Hash(coinbase.begin(), coinbase.end());
+        for (const UniValue& branch : job[4].getValues()) {
+            const std::vector<unsigned char> hash = ParseHex(branch.get_str());
+            root = Hash(root.begin(), root.end(), hash.begin(), hash.end());
+        }
+        std::vector<unsigned char> prev = ParseHex(job[1].get_str());
+        for (size_t i = 0; i < prev.size(); i += 4)
+            std::reverse(prev.begin() + i, prev.begin() + i + 4);
+
+        CBlockHeader header;
+        header.nVersion = ReadBE32(ParseHex(job[5].get_str()).data());
+        memcpy(header.hashPrevBlock.begin(), prev.data(), 32);
+        header.hashMerkleRoot = root;
+        header.nBits = ReadBE32(ParseHex(job[6].get_str()).data());
+        header.nTime = ReadBE32(ParseHex(job[7].get_str()).data());
+        header.nNonce = nNonce;
+        return header;
+    }
+
+    std::string Submit(const std::string& extranonce2, uint32_t nNonce, const std::string& job_id = "") const
+    {
+        return strprintf("{\"id\":4,\"method\":\"mining.submit\",\"params\":[\"worker\",\"%s\",\"%s\",\"%s\",\"%08x\"]}",
+            job_id.empty() ? job[0].get_str() : job_id, extranonce2, job[7].get_str(), nNonce);
+    }
+};
+
+struct WorkServerSetup : public BasicTestingSetup
+{
+    std::map<int64_t, DummyMiner> miners;
+    std::vector<CBlock> found;
+    WorkServer server;
+    const std::string address;
+
+    WorkServerSetup() :
+        server([this](int64_t client, const std::string& line) { miners[client].Receive(line); },
+               [this](CBlock& block) { found.push_back(block); return true; }),
+        address(EncodeDestination(PKHash(uint160(ParseHex("0102030405060708090a0b0c0d0e0f1011121314"))))) {}
+
+    DummyMiner& Connect(int64_t client)
+    {
+        server.AddClient(client);
+        BOOST_CHECK(server.ProcessLine(client, "{\"id\":1,\"method\":\"mining.subscribe\",\"params\":[\"dummyminer/1.0\"]}"));
+        BOOST_CHECK(server.ProcessLine(client, strprintf("{\"id\":2,\"method\":\"mining.authorize\",\"params\":[\"%s.rig1\",\"x\"]}", address)));
+        return miners[client];
+    }
+};
+
+/** A block template with a coinbase and nTx other transactions */
+static CBlock TemplateBlock(int nTx, uint32_t nBits)
+{
+    CBlock block;
+    block.nVersion = 4;
+    block.hashPrevBlock = uint256S("0x00000000000000000000000000000000000000000000000000000000deadbeef");
+    block.nTime = GetAdjustedTime() - 60;
+    block.nBits = nBits;
+
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].prevout.SetNull();
+    coinbase.vin[0].scriptSig = CScript() << 100000 << OP_0;
+    coinbase.vout.resize(1);
+    coinbase.vout[0].nValue = 2500 * COIN;
+    block.vtx.push_back(MakeTransactionRef(coinbase));
+    for (int i = 1; i <= nTx; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(ArithToUint256(arith_uint256(i)), 0);
+        tx.vout.resize(1);
+        tx.vout[0].nValue = i * COIN;
+        block.vtx.push_back(MakeTransactionRef(tx));
+    }
+    return block;
+}
+
+BOOST_FIXTURE_TEST_CASE(workserver_job_matches_template, WorkServerSetup)
+{
+    const CBlock block = TemplateBlock(4, 0x1d00ffff);
+    server.NewJob(block, 100000, true);
+
+    DummyMiner& miner = Connect(1);
+    BOOST_REQUIRE(miner.job.isArray());
+    BOOST_CHECK_EQUAL(miner.job.size(), 9U);
+    BOOST_CHECK(miner.job[8].get_bool());
+    BOOST_CHECK_EQUAL(miner.extranonce1.size(), 2U * WORKSERVER_EXTRANONCE1_SIZE);
+    BOOST_CHECK(miner.shareTarget == arith_uint256().SetCompact(block.nBits) << WORKSERVER_SHARE_SHIFT);
+
+    // The header the miner assembles is the template with its coinbase filled in
+    const CBlockHeader header = miner.Header("0000002a", 7);
+    CBlock expected = block;
+    CMutableTransaction coinbase(*expected.vtx[0]);
+    coinbase.vin[0].scriptSig = CScript() << 100000 << ParseHex(miner.extranonce1 + "0000002a");
+    coinbase.vout[0].scriptPubKey = GetScriptForDestination(DecodeDestination(address));
+    expected.vtx[0] = MakeTransactionRef(coinbase);
+    BOOST_CHECK_EQUAL(header.hashMerkleRoot, BlockMerkleRoot(expected));
+    BOOST_CHECK_EQUAL(header.hashPrevBlock, block.hashPrevBlock);
+    BOOST_CHECK_EQUAL(header.nVersion, block.nVersion);
+    BOOST_CHECK_EQUAL(header.nBits, block.nBits);
+    BOOST_CHECK_EQUAL(header.nTime, block.nTime);
+
+    // A second client gets a distinct extranonce1, and new jobs are pushed to both
+    DummyMiner& other = Connect(2);
+    BOOST_CHECK(other.extranonce1 != miner.extranonce1);
+    const std::string first_job = miner.job[0].get_str();
+    server.NewJob(TemplateBlock(1, 0x1d00ffff), 100000, false);
+    BOOST_CHECK(miner.job[0].get_str() != first_job);
+    BOOST_CHECK_EQUAL(miner.job[0].get_str(), other.job[0].get_str());
+    BOOST_CHECK(!miner.job[8].get_bool());
+}
+
+BOOST_FIXTURE_TEST_CASE(workserver_submit_shares_and_blocks, WorkServerSetup)
+{
+    // An easy target, so a few nonces find both a block and a share that is not one
+    server.NewJob(TemplateBlock(2, 0x207fffff), 100000, true);
+    DummyMiner& miner = Connect(1);
+    const arith_uint256 target = arith_uint256().SetCompact(0x207fffff);
+
+    uint32_t nBlockNonce = 0, nShareNonce = 0;
+    bool fBlock = false, fShare = false;
+    for (uint32_t nNonce = 0; nNonce < 64 && !(fBlock && fShare); nNonce++) {
+        const bool fMeetsTarget = UintToArith256(miner.Header("00000001", nNonce).GetWorkHash()) <= target;
+        if (fMeetsTarget && !fBlock) {
+            fBlock = true;
+            nBlockNonce = nNonce;
+        } else if (!fMeetsTarget && !fShare) {
+            fShare = true;
+            nShareNonce = nNonce;
+        }
+    }
+    BOOST_REQUIRE(fBlock && fShare);
+
+    BOOST_CHECK(server.ProcessLine(1, miner.Submit("00000001", nBlockNonce)));
+    BOOST_CHECK(find_value(miner.LastReply(), "result").get_bool());
+    BOOST_REQUIRE_EQUAL(found.size(), 1U);
+    BOOST_CHECK_EQUAL(found[0].GetHash(), miner.Header("00000001", nBlockNonce).GetHash());
+    BOOST_CHECK_EQUAL(server.BlocksFound(), 1U);
+
+    // The same solution again is a duplicate
+    BOOST_CHECK(server.ProcessLine(1, miner.Submit("00000001", nBlockNonce)));
+    BOOST_CHECK_EQUAL(find_value(miner.LastReply(), "error")[0].get_int(), 22);
+    BOOST_CHECK_EQUAL(found.size(), 1U);
+
+    // A share that misses the block target is counted but not submitted
+    BOOST_CHECK(server.ProcessLine(1, miner.Submit("00000001", nShareNonce)));
+    BOOST_CHECK(find_value(miner.LastReply(), "result").get_bool());
+    BOOST_CHECK_EQUAL(found.size(), 1U);
+    BOOST_CHECK_EQUAL(server.SharesAccepted(), 2U);
+}
+
+BOOST_FIXTURE_TEST_CASE(workserver_rejects_bad_submissions, WorkServerSetup)
+{
+    server.NewJob(TemplateBlock(1, 0x1d00ffff), 100000, true);
+
+    // Submitting before authorizing, and authorizing with something that is not an address
+    server.AddClient(1);
+    BOOST_CHECK(server.ProcessLine(1, "{\"id\":1,\"method\":\"mining.subscribe\",\"params\":[]}"));
+    BOOST_CHECK(server.ProcessLine(1, "{\"id\":4,\"method\":\"mining.submit\",\"params\":[\"worker\",\"1\",\"00000000\",\"00000000\",\"00000000\"]}"));
+    BOOST_CHECK_EQUAL(find_value(miners[1].LastReply(), "error")[0].get_int(), 24);
+    BOOST_CHECK(server.ProcessLine(1, "{\"id\":2,\"method\":\"mining.authorize\",\"params\":[\"notanaddress\",\"x\"]}"));
+    BOOST_CHECK(!find_value(miners[1].LastReply(), "result").get_bool());
+    BOOST_CHECK(miners[1].job.isNull());
+
+    DummyMiner& miner = Connect(2);
+    BOOST_REQUIRE(miner.job.isArray());
+
+    // Unknown job, malformed extranonce2, ntime before the template's
+    BOOST_CHECK(server.ProcessLine(2, miner.Submit("00000001", 0, "ffff")));
+    BOOST_CHECK_EQUAL(find_value(miner.LastReply(), "error")[0].get_int(), 21);
+    BOOST_CHECK(server.ProcessLine(2, miner.Submit("0001", 0)));
+    BOOST_CHECK_EQUAL(find_value(miner.LastReply(), "error")[0].get_int(), 20);
+    BOOST_CHECK(server.ProcessLine(2, strprintf("{\"id\":4,\"method\":\"mining.submit\",\"params\":[\"worker\",\"%s\",\"00000001\",\"%08x\",\"00000000\"]}",
+        miner.job[0].get_str(), ReadBE32(ParseHex(miner.job[7].get_str()).data()) - 1)));
+    BOOST_CHECK_EQUAL(find_value(miner.LastReply(), "error")[0].get_int(), 20);
+
+    // A hash above the share target
+    BOOST_CHECK(server.ProcessLine(2, miner.Submit("00000001", 0)));
+    BOOST_CHECK_EQUAL(find_value(miner.LastReply(), "error")[0].get_int(), 23);
+    BOOST_CHECK_EQUAL(server.SharesAccepted(), 0U);
+
+    // A new tip makes the old job stale
+    const std::string old_job = miner.job[0].get_str();
+    server.NewJob(TemplateBlock(1, 0x1d00ffff), 100001, true);
+    BOOST_CHECK(server.ProcessLine(2, miner.Submit("00000001", 0, old_job)));
+    BOOST_CHECK_EQUAL(find_value(miner.LastReply(), "error")[0].get_int(), 21);
+
+    // Unknown methods get an error, garbage gets the client dropped
+    BOOST_CHECK(server.ProcessLine(2, "{\"id\":5,\"method\":\"mining.frobnicate\",\"params\":[]}"));
+    BOOST_CHECK_EQUAL(find_value(miner.LastReply(), "error")[0].get_int(), 20);
+    BOOST_CHECK(!server.ProcessLine(2, "not json"));
+    BOOST_CHECK(found.empty());
+}
+
+BOOST_FIXTURE_TEST_CASE(workserver_limits_share_checks, WorkServerSetup)
+{
+    SetMockTime(GetTime());
+
+    // Every nonce makes a share on an easy target, but only so many get hashed a minute
+    server.NewJob(TemplateBlock(1, 0x207fffff), 100000, true);
+    DummyMiner& miner = Connect(1);
+    for (uint32_t nNonce = 0; nNonce < MAX_WORKSERVER_SHARES_PER_MINUTE; nNonce++)
+        BOOST_CHECK(server.ProcessLine(1, miner.Submit("00000001", nNonce)));
+    BOOST_CHECK_EQUAL(server.SharesAccepted(), (uint64_t)MAX_WORKSERVER_SHARES_PER_MINUTE);
+    BOOST_CHECK(server.ProcessLine(1, miner.Submit("00000002", 0)));
+    BOOST_CHECK_EQUAL(find_value(miner.LastReply(), "error")[0].get_int(), 20);
+    SetMockTime(GetTime() + 60);
+    BOOST_CHECK(server.ProcessLine(1, miner.Submit("00000002", 0)));
+    BOOST_CHECK(find_value(miner.LastReply(), "result").get_bool());
+
+    // A client that keeps sending shares above the target is dropped
+    server.NewJob(TemplateBlock(1, 0x1d00ffff), 100001, true);
+    DummyMiner& other = Connect(2);
+    for (uint32_t nNonce = 1; nNonce < MAX_WORKSERVER_LOW_SHARES; nNonce++) {
+        BOOST_CHECK(server.ProcessLine(2, other.Submit("00000001", nNonce)));
+        BOOST_CHECK_EQUAL(find_value(other.LastReply(), "error")[0].get_int(), 23);
+    }
+    BOOST_CHECK(!server.ProcessLine(2, other.Submit("00000001", MAX_WORKSERVER_LOW_SHARES)));
+    BOOST_CHECK_EQUAL(find_value(other.LastReply(), "error")[0].get_int(), 23);
+
+    SetMockTime(0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
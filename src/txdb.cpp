@@ -12,6 +12,8 @@
 #include <ui_interface.h>
 #include <uint256.h>
 #include <util/system.h>
+#include <util/threadnames.h>
+#include <util/time.h>
 #include <util/translation.h>
 #include <util/vector.h>
 
@@ -29,6 +31,7 @@ static const char DB_HEAD_BLOCKS = 'H';
 static const char DB_FLAG = 'F';
 static const char DB_REINDEX_FLAG = 'R';
 static const char DB_LAST_BLOCK = 'l';
+static const char DB_WORK_HASH = 'W';
 
 namespace {
 
@@ -82,6 +85,14 @@ std::vector<uint256> CCoinsViewDB::GetHeadBlocks() const {
 }
 
 bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
+    return WriteCoins(mapCoins, hashBlock, &mapCoins);
+}
+
+bool CCoinsViewDB::WriteCoins(const CCoinsMap &mapCoins, const uint256 &hashBlock) {
+    return WriteCoins(mapCoins, hashBlock, nullptr);
+}
+
+bool CCoinsViewDB::WriteCoins(const CCoinsMap &mapCoins, const uint256 &hashBlock, CCoinsMap *pmapErase) {
     CDBBatch batch(db);
     size_t count = 0;
     size_t changed = 0;
@@ -106,7 +117,7 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
     batch.Erase(DB_BEST_BLOCK);
     batch.Write(DB_HEAD_BLOCKS, Vector(hashBlock, old_tip));
 
-    for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
+    for (CCoinsMap::const_iterator it = mapCoins.begin(); it != mapCoins.end();) {
         if (it->second.flags & CCoinsCacheEntry::DIRTY) {
             CoinEntry entry(&it->first);
             if (it->second.coin.IsSpent())
@@ -116,8 +127,9 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
             changed++;
         }
         count++;
-        CCoinsMap::iterator itOld = it++;
-        mapCoins.erase(itOld);
+        CCoinsMap::const_iterator itOld = it++;
+        if (pmapErase)
+            pmapErase->erase(itOld);
         if (batch.SizeEstimate() > batch_size) {
             LogPrint(BCLog::COINDB, "Writing partial batch of %.2f MiB\n", batch.SizeEstimate() * (1.0 / 1048576.0));
             db.WriteBatch(batch);
@@ -142,6 +154,83 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
     return ret;
 }
 
+CCoinsViewBackgroundFlush::~CCoinsViewBackgroundFlush() {
+    Wait();
+}
+
+bool CCoinsViewBackgroundFlush::GetCoin(const COutPoint &outpoint, Coin &coin) const {
+    std::shared_ptr<const CCoinsBatch> batch = WITH_LOCK(m_mutex, return m_batch);
+    if (batch) {
+        CCoinsMap::const_iterator it = batch->coins.find(outpoint);
+        if (it != batch->coins.end()) {
+            coin = it->second.coin;
+            return !coin.IsSpent();
+        }
+    }
+    return base->GetCoin(outpoint, coin);
+}
+
+bool CCoinsViewBackgroundFlush::HaveCoin(const COutPoint &outpoint) const {
+    Coin coin;
+    return GetCoin(outpoint, coin);
+}
+
+uint256 CCoinsViewBackgroundFlush::GetBestBlock() const {
+    std::shared_ptr<const CCoinsBatch> batch = WITH_LOCK(m_mutex, return m_batch);
+    if (batch)
+        return batch->hashBlock;
+    return base->GetBestBlock();
+}
+
+bool CCoinsViewBackgroundFlush::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
+    if (!Wait())
+        return false;
+    return base->BatchWrite(mapCoins, hashBlock);
+}
+
+bool CCoinsViewBackgroundFlush::WriteInBackground(std::unique_ptr<CCoinsBatch> batch, std::function<void()> on_written) {
+    if (!Wait())
+        return false;
+    std::shared_ptr<const CCoinsBatch> shared_batch(std::move(batch));
+    WITH_LOCK(m_mutex, m_batch = shared_batch);
+    m_thread = std::thread(&CCoinsViewBackgroundFlush::ThreadWriteBatch, this, std::move(shared_batch), std::move(on_written));
+    return true;
+}
+
+bool CCoinsViewBackgroundFlush::Wait() {
+    if (m_thread.joinable()) {
+        int64_t nStart = GetTimeMicros();
+        m_thread.join();
+        LogPrint(BCLog::BENCH, "Waited %.2fms for the previous coins write\n", (GetTimeMicros() - nStart) * 0.001);
+    }
+    LOCK(m_mutex);
+    return !m_write_failed;
+}
+
+void CCoinsViewBackgroundFlush::ThreadWriteBatch(std::shared_ptr<const CCoinsBatch> batch, std::function<void()> on_written) {
+    util::ThreadRename("coinsflush");
+    int64_t nStart = GetTimeMicros();
+    bool fOk = false;
+    try {
+        fOk = m_db.WriteCoins(batch->coins, batch->hashBlock);
+    } catch (const std::exception& e) {
+        LogPrintf("%s: %s\n", __func__, e.what());
+    }
+    LogPrint(BCLog::BENCH, "Wrote %u coins (%.2f MiB) in the background: %.2fms\n", (unsigned int)batch->coins.size(), batch->usage * (1.0 / 1048576.0), (GetTimeMicros() - nStart) * 0.001);
+
+    {
+        LOCK(m_mutex);
+        if (fOk) {
+            m_batch.reset();
+        } else {
+            // Keep answering reads from the batch; the next flush reports the failure
+            m_write_failed = true;
+        }
+    }
+    if (fOk && on_written)
+        on_written();
+}
+
 size_t CCoinsViewDB::EstimateSize() const
 {
     return db.EstimateSize(DB_COIN, (char)(DB_COIN+1));
@@ -231,6 +320,10 @@ bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockF
     batch.Write(DB_LAST_BLOCK, nLastFile);
     for (std::vector<const CBlockIndex*>::const_iterator it=blockinfo.begin(); it != blockinfo.end(); it++) {
         batch.Write(std::make_pair(DB_BLOCK_INDEX, (*it)->GetBlockHash()), CDiskBlockIndex(*it));
+        // Verium: kept out of the entry, which older versions rewrite with
+        // the BLOCK_POW_VERIFIED bit they don't know about but without the hash
+        if ((*it)->nStatus & BLOCK_POW_VERIFIED)
+            batch.Write(std::make_pair(DB_WORK_HASH, (*it)->GetBlockHash()), (*it)->hashWork);
     }
     return WriteBatch(batch, true);
 }
@@ -251,6 +344,20 @@ bool CBlockTreeDB::LoadBlockIndexGuts(const Consensus::Params& consensusParams,
 {
     std::unique_ptr<CDBIterator> pcursor(NewIterator());
 
+    // Verium: load the recorded work hashes first, the entries below keep them
+    pcursor->Seek(std::make_pair(DB_WORK_HASH, uint256()));
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        if (ShutdownRequested()) return false;
+        std::pair<char, uint256> key;
+        if (!pcursor->GetKey(key) || key.first != DB_WORK_HASH)
+            break;
+        CBlockIndex* pindex = insertBlockIndex(key.second);
+        if (!pindex || !pcursor->GetValue(pindex->hashWork))
+            return error("%s: failed to read work hash", __func__);
+        pcursor->Next();
+    }
+
     pcursor->Seek(std::make_pair(DB_BLOCK_INDEX, uint256()));
 
     // Load m_block_index
@@ -275,6 +382,10 @@ bool CBlockTreeDB::LoadBlockIndexGuts(const Consensus::Params& consensusParams,
                 pindexNew->nNonce         = diskindex.nNonce;
                 pindexNew->nStatus        = diskindex.nStatus;
                 pindexNew->nTx            = diskindex.nTx;
+                // Without a recorded work hash to go with the bit, the block
+                // is hashed again when checked
+                if (pindexNew->hashWork.IsNull())
+                    pindexNew->nStatus &= ~BLOCK_POW_VERIFIED;
 
                 // XXX: to check
                 // ppcoin related block index fields
@@ -290,11 +401,11 @@ bool CBlockTreeDB::LoadBlockIndexGuts(const Consensus::Params& consensusParams,
                 }
 
                 /* Verium:
-                 *   We're not going to run the check here, as it takes a very long time at client startup.
-                 * Instead, we will assume that the local client data is valid.
+                 *   Recomputing scrypt here would take hours at client startup, so only check
+                 * that the work hash recorded when the block was first verified meets its target.
                  */
-                //if (!CheckProofOfWork(pindexNew->GetBlockHash(), pindexNew->nBits, consensusParams))
-                //    return error("%s: CheckProofOfWork failed: %s", __func__, pindexNew->ToString());
+                if ((pindexNew->nStatus & BLOCK_POW_VERIFIED) && !CheckProofOfWork(pindexNew->hashWork, pindexNew->nBits, consensusParams))
+                    return error("%s: CheckProofOfWork failed: %s", __func__, pindexNew->ToString());
                 pcursor->Next();
             } else {
                 return error("%s: failed to read value", __func__);
@@ -10,9 +10,12 @@
 #include <dbwrapper.h>
 #include <chain.h>
 #include <primitives/block.h>
+#include <sync.h>
 
+#include <functional>
 #include <memory>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -57,9 +60,59 @@ public:
     bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
     CCoinsViewCursor *Cursor() const override;
 
+    //! Write the dirty coins of mapCoins like BatchWrite(), but leave mapCoins
+    //! as it is, so that other threads may read it while it is written.
+    bool WriteCoins(const CCoinsMap &mapCoins, const uint256 &hashBlock);
+
     //! Attempt to update from an older database format. Returns whether an error occurred.
     bool Upgrade();
     size_t EstimateSize() const override;
+
+private:
+    bool WriteCoins(const CCoinsMap &mapCoins, const uint256 &hashBlock, CCoinsMap *pmapErase);
+};
+
+/**
+ * CCoinsView over CCoinsViewDB that writes flushed coins caches to it on a
+ * background thread. The cache hands its contents over as a CCoinsBatch and
+ * goes on empty, while this view answers reads from the batch until it is
+ * written. The write marks its range of blocks in the database like any
+ * BatchWrite(), so a crash during it is recovered by ReplayBlocks().
+ *
+ * Only one batch is written at a time: handing over the next one, or
+ * writing through BatchWrite(), waits for the previous write to finish.
+ * Reads are safe from any thread, but a batch may only be handed over, and
+ * waited for, by the thread that owns the cache above.
+ */
+class CCoinsViewBackgroundFlush final : public CCoinsViewBacked
+{
+private:
+    CCoinsViewDB& m_db;
+    mutable Mutex m_mutex;
+    //! The batch being written, or that failed to be written
+    std::shared_ptr<const CCoinsBatch> m_batch GUARDED_BY(m_mutex);
+    bool m_write_failed GUARDED_BY(m_mutex){false};
+    std::thread m_thread;
+
+    void ThreadWriteBatch(std::shared_ptr<const CCoinsBatch> batch, std::function<void()> on_written);
+
+public:
+    explicit CCoinsViewBackgroundFlush(CCoinsViewDB& db) : CCoinsViewBacked(&db), m_db(db) {}
+    ~CCoinsViewBackgroundFlush();
+
+    bool GetCoin(const COutPoint &outpoint, Coin &coin) const override;
+    bool HaveCoin(const COutPoint &outpoint) const override;
+    uint256 GetBestBlock() const override;
+    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
+
+    //! Start writing batch in the background, once the previous write is
+    //! done. Returns false if that one failed, without starting this one.
+    //! on_written, if given, is called from the writing thread once the batch
+    //! is on disk, and not at all if the write fails.
+    bool WriteInBackground(std::unique_ptr<CCoinsBatch> batch, std::function<void()> on_written = nullptr);
+
+    //! Wait for the batch being written, if any. Returns false if a write failed.
+    bool Wait();
 };
 
 /** Specialization of CCoinsViewCursor to iterate over a CCoinsViewDB */
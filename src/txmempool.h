@@ -31,9 +31,6 @@
 class CBlockIndex;
 extern RecursiveMutex cs_main;
 
-/** Fake height value used in Coin to signify they are only in the memory pool (since 0.8) */
-static const uint32_t MEMPOOL_HEIGHT = 0x7FFFFFFF;
-
 struct LockPoints
 {
     // Will be set to the blockchain height and median time past
@@ -24,9 +24,9 @@ struct TxInUndoFormatter
 {
     template<typename Stream>
     void Ser(Stream &s, const Coin& txout) {
-        ::Serialize(s, VARINT(txout.nHeight * uint32_t{4} + txout.fCoinBase + (txout.fCoinStake ? 2u : 0u)));
+        ::Serialize(s, VARINT(txout.GetHeight() * uint32_t{4} + txout.fCoinBase + (txout.fCoinStake ? 2u : 0u)));
         ::Serialize(s, VARINT(txout.nTime));
-        if (txout.nHeight > 0) {
+        if (txout.GetHeight() > 0) {
             // Required to maintain compatibility with older undo format.
             ::Serialize(s, (unsigned char)0);
         }
@@ -37,11 +37,13 @@ struct TxInUndoFormatter
     void Unser(Stream &s, Coin& txout) {
         uint32_t nCode = 0;
         ::Unserialize(s, VARINT(nCode));
-        txout.nHeight = nCode >> 2;
+        if ((nCode >> 2) >= MEMPOOL_HEIGHT)
+            throw std::ios_base::failure("Undo height out of range");
+        txout.SetHeight(nCode >> 2);
         txout.fCoinBase = nCode & 1;
         txout.fCoinStake = nCode & 2;
         ::Unserialize(s, VARINT(txout.nTime));
-        if (txout.nHeight > 0) {
+        if (txout.GetHeight() > 0) {
             // Old versions stored the version number for the last spend of
             // a transaction's outputs. Non-final spends were indicated with
             // height = 0.
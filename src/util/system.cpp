@@ -64,6 +64,8 @@
 #endif
 
 #include <boost/algorithm/string/replace.hpp>
+#include <fstream>
+#include <sstream>
 #include <thread>
 #include <typeinfo>
 #include <univalue.h>
@@ -1162,6 +1164,75 @@ void ScheduleBatchPriority()
 #endif
 }
 
+#ifdef __linux__
+/** Parse a sysfs CPU list such as "0-3,8-11" */
+static std::vector<int> ParseCpuList(const std::string& list)
+{
+    std::vector<int> cpus;
+    std::stringstream ss(list);
+    std::string range;
+    while (std::getline(ss, range, ',')) {
+        int first, last;
+        size_t dash = range.find('-');
+        if (!ParseInt32(TrimString(range.substr(0, dash)), &first)) continue;
+        last = first;
+        if (dash != std::string::npos && !ParseInt32(TrimString(range.substr(dash + 1)), &last)) continue;
+        for (int cpu = first; cpu <= last && cpu < CPU_SETSIZE; ++cpu) {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+#endif
+
+std::vector<std::vector<int>> GetNumaNodeCpus()
+{
+    std::vector<std::vector<int>> nodes;
+#ifdef __linux__
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    const bool have_mask = sched_getaffinity(0, sizeof(allowed), &allowed) == 0;
+    for (int node = 0; ; ++node) {
+        std::ifstream file(strprintf("/sys/devices/system/node/node%d/cpulist", node));
+        if (!file.is_open()) break;
+        std::string list;
+        std::getline(file, list);
+        std::vector<int> cpus;
+        for (int cpu : ParseCpuList(list)) {
+            if (!have_mask || CPU_ISSET(cpu, &allowed)) cpus.push_back(cpu);
+        }
+        // Nodes with memory but no (usable) CPUs cannot host a thread
+        if (!cpus.empty()) nodes.push_back(std::move(cpus));
+    }
+#endif
+    if (nodes.empty()) {
+        nodes.emplace_back();
+        for (int cpu = 0; cpu < GetNumCores(); ++cpu) {
+            nodes.back().push_back(cpu);
+        }
+    }
+    return nodes;
+}
+
+bool SetThreadAffinity(const std::vector<int>& cpus)
+{
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) {
+        if (cpu >= 0 && cpu < CPU_SETSIZE) CPU_SET(cpu, &set);
+    }
+    const int rc = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (rc != 0) {
+        LogPrintf("Failed to pthread_setaffinity_np: %s\n", strerror(rc));
+        return false;
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
 namespace util {
 #ifdef WIN32
 WinCmdLineArgs::WinCmdLineArgs()
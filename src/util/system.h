@@ -483,6 +483,18 @@ std::string CopyrightHolders(const std::string& strPrefix);
  */
 void ScheduleBatchPriority();
 
+/**
+ * Return the CPUs the process may run on, grouped by NUMA node. Where the
+ * topology is unknown this is a single node holding GetNumCores() CPUs.
+ */
+std::vector<std::vector<int>> GetNumaNodeCpus();
+
+/**
+ * On platforms that support it, restrict the calling thread to the given
+ * CPUs. Returns false if the platform or the kernel refused.
+ */
+bool SetThreadAffinity(const std::vector<int>& cpus);
+
 namespace util {
 
 //! Simplification of std insertion
@@ -6,6 +6,7 @@
 #include <validation.h>
 
 #include <arith_uint256.h>
+#include <blockcache.h>
 #include <chain.h>
 #include <chainparams.h>
 #include <checkqueue.h>
@@ -14,6 +15,8 @@
 #include <consensus/tx_check.h>
 #include <consensus/tx_verify.h>
 #include <consensus/validation.h>
+#include <crypto/sha256.h>
+#include <crypto/scrypt.h>
 #include <cuckoocache.h>
 #include <flatfile.h>
 #include <hash.h>
@@ -44,7 +47,11 @@
 #include <util/translation.h>
 #include <validationinterface.h>
 #include <warnings.h>
+
+#include <deque>
+#include <list>
 #include <string>
+#include <thread>
 
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/thread.hpp>
@@ -133,6 +140,8 @@ Mutex g_best_block_mutex;
 std::condition_variable g_best_block_cv;
 uint256 g_best_block;
 bool g_parallel_script_checks{false};
+bool g_async_coins_flush{false};
+int g_script_check_threads{0};
 std::atomic_bool fImporting(false);
 std::atomic_bool fReindex(false);
 bool fRequireStandard = true;
@@ -143,6 +152,8 @@ bool fAlerts = DEFAULT_ALERTS;
 int64_t nMaxTipAge = DEFAULT_MAX_TIP_AGE;
 
 uint256 hashAssumeValid;
+uint256 hashAssumeValidPow;
+std::atomic<uint64_t> nPoWChecksSkipped{0};
 arith_uint256 nMinimumChainWork;
 CFeeRate minRelayTxFee;
 CTxMemPool mempool;
@@ -281,11 +292,11 @@ bool CheckSequenceLocks(const CTxMemPool& pool, const CTransaction& tx, int flag
             if (!viewMemPool.GetCoin(txin.prevout, coin)) {
                 return error("%s: Missing input", __func__);
             }
-            if (coin.nHeight == MEMPOOL_HEIGHT) {
+            if (coin.GetHeight() == MEMPOOL_HEIGHT) {
                 // Assume all mempool transaction confirm in the next block
                 prevheights[txinIndex] = tip->nHeight + 1;
             } else {
-                prevheights[txinIndex] = coin.nHeight;
+                prevheights[txinIndex] = coin.GetHeight();
             }
         }
         lockPair = CalculateSequenceLocks(tx, flags, &prevheights, index);
@@ -890,9 +901,9 @@ bool GetTransaction(const uint256& hash, CTransactionRef& txOut, const Consensus
             return g_txindex->FindTx(hash, hashBlock, txOut);
         }
     } else {
-        CBlock block;
-        if (ReadBlockFromDisk(block, block_index, consensusParams)) {
-            for (const auto& tx : block.vtx) {
+        std::shared_ptr<const CBlock> pblock = ReadCachedBlock(block_index, consensusParams);
+        if (pblock) {
+            for (const auto& tx : pblock->vtx) {
                 if (tx->GetHash() == hash) {
                     txOut = tx;
                     hashBlock = block_index->GetBlockHash();
@@ -961,19 +972,47 @@ bool ReadBlockFromDisk(CBlock& block, const FlatFilePos& pos, const Consensus::P
     return true;
 }
 
-bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams)
+/** Read a block through the block cache, adding it to the cache on a miss if fInsert */
+static std::shared_ptr<const CBlock> ReadIndexedBlock(const CBlockIndex* pindex, const Consensus::Params& consensusParams, bool fInsert)
 {
+    const uint256 hash = pindex->GetBlockHash();
+    std::shared_ptr<const CBlock> pblockCached = g_block_cache.Get(hash);
+    if (pblockCached)
+        return pblockCached;
+
     FlatFilePos blockPos;
     {
         LOCK(cs_main);
         blockPos = pindex->GetBlockPos();
     }
 
-    if (!ReadBlockFromDisk(block, blockPos, consensusParams))
+    std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+    if (!ReadBlockFromDisk(*pblock, blockPos, consensusParams))
+        return nullptr;
+    if (pblock->GetHash() != hash) {
+        error("ReadBlockFromDisk(): GetHash() doesn't match index for %s at %s", pindex->ToString(), blockPos.ToString());
+        return nullptr;
+    }
+    if (fInsert)
+        g_block_cache.Insert(hash, pblock);
+    return pblock;
+}
+
+std::shared_ptr<const CBlock> ReadCachedBlock(const CBlockIndex* pindex, const Consensus::Params& consensusParams)
+{
+    return ReadIndexedBlock(pindex, consensusParams, true);
+}
+
+bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams)
+{
+    std::shared_ptr<const CBlock> pblock = ReadIndexedBlock(pindex, consensusParams, false);
+    if (!pblock) {
+        block.SetNull();
         return false;
-    if (block.GetHash() != pindex->GetBlockHash())
-        return error("ReadBlockFromDisk(CBlock&, CBlockIndex*): GetHash() doesn't match index for %s at %s",
-                pindex->ToString(), pindex->GetBlockPos().ToString());
+    }
+    block = *pblock;
+    // The copy gets checked again by whoever checks it
+    block.fChecked = false;
     return true;
 }
 
@@ -1030,7 +1069,8 @@ CoinsViews::CoinsViews(
     bool in_memory,
     bool should_wipe) : m_dbview(
                             GetDataDir() / ldb_name, cache_size_bytes, in_memory, should_wipe),
-                        m_catcherview(&m_dbview) {}
+                        m_flushview(m_dbview),
+                        m_catcherview(&m_flushview) {}
 
 void CoinsViews::InitCache()
 {
@@ -1456,13 +1496,13 @@ int ApplyTxInUndo(Coin&& undo, CCoinsViewCache& view, const COutPoint& out)
 
     if (view.HaveCoin(out)) fClean = false; // overwriting transaction output
 
-    if (undo.nHeight == 0) {
+    if (undo.GetHeight() == 0) {
         // Missing undo metadata (height and coinbase). Older versions included this
         // information only in undo records for the last spend of a transactions'
         // outputs. This implies that it must be present for some other output of the same tx.
         const Coin& alternate = AccessByTxid(view, out.hash);
         if (!alternate.IsSpent()) {
-            undo.nHeight = alternate.nHeight;
+            undo.SetHeight(alternate.GetHeight());
             undo.fCoinBase = alternate.fCoinBase;
             undo.nTime = alternate.nTime;
             if( IsVericoin() )
@@ -1511,7 +1551,7 @@ DisconnectResult CChainState::DisconnectBlock(const CBlock& block, const CBlockI
                 COutPoint out(hash, o);
                 Coin coin;
                 bool is_spent = view.SpendCoin(out, &coin);
-                if (!is_spent || tx.vout[o] != coin.out || pindex->nHeight != coin.nHeight || is_coinbase != coin.fCoinBase || is_coinstake != coin.fCoinStake) {
+                if (!is_spent || tx.vout[o] != coin.out || pindex->nHeight != coin.GetHeight() || is_coinbase != coin.fCoinBase || is_coinstake != coin.fCoinStake) {
                     fClean = false; // transaction output mismatch
                 }
             }
@@ -1583,6 +1623,151 @@ void ThreadScriptCheck(int worker_num) {
     scriptcheckqueue.Thread();
 }
 
+// Each check already holds a full multi-way scrypt batch, so hand them out one at a time.
+static CCheckQueue<CHeaderPoWCheck> headerpowcheckqueue(1);
+
+void ThreadHeaderPoWCheck(int worker_num) {
+    util::ThreadRename(strprintf("powcheck.%i", worker_num));
+    headerpowcheckqueue.Thread();
+}
+
+/**
+ * Number of transactions of a block checked by each CBlockTxCheck. A power of
+ * two, so that each run is a subtree of the merkle tree, and a multiple of the
+ * eight pairs the widest SHA256D64 kernel hashes at once.
+ */
+static const size_t BLOCK_TX_CHECK_RUN_SIZE = 16;
+static_assert((BLOCK_TX_CHECK_RUN_SIZE & (BLOCK_TX_CHECK_RUN_SIZE - 1)) == 0, "runs must be merkle subtrees");
+
+static CCheckQueue<CBlockTxCheck> blockcheckqueue(8);
+
+void ThreadBlockCheck(int worker_num) {
+    util::ThreadRename(strprintf("blockcheck.%i", worker_num));
+    blockcheckqueue.Thread();
+}
+
+static CCheckQueue<CCoinsFetch> coinsfetchqueue(16);
+
+void ThreadCoinsFetch(int worker_num) {
+    util::ThreadRename(strprintf("coinsfetch.%i", worker_num));
+    coinsfetchqueue.Thread();
+}
+
+/** Whether the scrypt proof of work of a block was already verified and recorded in its index entry. */
+static bool HasVerifiedWork(const CBlockIndex* pindex)
+{
+    return pindex && (pindex->nStatus & BLOCK_POW_VERIFIED);
+}
+
+/** Record the verified scrypt work hash of a block, so later checks don't need to recompute it. */
+static void RecordBlockWork(CBlockIndex* pindex, const uint256& hashWork) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    if (hashWork.IsNull() || HasVerifiedWork(pindex))
+        return;
+    pindex->hashWork = hashWork;
+    pindex->nStatus |= BLOCK_POW_VERIFIED;
+    setDirtyBlockIndex.insert(pindex);
+}
+
+/**
+ * Verium: scrypt work hashes computed ahead of CheckBlockWork() by block imports,
+ * keyed by block hash. Bounded, as blocks that are never accepted leave entries
+ * behind; the oldest entries go first, as the import reads blocks in file order.
+ */
+class CWorkHashCache
+{
+private:
+    static constexpr size_t MAX_ENTRIES = 4096;
+
+    typedef std::list<std::pair<uint256, uint256>> WorkHashList;
+
+    Mutex m_mutex;
+    //! Block hash and work hash, oldest first
+    WorkHashList m_entries GUARDED_BY(m_mutex);
+    std::unordered_map<uint256, WorkHashList::iterator, BlockHasher> m_work_hashes GUARDED_BY(m_mutex);
+
+public:
+    void Insert(const uint256& hash, const uint256& hashWork)
+    {
+        LOCK(m_mutex);
+        if (m_work_hashes.count(hash))
+            return;
+        if (m_entries.size() >= MAX_ENTRIES) {
+            m_work_hashes.erase(m_entries.front().first);
+            m_entries.pop_front();
+        }
+        m_work_hashes.emplace(hash, m_entries.emplace(m_entries.end(), hash, hashWork));
+    }
+
+    /** Remove the entry for a block, returning its work hash if there was one. */
+    bool Take(const uint256& hash, uint256& hashWork)
+    {
+        LOCK(m_mutex);
+        auto it = m_work_hashes.find(hash);
+        if (it == m_work_hashes.end())
+            return false;
+        hashWork = it->second->second;
+        m_entries.erase(it->second);
+        m_work_hashes.erase(it);
+        return true;
+    }
+};
+
+static CWorkHashCache g_work_hash_cache;
+
+/**
+ * Verium: check the scrypt proof of work of a PoW block, unless it was already
+ * checked or its index entry records verified work. hashWork is set when the
+ * hash had to be computed, so the caller can record it with RecordBlockWork().
+ */
+static bool CheckBlockWork(const CBlock& block, const CBlockIndex* pindex, BlockValidationState& state, const Consensus::Params& consensusParams, uint256& hashWork)
+{
+    hashWork.SetNull();
+    if (block.fChecked || block.IsProofOfStake() || HasVerifiedWork(pindex))
+        return true;
+
+    // Failing to hash for lack of memory says nothing about the block, so it
+    // is an error rather than a reason to take the block as invalid
+    if (!g_work_hash_cache.Take(block.GetHash(), hashWork) && !block.GetWorkHash(hashWork)) {
+        hashWork.SetNull();
+        return state.Error("scrypt proof of work could not be computed");
+    }
+    if (!CheckProofOfWork(hashWork, block.nBits, consensusParams))
+        return state.Invalid(BlockValidationResult::BLOCK_INVALID_HEADER, "high-hash", "proof of work failed");
+    return true;
+}
+
+/**
+ * Verium: whether pindex is an ancestor of the -assumevalidpow block, under the same
+ * conditions as -assumevalid skips script checks in ConnectBlock(). Its nBits were
+ * still checked against the retarget rules when its header was accepted.
+ */
+static bool IsAssumedValidWork(const CBlockIndex* pindex, const Consensus::Params& consensusParams) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    if (hashAssumeValidPow.IsNull() || pindexBestHeader == nullptr)
+        return false;
+    const CBlockIndex* pindexAssumed = LookupBlockIndex(hashAssumeValidPow);
+    return pindexAssumed && pindexAssumed->GetAncestor(pindex->nHeight) == pindex &&
+           pindexBestHeader->GetAncestor(pindex->nHeight) == pindex &&
+           pindexBestHeader->nChainTrust >= nMinimumChainWork &&
+           GetBlockProofEquivalentTime(*pindexBestHeader, *pindex, *pindexBestHeader, consensusParams) > 60 * 60 * 24 * 7 * 2;
+}
+
+/**
+ * Verium: whether new headers extending pindexPrev are accepted without hashing
+ * their scrypt proof of work, as candidate ancestors of the -assumevalidpow block.
+ * Only until header sync reaches that block, whose known ancestors are all in the
+ * index from then on, and only along the best header chain, so a single chain of
+ * headers at most is taken on its nBits. Their blocks are hashed like any other
+ * unless IsAssumedValidWork() later proves them ancestors of the assumed block.
+ */
+static bool DeferHeaderWork(const CBlockIndex* pindexPrev) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    if (hashAssumeValidPow.IsNull() || pindexPrev == nullptr || pindexPrev != pindexBestHeader)
+        return false;
+    return LookupBlockIndex(hashAssumeValidPow) == nullptr && ::ChainstateActive().IsInitialBlockDownload();
+}
+
 // 0.13.0 was shipped with a segwit deployment defined for testnet, but not for
 // mainnet. We no longer need to support disabling the segwit deployment
 // except for testing purposes, due to limitations of the functional test
@@ -1671,7 +1856,17 @@ bool CChainState::ConnectBlock(const CBlock& block, BlockValidationState& state,
     // is enforced in ContextualCheckBlockHeader(); we wouldn't want to
     // re-enforce that rule here (at least until we make it impossible for
     // GetAdjustedTime() to go backward).
-    if (!CheckBlock(block, state, chainparams.GetConsensus(), !fJustCheck, !fJustCheck)) {
+    bool fWorkChecks = !fJustCheck;
+    if (fWorkChecks && block.IsProofOfWork() && !block.fChecked && !HasVerifiedWork(pindex) &&
+        IsAssumedValidWork(pindex, chainparams.GetConsensus())) {
+        // Verium: the scrypt proof of work of ancestors of the -assumevalidpow block is not
+        // recomputed, like script checks under -assumevalid below.
+        fWorkChecks = false;
+        nPoWChecksSkipped++;
+    }
+    uint256 hashWork;
+    if ((fWorkChecks && !CheckBlockWork(block, pindex, state, chainparams.GetConsensus(), hashWork)) ||
+        !CheckBlock(block, state, chainparams.GetConsensus(), false, !fJustCheck)) {
         if (state.GetResult() == BlockValidationResult::BLOCK_MUTATED) {
             // We don't write down blocks to disk if they may have been
             // corrupted, so this should be impossible unless we're having hardware
@@ -1680,6 +1875,7 @@ bool CChainState::ConnectBlock(const CBlock& block, BlockValidationState& state,
         }
         return error("%s: Consensus::CheckBlock: %s", __func__, state.ToString());
     }
+    RecordBlockWork(pindex, hashWork);
 
     // verify that the view's current state corresponds to the previous block
     uint256 hashPrevBlock = pindex->pprev == nullptr ? uint256() : pindex->pprev->GetBlockHash();
@@ -1871,7 +2067,7 @@ bool CChainState::ConnectBlock(const CBlock& block, BlockValidationState& state,
             // be in ConnectBlock because they require the UTXO set
             prevheights.resize(tx.vin.size());
             for (size_t j = 0; j < tx.vin.size(); j++) {
-                prevheights[j] = view.AccessCoin(tx.vin[j].prevout).nHeight;
+                prevheights[j] = view.AccessCoin(tx.vin[j].prevout).GetHeight();
             }
 
             if (!SequenceLocks(tx, nLockTimeFlags, &prevheights, *pindex)) {
@@ -2080,10 +2276,19 @@ bool CChainState::FlushStateToDisk(
                 return AbortNode(state, "Disk space is too low!", _("Error: Disk space is too low!").translated, CClientUIInterface::MSG_NOPREFIX);
             }
             // Flush the chainstate (which may refer to block index entries).
-            if (!CoinsTip().Flush())
+            // With -asyncflush, only forced flushes wait for it to be written,
+            // and the wallets only hear of the flush once it is on disk.
+            if (g_async_coins_flush && mode != FlushStateMode::ALWAYS) {
+                const CBlockLocator locator = m_chain.GetLocator();
+                auto on_written = [locator] { GetMainSignals().ChainStateFlushed(locator); };
+                if (!m_coins_views->m_flushview.WriteInBackground(CoinsTip().TakeBatch(), on_written))
+                    return AbortNode(state, "Failed to write to coin database");
+            } else if (!CoinsTip().Flush()) {
                 return AbortNode(state, "Failed to write to coin database");
+            } else {
+                full_flush_completed = true;
+            }
             nLastFlush = nNow;
-            full_flush_completed = true;
         }
     }
     if (full_flush_completed) {
@@ -2213,6 +2418,91 @@ static int64_t nTimeFlush = 0;
 static int64_t nTimeChainState = 0;
 static int64_t nTimePostConnect = 0;
 
+static int64_t nTimePrefetch = 0;
+static int64_t nTimePrefetchSaved = 0;
+static uint64_t nPrefetchInputs = 0;
+static uint64_t nPrefetchCached = 0;
+static uint64_t nPrefetchFound = 0;
+
+bool CCoinsFetch::operator()()
+{
+    const int64_t nTimeStart = GetTimeMicros();
+    try {
+        m_view->GetCoin(*m_outpoint, *m_coin);
+    } catch (const std::exception&) {
+        m_coin->Clear();
+    }
+    *m_read_time = GetTimeMicros() - nTimeStart;
+    return true;
+}
+
+/**
+ * Warm cache with the coins spent by block, before it is connected. The
+ * inputs missing from cache are read from db across the coins fetch threads,
+ * as LevelDB serves point reads concurrently, and added to cache on this
+ * thread once all of them are done. ConnectBlock() then finds its inputs in
+ * memory instead of reading them from disk one after the other. Inputs
+ * spending outputs of the block itself are not looked up.
+ */
+static void PrefetchBlockInputs(const CBlock& block, CCoinsViewCache& cache, const CCoinsView& db)
+{
+    if (!g_parallel_script_checks)
+        return;
+
+    const int64_t nTimeStart = GetTimeMicros();
+    std::set<uint256> setBlockTxids;
+    for (const auto& tx : block.vtx)
+        setBlockTxids.insert(tx->GetHash());
+
+    unsigned int nInputs = 0;
+    std::vector<COutPoint> vOutpoints;
+    for (const auto& tx : block.vtx) {
+        if (tx->IsCoinBase())
+            continue;
+        for (const CTxIn& txin : tx->vin) {
+            nInputs++;
+            if (!setBlockTxids.count(txin.prevout.hash) && !cache.HaveCoinInCache(txin.prevout))
+                vOutpoints.push_back(txin.prevout);
+        }
+    }
+    if (nInputs == 0)
+        return;
+
+    std::vector<Coin> vCoins(vOutpoints.size());
+    std::vector<int64_t> vReadTimes(vOutpoints.size());
+    if (!vOutpoints.empty()) {
+        std::vector<CCoinsFetch> vFetches;
+        vFetches.reserve(vOutpoints.size());
+        for (size_t i = 0; i < vOutpoints.size(); i++)
+            vFetches.emplace_back(db, vOutpoints[i], vCoins[i], vReadTimes[i]);
+        CCheckQueueControl<CCoinsFetch> control(&coinsfetchqueue);
+        control.Add(vFetches);
+        control.Wait();
+    }
+    const int64_t nTimeReads = GetTimeMicros() - nTimeStart;
+
+    unsigned int nFound = 0;
+    int64_t nTimeSerial = 0;
+    for (size_t i = 0; i < vOutpoints.size(); i++) {
+        nTimeSerial += vReadTimes[i];
+        if (!vCoins[i].IsSpent())
+            nFound++;
+        cache.AddFetchedCoin(vOutpoints[i], std::move(vCoins[i]));
+    }
+
+    // What the reads would have cost ConnectBlock() one after the other
+    const int64_t nSaved = std::max<int64_t>(nTimeSerial - nTimeReads, 0);
+    const int64_t nTime = GetTimeMicros() - nTimeStart;
+    nTimePrefetch += nTime;
+    nTimePrefetchSaved += nSaved;
+    nPrefetchInputs += nInputs;
+    nPrefetchCached += nInputs - vOutpoints.size();
+    nPrefetchFound += nFound;
+    LogPrint(BCLog::BENCH, "  - Prefetch %u inputs: %u cached, %u read by %d threads, %u found: %.2fms, %.2fms saved [%.2fs, %.2fs saved, %.1f%% hit rate, %.1f%% without prefetch]\n",
+        nInputs, nInputs - (unsigned int)vOutpoints.size(), (unsigned int)vOutpoints.size(), g_script_check_threads + 1, nFound, nTime * MILLI, nSaved * MILLI,
+        nTimePrefetch * MICRO, nTimePrefetchSaved * MICRO, 100.0 * (nPrefetchCached + nPrefetchFound) / nPrefetchInputs, 100.0 * nPrefetchCached / nPrefetchInputs);
+}
+
 struct PerBlockConnectTrace {
     CBlockIndex* pindex = nullptr;
     std::shared_ptr<const CBlock> pblock;
@@ -2266,10 +2556,9 @@ bool CChainState::ConnectTip(BlockValidationState& state, const CChainParams& ch
     int64_t nTime1 = GetTimeMicros();
     std::shared_ptr<const CBlock> pthisBlock;
     if (!pblock) {
-        std::shared_ptr<CBlock> pblockNew = std::make_shared<CBlock>();
-        if (!ReadBlockFromDisk(*pblockNew, pindexNew, chainparams.GetConsensus()))
+        pthisBlock = ReadCachedBlock(pindexNew, chainparams.GetConsensus());
+        if (!pthisBlock)
             return AbortNode(state, "Failed to read block");
-        pthisBlock = pblockNew;
     } else {
         pthisBlock = pblock;
     }
@@ -2278,6 +2567,8 @@ bool CChainState::ConnectTip(BlockValidationState& state, const CChainParams& ch
     int64_t nTime2 = GetTimeMicros(); nTimeReadFromDisk += nTime2 - nTime1;
     int64_t nTime3;
     LogPrint(BCLog::BENCH, "  - Load block from disk: %.2fms [%.2fs]\n", (nTime2 - nTime1) * MILLI, nTimeReadFromDisk * MICRO);
+    PrefetchBlockInputs(blockConnecting, CoinsTip(), m_coins_views->m_flushview);
+    nTime2 = GetTimeMicros();
     {
         CCoinsViewCache view(&CoinsTip());
         bool rv = ConnectBlock(blockConnecting, state, pindexNew, view, chainparams);
@@ -2306,6 +2597,7 @@ bool CChainState::ConnectTip(BlockValidationState& state, const CChainParams& ch
     // Update m_chain & related variables.
     m_chain.SetTip(pindexNew);
     UpdateTip(pindexNew, chainparams);
+    g_block_cache.Insert(pindexNew->GetBlockHash(), pthisBlock);
 
     int64_t nTime6 = GetTimeMicros(); nTimePostConnect += nTime6 - nTime5; nTimeTotal += nTime6 - nTime1;
     LogPrint(BCLog::BENCH, "  - Connect postprocess: %.2fms [%.2fs (%.2fms/blk)]\n", (nTime6 - nTime5) * MILLI, nTimePostConnect * MICRO, nTimePostConnect * MILLI / nBlocksTotal);
@@ -2852,6 +3144,8 @@ CBlockIndex* BlockManager::AddToBlockIndex(const CBlockHeader& block)
     pindexNew->nTimeMax = (pindexNew->pprev ? std::max(pindexNew->pprev->nTimeMax, pindexNew->nTime) : pindexNew->nTime);
     if (block.nFlags & CBlockIndex::BLOCK_PROOF_OF_STAKE)
         pindexNew->SetProofOfStake();
+    pindexNew->BuildLastBlockIndex();
+    UpdateStakeWeightStats(pindexNew);
     pindexNew->nChainTrust = (pindexNew->pprev ? pindexNew->pprev->nChainTrust : 0) + GetBlockTrust(*pindexNew);
     pindexNew->RaiseValidity(BLOCK_VALID_TREE);
     if (pindexBestHeader == nullptr || pindexBestHeader->nChainTrust < pindexNew->nChainTrust)
@@ -2976,20 +3270,107 @@ static bool FindUndoPos(BlockValidationState &state, int nFile, FlatFilePos &pos
 
 static bool CheckBlockHeader(const CBlockHeader& block, BlockValidationState& state, const Consensus::Params& consensusParams, bool fCheckPOW = true)
 {
-    /*
-     * Verium:
-     *
-     *   Header verification takes a long time due to having to compute scrypt hashes.
-     * This is a lengthy process, and so for this reason we skip it. This is acceptable
-     * since we're going to run a full validation of each and every block in the chain
-     * once the full data set is received.
-     *
-     */
+    // Check proof of work matches claimed amount.
+    // Verium: headers received from the network have their scrypt proof of work
+    // computed in batches by ProcessNewBlockHeaders() and skip this check.
+    if (fCheckPOW) {
+        uint256 hashWork;
+        if (!block.GetWorkHash(hashWork))
+            return state.Error("scrypt proof of work could not be computed");
+        if (!CheckProofOfWork(hashWork, block.nBits, consensusParams))
+            return state.Invalid(BlockValidationResult::BLOCK_INVALID_HEADER, "high-hash", "proof of work failed");
+    }
+
+    return true;
+}
+
+bool CHeaderPoWCheck::operator()()
+{
+    const size_t count = m_indices.size();
+    std::vector<unsigned char> input(count * CBlockHeader::NORMAL_SERIALIZE_SIZE);
+    std::vector<unsigned char> output(count * 32);
+
+    for (size_t i = 0; i < count; i++) {
+        const CBlockHeader& header = (*m_headers)[m_indices[i]];
+        memcpy(&input[i * CBlockHeader::NORMAL_SERIALIZE_SIZE], &header.nVersion, CBlockHeader::NORMAL_SERIALIZE_SIZE);
+    }
+    if (!scryptHashBatch(input.data(), (char*)output.data(), count)) {
+        *m_hash_failed = true;
+        return false;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        uint256& hash = (*m_work_hashes)[m_indices[i]];
+        memcpy(hash.begin(), &output[i * 32], 32);
+        if (m_check_target && !CheckProofOfWork(hash, (*m_headers)[m_indices[i]].nBits, *m_params))
+            return false;
+    }
+    return true;
+}
+
+/**
+ * Check the scrypt proof of work of the given headers across the header PoW
+ * worker threads, grouping them so each check fills the widest scrypt kernel.
+ * Stops early and returns false as soon as one header misses its target, or
+ * as an error when the headers could not be hashed for lack of memory. With
+ * check_target false every header is hashed and only the error can occur.
+ */
+static bool CheckHeadersProofOfWork(const std::vector<CBlockHeader>& headers, const std::vector<size_t>& to_check, std::vector<uint256>& work_hashes, const Consensus::Params& consensusParams, BlockValidationState& state, bool check_target = true)
+{
+    if (to_check.empty())
+        return true;
+
+    const size_t batch_size = ScryptBatchThroughput();
+    std::atomic<bool> hash_failed{false};
+    std::vector<CHeaderPoWCheck> checks;
+    for (size_t i = 0; i < to_check.size(); i += batch_size) {
+        std::vector<size_t> indices(to_check.begin() + i, to_check.begin() + std::min(i + batch_size, to_check.size()));
+        checks.emplace_back(headers, std::move(indices), work_hashes, consensusParams, hash_failed, check_target);
+    }
 
+    CCheckQueueControl<CHeaderPoWCheck> control(&headerpowcheckqueue);
+    control.Add(checks);
+    if (control.Wait())
+        return true;
+    if (hash_failed)
+        return state.Error("scrypt proof of work could not be computed");
+    return state.Invalid(BlockValidationResult::BLOCK_INVALID_HEADER, "high-hash", "proof of work failed");
+}
+
+bool CBlockTxCheck::operator()()
+{
+    if (!m_merkle_root) {
+        for (size_t i = m_begin; i < m_end; i++) {
+            const CTransaction& tx = *m_block->vtx[i];
+            if (*m_failed_tx < 0 && !CheckTransaction(tx, *m_state))
+                *m_failed_tx = (int)i;
+            *m_sigops += GetLegacySigOpCount(tx);
+        }
+    } else {
+        // As ComputeMerkleRoot() does it for the whole block. A short last
+        // run keeps duplicating its last hash up to the level of the others.
+        std::vector<uint256> hashes;
+        hashes.reserve(BLOCK_TX_CHECK_RUN_SIZE);
+        for (size_t i = m_begin; i < m_end; i++)
+            hashes.push_back(m_block->vtx[i]->GetHash());
+        bool mutation = false;
+        for (size_t width = 1; width < BLOCK_TX_CHECK_RUN_SIZE; width *= 2) {
+            for (size_t pos = 0; pos + 1 < hashes.size(); pos += 2) {
+                if (hashes[pos] == hashes[pos + 1]) mutation = true;
+            }
+            if (hashes.size() & 1) {
+                hashes.push_back(hashes.back());
+            }
+            SHA256D64(hashes[0].begin(), hashes[0].begin(), hashes.size() / 2);
+            hashes.resize(hashes.size() / 2);
+        }
+        *m_merkle_root = hashes[0];
+        *m_mutated = mutation;
+    }
     return true;
 }
 
-bool CheckBlock(const CBlock& block, BlockValidationState& state, const Consensus::Params& consensusParams, bool fCheckPOW, bool fCheckMerkleRoot, bool fCheckSignature)
+bool CheckBlock(const CBlock& block, BlockValidationState& state, const Consensus::Params& consensusParams, bool fCheckPOW, bool fCheckMerkleRoot)
 {
     // These are checks that are independent of context.
 
@@ -3001,14 +3382,37 @@ bool CheckBlock(const CBlock& block, BlockValidationState& state, const Consensu
     if (!CheckBlockHeader(block, state, consensusParams, fCheckPOW && !block.IsProofOfStake()))
         return false;
 
-    // Check proof of work matches claimed amount
-    if (fCheckPOW && !block.IsProofOfStake() && !CheckProofOfWork(block.GetWorkHash(), block.nBits, consensusParams))
-        return state.Invalid(BlockValidationResult::BLOCK_INVALID_HEADER, "high-hash", "proof of work failed");
+    // The merkle subtrees of the transactions are hashed, and then the
+    // transactions checked and their sigops counted, in runs on the block
+    // check threads when the block has more than one run. The results are
+    // still looked at in the order of the checks below, so the first failure
+    // reported is always the same.
+    const size_t nRuns = (block.vtx.size() + BLOCK_TX_CHECK_RUN_SIZE - 1) / BLOCK_TX_CHECK_RUN_SIZE;
+    const bool fParallelTxChecks = g_parallel_script_checks && nRuns > 1;
 
     // Check the merkle root.
     if (fCheckMerkleRoot) {
         bool mutated;
-        uint256 hashMerkleRoot2 = BlockMerkleRoot(block, &mutated);
+        uint256 hashMerkleRoot2;
+        if (fParallelTxChecks) {
+            std::vector<uint256> vRunMerkleRoots(nRuns);
+            std::unique_ptr<bool[]> vRunMutated(new bool[nRuns]());
+            std::vector<CBlockTxCheck> vMerkleChecks;
+            vMerkleChecks.reserve(nRuns);
+            for (size_t i = 0; i < nRuns; i++) {
+                vMerkleChecks.emplace_back(block, i * BLOCK_TX_CHECK_RUN_SIZE, std::min((i + 1) * BLOCK_TX_CHECK_RUN_SIZE, block.vtx.size()),
+                    vRunMerkleRoots[i], vRunMutated[i]);
+            }
+            CCheckQueueControl<CBlockTxCheck> control(&blockcheckqueue);
+            control.Add(vMerkleChecks);
+            control.Wait();
+
+            hashMerkleRoot2 = ComputeMerkleRoot(std::move(vRunMerkleRoots), &mutated);
+            for (size_t i = 0; i < nRuns; i++)
+                mutated |= vRunMutated[i];
+        } else {
+            hashMerkleRoot2 = BlockMerkleRoot(block, &mutated);
+        }
         if (block.hashMerkleRoot != hashMerkleRoot2)
             return state.Invalid(BlockValidationResult::BLOCK_MUTATED, "bad-txnmrklroot", "hashMerkleRoot mismatch");
 
@@ -3055,9 +3459,27 @@ bool CheckBlock(const CBlock& block, BlockValidationState& state, const Consensu
 
     // Check transactions
     // Must check for duplicate inputs (see CVE-2018-17144)
-    for (const auto& tx : block.vtx) {
-        TxValidationState tx_state;
-        if (!CheckTransaction(*tx, tx_state)) {
+    std::vector<int> vFailedTx(nRuns, -1);
+    std::vector<TxValidationState> vTxStates(nRuns);
+    std::vector<unsigned int> vSigOps(nRuns, 0);
+    std::vector<CBlockTxCheck> vTxChecks;
+    vTxChecks.reserve(nRuns);
+    for (size_t i = 0; i < nRuns; i++) {
+        vTxChecks.emplace_back(block, i * BLOCK_TX_CHECK_RUN_SIZE, std::min((i + 1) * BLOCK_TX_CHECK_RUN_SIZE, block.vtx.size()),
+            vFailedTx[i], vTxStates[i], vSigOps[i]);
+    }
+    if (fParallelTxChecks) {
+        CCheckQueueControl<CBlockTxCheck> control(&blockcheckqueue);
+        control.Add(vTxChecks);
+        control.Wait();
+    } else {
+        for (CBlockTxCheck& check : vTxChecks)
+            check();
+    }
+    for (size_t i = 0; i < nRuns; i++) {
+        if (vFailedTx[i] >= 0) {
+            const CTransactionRef& tx = block.vtx[vFailedTx[i]];
+            const TxValidationState& tx_state = vTxStates[i];
             // CheckBlock() does context-free validation checks. The only
             // possible failures are consensus failures.
             assert(tx_state.GetResult() == TxValidationResult::TX_CONSENSUS);
@@ -3069,20 +3491,22 @@ bool CheckBlock(const CBlock& block, BlockValidationState& state, const Consensu
         }
     }
     unsigned int nSigOps = 0;
-    for (const auto& tx : block.vtx)
+    for (unsigned int nRunSigOps : vSigOps)
     {
-        nSigOps += GetLegacySigOpCount(*tx);
+        nSigOps += nRunSigOps;
     }
     if (nSigOps * WITNESS_SCALE_FACTOR > MAX_BLOCK_SIGOPS_COST)
         return state.Invalid(BlockValidationResult::BLOCK_CONSENSUS, "bad-blk-sigops", "out-of-bounds SigOpCount");
 
+    // ppcoin: check block signature. It is not covered by the block hash, so
+    // a bad one may be a corrupted copy of a valid block: report it as such,
+    // so that the block is neither marked invalid nor stored.
+    if (fCheckMerkleRoot && block.IsProofOfStake() && !CheckBlockSignature(block))
+        return state.Invalid(BlockValidationResult::BLOCK_MUTATED, "bad-blk-sign", strprintf("%s : bad block signature", __func__));
+
     if (fCheckPOW && fCheckMerkleRoot)
         block.fChecked = true;
 
-    // ppcoin: check block signature
-    if (fCheckMerkleRoot && fCheckSignature && block.IsProofOfStake() && !CheckBlockSignature(block))
-        return state.Invalid(BlockValidationResult::BLOCK_CONSENSUS, "bad-blk-sign", strprintf("%s : bad block signature", __func__));
-
     return true;
 }
 
@@ -3298,7 +3722,7 @@ static bool ContextualCheckBlock(const CBlock& block, BlockValidationState& stat
     return true;
 }
 
-bool BlockManager::AcceptBlockHeader(const CBlockHeader& block, BlockValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex)
+bool BlockManager::AcceptBlockHeader(const CBlockHeader& block, BlockValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex, bool fCheckPOW)
 {
     AssertLockHeld(cs_main);
     // Check for duplicate
@@ -3318,7 +3742,7 @@ bool BlockManager::AcceptBlockHeader(const CBlockHeader& block, BlockValidationS
             return true;
         }
 
-        if (!CheckBlockHeader(block, state, chainparams.GetConsensus(), !(block.nFlags & CBlockIndex::BLOCK_PROOF_OF_STAKE)))
+        if (!CheckBlockHeader(block, state, chainparams.GetConsensus(), fCheckPOW && !(block.nFlags & CBlockIndex::BLOCK_PROOF_OF_STAKE)))
             return error("%s: Consensus::CheckBlockHeader: %s, %s", __func__, hash.ToString(), state.ToString());
 
         // Get prev block index
@@ -3387,16 +3811,47 @@ bool BlockManager::AcceptBlockHeader(const CBlockHeader& block, BlockValidationS
 // Exposed wrapper for AcceptBlockHeader
 bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& headers, BlockValidationState& state, const CChainParams& chainparams, const CBlockIndex** ppindex)
 {
+    // Verium: hashing scrypt header by header under cs_main would stall sync,
+    // so check the proof of work of all new PoW headers up front, in parallel.
+    // A message with any invalid header is rejected as a whole: honest peers
+    // never send one, and it keeps the cost of a bad message to one batch.
+    std::vector<size_t> to_check;
+    std::vector<uint256> work_hashes(headers.size());
+    {
+        LOCK(cs_main);
+        // The headers of a message are connected, so the first new one decides
+        // whether the batch extends the best header chain below -assumevalidpow
+        bool fDeferWork = false;
+        bool fFirstNew = true;
+        for (size_t i = 0; i < headers.size(); i++) {
+            if (LookupBlockIndex(headers[i].GetHash()))
+                continue;
+            if (fFirstNew) {
+                fDeferWork = DeferHeaderWork(LookupBlockIndex(headers[i].hashPrevBlock));
+                fFirstNew = false;
+            }
+            if (fDeferWork || (headers[i].nFlags & CBlockIndex::BLOCK_PROOF_OF_STAKE))
+                continue;
+            to_check.push_back(i);
+        }
+    }
+    const bool fPoWChecked = CheckHeadersProofOfWork(headers, to_check, work_hashes, chainparams.GetConsensus(), state);
+    // Headers arrive in bursts, so give the scratchpads back between them
+    ScryptReleaseScratchpads();
+    if (!fPoWChecked)
+        return false;
+
     {
         LOCK(cs_main);
-        for (const CBlockHeader& header : headers) {
+        for (size_t i = 0; i < headers.size(); i++) {
             CBlockIndex *pindex = nullptr; // Use a temp pindex instead of ppindex to avoid a const_cast
-            bool accepted = g_blockman.AcceptBlockHeader(header, state, chainparams, &pindex);
+            bool accepted = g_blockman.AcceptBlockHeader(headers[i], state, chainparams, &pindex, false);
             ::ChainstateActive().CheckBlockIndex(chainparams.GetConsensus());
 
             if (!accepted) {
                 return false;
             }
+            RecordBlockWork(pindex, work_hashes[i]);
             if (ppindex) {
                 *ppindex = pindex;
             }
@@ -3440,7 +3895,9 @@ bool CChainState::AcceptBlock(const std::shared_ptr<const CBlock>& pblock, Block
     CBlockIndex *pindexDummy = nullptr;
     CBlockIndex *&pindex = ppindex ? *ppindex : pindexDummy;
 
-    bool accepted_header = m_blockman.AcceptBlockHeader(block, state, chainparams, &pindex);
+    // The proof of work of a full block is checked by CheckBlockWork(), which either
+    // already ran in ProcessNewBlock() or runs below before the block is stored.
+    bool accepted_header = m_blockman.AcceptBlockHeader(block, state, chainparams, &pindex, false);
     CheckBlockIndex(chainparams.GetConsensus());
 
     if (!accepted_header)
@@ -3479,7 +3936,11 @@ bool CChainState::AcceptBlock(const std::shared_ptr<const CBlock>& pblock, Block
         if (pindex->nChainTrust < nMinimumChainWork) return true;
     }
 
-    if (!CheckBlock(block, state, chainparams.GetConsensus()) ||
+    // A block whose header was only accepted just above is never an ancestor of
+    // a known block, so it is never taken as assumed valid here.
+    uint256 hashWork;
+    if ((!IsAssumedValidWork(pindex, chainparams.GetConsensus()) && !CheckBlockWork(block, pindex, state, chainparams.GetConsensus(), hashWork)) ||
+        !CheckBlock(block, state, chainparams.GetConsensus(), false) ||
         !ContextualCheckBlock(block, state, chainparams.GetConsensus(), pindex->pprev)) {
         if (state.IsInvalid() && state.GetResult() != BlockValidationResult::BLOCK_MUTATED) {
             pindex->nStatus |= BLOCK_FAILED_VALID;
@@ -3487,6 +3948,7 @@ bool CChainState::AcceptBlock(const std::shared_ptr<const CBlock>& pblock, Block
         }
         return error("%s: %s", __func__, state.ToString());
     }
+    RecordBlockWork(pindex, hashWork);
 
     // Header is valid/has work, merkle tree and segwit merkle tree are good...RELAY NOW
     // (but if it does not build on our best tip, let the SendMessages loop relay it)
@@ -3526,12 +3988,24 @@ bool ProcessNewBlock(const CChainParams& chainparams, const std::shared_ptr<cons
         LOCK(cs_main);
 
         // Ensure that CheckBlock() passes before calling AcceptBlock, as
-        // belt-and-suspenders.
-        bool ret = CheckBlock(*pblock, state, chainparams.GetConsensus());
+        // belt-and-suspenders. The scrypt work is skipped if it was already
+        // verified with the header, or if the block is known to be an
+        // ancestor of the -assumevalidpow block.
+        uint256 hashWork;
+        const CBlockIndex* pindexKnown = LookupBlockIndex(pblock->GetHash());
+        const bool fAssumedWork = pindexKnown && IsAssumedValidWork(pindexKnown, chainparams.GetConsensus());
+        bool ret = (fAssumedWork || CheckBlockWork(*pblock, pindexKnown, state, chainparams.GetConsensus(), hashWork)) &&
+                   CheckBlock(*pblock, state, chainparams.GetConsensus(), false);
         if (ret) {
+            // The proof of work skipped by CheckBlock() was covered just above,
+            // unless it is left to ConnectBlock()
+            if (!fAssumedWork)
+                pblock->fChecked = true;
             // Store to disk
             ret = ::ChainstateActive().AcceptBlock(pblock, state, chainparams, &pindex, fForceProcessing, nullptr, fNewBlock);
         }
+        if (ret)
+            RecordBlockWork(pindex, hashWork);
         if (ppindex)
             *ppindex = ret ? pindex : nullptr;
         if (!ret) {
@@ -3661,6 +4135,8 @@ bool BlockManager::LoadBlockIndex(
         CBlockIndex* pindex = item.second;
         pindex->nChainTrust = (pindex->pprev ? pindex->pprev->nChainTrust : 0) + GetBlockTrust(*pindex);
         pindex->nTimeMax = (pindex->pprev ? std::max(pindex->pprev->nTimeMax, pindex->nTime) : pindex->nTime);
+        pindex->BuildLastBlockIndex();
+        UpdateStakeWeightStats(pindex);
         // We can link the chain of blocks for which we've received transactions at some point.
         // Pruned nodes may have deleted the block.
         if (pindex->nTx > 0) {
@@ -3821,13 +4297,18 @@ bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview,
         if (pindex->nHeight <= ::ChainActive().Height()-nCheckDepth)
             break;
         CBlock block;
-        // check level 0: read from disk
+        // check level 0: read from disk, and check the recorded work hash against the target
         if (!ReadBlockFromDisk(block, pindex, chainparams.GetConsensus()))
             return error("VerifyDB(): *** ReadBlockFromDisk failed at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
+        if (HasVerifiedWork(pindex) && !CheckProofOfWork(pindex->hashWork, pindex->nBits, chainparams.GetConsensus()))
+            return error("VerifyDB(): *** found bad recorded work at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
         // check level 1: verify block validity
-        if (nCheckLevel >= 1 && !CheckBlock(block, state, chainparams.GetConsensus()))
+        uint256 hashWork;
+        if (nCheckLevel >= 1 && (!CheckBlockWork(block, pindex, state, chainparams.GetConsensus(), hashWork) ||
+                                 !CheckBlock(block, state, chainparams.GetConsensus(), false)))
             return error("%s: *** found bad block at %d, hash=%s (%s)\n", __func__,
                          pindex->nHeight, pindex->GetBlockHash().ToString(), state.ToString());
+        RecordBlockWork(pindex, hashWork);
         // check level 2: verify undo validity
         if (nCheckLevel >= 2 && pindex) {
             CBlockUndo undo;
@@ -3886,6 +4367,70 @@ bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview,
     return true;
 }
 
+void ThreadRecheckBlockWork()
+{
+    util::ThreadRename("powrecheck");
+
+    std::vector<CBlockIndex*> to_check;
+    {
+        LOCK(cs_main);
+        for (CBlockIndex* pindex = ::ChainActive().Genesis(); pindex; pindex = ::ChainActive().Next(pindex)) {
+            if (HasVerifiedWork(pindex))
+                to_check.push_back(pindex);
+        }
+    }
+    LogPrintf("Rechecking the recorded proof of work of %u blocks in the background\n", to_check.size());
+
+    const size_t batch_size = ScryptBatchThroughput();
+    std::vector<unsigned char> input, output;
+    int reportDone = 0;
+    size_t mismatches = 0;
+    for (size_t i = 0; i < to_check.size(); i += batch_size) {
+        boost::this_thread::interruption_point();
+        if (ShutdownRequested())
+            return;
+
+        const size_t count = std::min(batch_size, to_check.size() - i);
+        input.resize(count * CBlockHeader::NORMAL_SERIALIZE_SIZE);
+        output.resize(count * 32);
+        {
+            LOCK(cs_main);
+            for (size_t k = 0; k < count; k++) {
+                const CBlockHeader header = to_check[i + k]->GetBlockHeader();
+                memcpy(&input[k * CBlockHeader::NORMAL_SERIALIZE_SIZE], &header.nVersion, CBlockHeader::NORMAL_SERIALIZE_SIZE);
+            }
+        }
+        // Hash outside cs_main, this takes about a second per lane
+        if (!scryptHashBatch(input.data(), (char*)output.data(), count)) {
+            LogPrintf("ERROR: %s: out of memory for scrypt, stopping the recheck\n", __func__);
+            return;
+        }
+        {
+            LOCK(cs_main);
+            for (size_t k = 0; k < count; k++) {
+                CBlockIndex* pindex = to_check[i + k];
+                if (memcmp(pindex->hashWork.begin(), &output[k * 32], 32) == 0)
+                    continue;
+                // Forget the bad hash so the block's work is recomputed the next time it is checked
+                LogPrintf("ERROR: %s: recorded work hash mismatch at %d, hash=%s\n", __func__, pindex->nHeight, pindex->GetBlockHash().ToString());
+                pindex->hashWork.SetNull();
+                pindex->nStatus &= ~BLOCK_POW_VERIFIED;
+                setDirtyBlockIndex.insert(pindex);
+                mismatches++;
+            }
+        }
+
+        const int percentageDone = (int)((i + count) * 100 / to_check.size());
+        if (reportDone < percentageDone / 10) {
+            // report every 10% step
+            LogPrintf("Proof of work recheck: %d%% done\n", percentageDone);
+            reportDone = percentageDone / 10;
+        }
+    }
+    ScryptReleaseScratchpads();
+    LogPrintf("Proof of work recheck finished, %u mismatches\n", mismatches);
+}
+
 /** Apply the effects of a block on the utxo cache, ignoring that it may already have been applied. */
 bool CChainState::RollforwardBlock(const CBlockIndex* pindex, CCoinsViewCache& inputs, const CChainParams& params)
 {
@@ -4191,123 +4736,274 @@ bool LoadGenesisBlock(const CChainParams& chainparams)
     return ::ChainstateActive().LoadGenesisBlock(chainparams);
 }
 
+/**
+ * Verium: a window of blocks read ahead by LoadExternalBlockFile(), each with the
+ * disk position it was read from.
+ */
+typedef std::vector<std::pair<std::shared_ptr<CBlock>, FlatFilePos>> BlockWindow;
+
+/**
+ * Verium: hash the scrypt proof of work of blocks read ahead by LoadExternalBlockFile()
+ * across the header PoW worker threads, and keep the results for CheckBlockWork(). A
+ * block missing its target keeps its hash too, and is rejected by the usual checks.
+ */
+static void PrecomputeBlockWork(const BlockWindow& blocks, const Consensus::Params& consensusParams)
+{
+    std::vector<CBlockHeader> headers;
+    {
+        LOCK(cs_main);
+        for (const auto& entry : blocks) {
+            const CBlock& block = *entry.first;
+            if (block.IsProofOfStake())
+                continue;
+            const CBlockIndex* pindex = LookupBlockIndex(block.GetHash());
+            if (pindex && (HasVerifiedWork(pindex) || (pindex->nStatus & BLOCK_HAVE_DATA) || IsAssumedValidWork(pindex, consensusParams)))
+                continue;
+            headers.push_back(block.GetBlockHeader());
+        }
+    }
+
+    std::vector<size_t> to_check(headers.size());
+    for (size_t i = 0; i < headers.size(); i++)
+        to_check[i] = i;
+    std::vector<uint256> work_hashes(headers.size());
+    BlockValidationState state;
+    if (!CheckHeadersProofOfWork(headers, to_check, work_hashes, consensusParams, state, false))
+        return;
+    for (size_t i = 0; i < headers.size(); i++)
+        g_work_hash_cache.Insert(headers[i].GetHash(), work_hashes[i]);
+}
+
+/**
+ * Verium: hands windows of blocks from one stage of LoadExternalBlockFile() to the
+ * next. Bounded, so reading never runs more than a few windows ahead of processing.
+ */
+class CBlockWindowQueue
+{
+private:
+    static constexpr size_t MAX_WINDOWS = 2;
+
+    Mutex m_mutex;
+    std::condition_variable m_cv;
+    std::deque<BlockWindow> m_windows GUARDED_BY(m_mutex);
+    bool m_closed GUARDED_BY(m_mutex){false};
+
+public:
+    /** Queue a window once there is room, returns false if the queue was closed. */
+    bool Push(BlockWindow window) LOCKS_EXCLUDED(m_mutex)
+    {
+        WAIT_LOCK(m_mutex, lock);
+        m_cv.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_mutex) { return m_closed || m_windows.size() < MAX_WINDOWS; });
+        if (m_closed)
+            return false;
+        m_windows.push_back(std::move(window));
+        m_cv.notify_all();
+        return true;
+    }
+
+    /** Wait for the next window, returns false once the queue is closed and empty. */
+    bool Pop(BlockWindow& window) LOCKS_EXCLUDED(m_mutex)
+    {
+        WAIT_LOCK(m_mutex, lock);
+        m_cv.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_mutex) { return m_closed || !m_windows.empty(); });
+        if (m_windows.empty())
+            return false;
+        window = std::move(m_windows.front());
+        m_windows.pop_front();
+        m_cv.notify_all();
+        return true;
+    }
+
+    /** No more windows: the producer is done, or the consumer gives up. */
+    void Close() LOCKS_EXCLUDED(m_mutex)
+    {
+        LOCK(m_mutex);
+        m_closed = true;
+        m_cv.notify_all();
+    }
+};
+
 bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, FlatFilePos *dbp)
 {
     // Map of disk positions for blocks with unknown parent (only used for reindex)
     static std::multimap<uint256, FlatFilePos> mapBlocksUnknownParent;
     int64_t nStart = GetTimeMillis();
 
+    // Verium: blocks are read in windows large enough to keep every core busy
+    // hashing, see PrecomputeBlockWork(). One thread reads the windows and
+    // another hashes them while this one processes the ones before.
+    const size_t nLookAhead = std::max(GetNumCores(), 1) * ScryptBatchThroughput();
+    // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor,
+    // which must only run once the reader is joined
+    CBufferedFile blkdat(fileIn, 2*MAX_BLOCK_SERIALIZED_SIZE, MAX_BLOCK_SERIALIZED_SIZE+8, SER_DISK, CLIENT_VERSION);
+    CBlockWindowQueue read_windows;
+    CBlockWindowQueue hashed_windows;
+    std::thread reader;
+    std::thread hasher;
+    // Stop and join the other stages however this thread leaves
+    auto stop_pipeline = [&] {
+        read_windows.Close();
+        hashed_windows.Close();
+        if (reader.joinable()) reader.join();
+        if (hasher.joinable()) hasher.join();
+    };
+
     int nLoaded = 0;
     try {
-        // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
-        CBufferedFile blkdat(fileIn, 2*MAX_BLOCK_SERIALIZED_SIZE, MAX_BLOCK_SERIALIZED_SIZE+8, SER_DISK, CLIENT_VERSION);
-        uint64_t nRewind = blkdat.GetPos();
-        while (!blkdat.eof()) {
-            boost::this_thread::interruption_point();
-
-            blkdat.SetPos(nRewind);
-            nRewind++; // start one byte further next time, in case of failure
-            blkdat.SetLimit(); // remove former limit
-            unsigned int nSize = 0;
+        reader = std::thread([&] {
+            util::ThreadRename("loadblk-read");
+            FlatFilePos pos = dbp ? *dbp : FlatFilePos();
             try {
-                // locate a header
-                unsigned char buf[CMessageHeader::MESSAGE_START_SIZE];
-                blkdat.FindByte(chainparams.MessageStart()[0]);
-                nRewind = blkdat.GetPos()+1;
-                blkdat >> buf;
-                if (memcmp(buf, chainparams.MessageStart(), CMessageHeader::MESSAGE_START_SIZE))
-                    continue;
-                // read size
-                blkdat >> nSize;
-                if (nSize < 80 || nSize > MAX_BLOCK_SERIALIZED_SIZE)
-                    continue;
-            } catch (const std::exception&) {
-                // no valid block header found; don't complain
-                break;
-            }
-            try {
-                // read block
-                uint64_t nBlockPos = blkdat.GetPos();
-                if (dbp)
-                    dbp->nPos = nBlockPos;
-                blkdat.SetLimit(nBlockPos + nSize);
-                blkdat.SetPos(nBlockPos);
-                std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
-                CBlock& block = *pblock;
-                blkdat >> block;
-                nRewind = blkdat.GetPos();
-
-                uint256 hash = block.GetHash();
-                {
-                    LOCK(cs_main);
-                    // detect out of order blocks, and store them for later
-                    if (hash != chainparams.GetConsensus().hashGenesisBlock && !LookupBlockIndex(block.hashPrevBlock)) {
-                        LogPrint(BCLog::REINDEX, "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
-                                block.hashPrevBlock.ToString());
-                        if (dbp)
-                            mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, *dbp));
-                        continue;
+                uint64_t nRewind = blkdat.GetPos();
+                bool fEnd = false;
+                while (!blkdat.eof() && !fEnd) {
+                    // Read a window of blocks along with their disk positions
+                    BlockWindow blocks;
+                    while (!blkdat.eof() && blocks.size() < nLookAhead) {
+                        blkdat.SetPos(nRewind);
+                        nRewind++; // start one byte further next time, in case of failure
+                        blkdat.SetLimit(); // remove former limit
+                        unsigned int nSize = 0;
+                        try {
+                            // locate a header
+                            unsigned char buf[CMessageHeader::MESSAGE_START_SIZE];
+                            blkdat.FindByte(chainparams.MessageStart()[0]);
+                            nRewind = blkdat.GetPos()+1;
+                            blkdat >> buf;
+                            if (memcmp(buf, chainparams.MessageStart(), CMessageHeader::MESSAGE_START_SIZE))
+                                continue;
+                            // read size
+                            blkdat >> nSize;
+                            if (nSize < 80 || nSize > MAX_BLOCK_SERIALIZED_SIZE)
+                                continue;
+                        } catch (const std::exception&) {
+                            // no valid block header found; don't complain
+                            fEnd = true;
+                            break;
+                        }
+                        try {
+                            // read block
+                            uint64_t nBlockPos = blkdat.GetPos();
+                            pos.nPos = nBlockPos;
+                            blkdat.SetLimit(nBlockPos + nSize);
+                            blkdat.SetPos(nBlockPos);
+                            std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+                            blkdat >> *pblock;
+                            nRewind = blkdat.GetPos();
+                            blocks.emplace_back(pblock, pos);
+                        } catch (const std::exception& e) {
+                            LogPrintf("LoadExternalBlockFile: Deserialize or I/O error - %s\n", e.what());
+                        }
                     }
+                    if (!read_windows.Push(std::move(blocks)))
+                        break;
+                }
+            } catch (const std::runtime_error& e) {
+                AbortNode(std::string("System error: ") + e.what());
+            }
+            read_windows.Close();
+        });
+        hasher = std::thread([&] {
+            util::ThreadRename("loadblk-hash");
+            BlockWindow blocks;
+            while (read_windows.Pop(blocks)) {
+                PrecomputeBlockWork(blocks, chainparams.GetConsensus());
+                if (!hashed_windows.Push(std::move(blocks)))
+                    break;
+            }
+            hashed_windows.Close();
+            read_windows.Close();
+        });
+
+        bool fAbort = false;
+        BlockWindow blocks;
+        while (!fAbort && hashed_windows.Pop(blocks)) {
+            for (auto& entry : blocks) {
+                boost::this_thread::interruption_point();
+
+                std::shared_ptr<CBlock>& pblock = entry.first;
+                FlatFilePos* pos = dbp ? &entry.second : nullptr;
+                const CBlock& block = *pblock;
+                try {
+                    uint256 hash = block.GetHash();
+                    {
+                        LOCK(cs_main);
+                        // detect out of order blocks, and store them for later
+                        if (hash != chainparams.GetConsensus().hashGenesisBlock && !LookupBlockIndex(block.hashPrevBlock)) {
+                            LogPrint(BCLog::REINDEX, "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
+                                    block.hashPrevBlock.ToString());
+                            if (pos)
+                                mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, *pos));
+                            continue;
+                        }
 
-                    // process in case the block isn't known yet
-                    CBlockIndex* pindex = LookupBlockIndex(hash);
-                    if (!pindex || (pindex->nStatus & BLOCK_HAVE_DATA) == 0) {
-                      BlockValidationState state;
-                      if (::ChainstateActive().AcceptBlock(pblock, state, chainparams, nullptr, true, dbp, nullptr)) {
-                          nLoaded++;
-                      }
-                      if (state.IsError()) {
-                          break;
-                      }
-                    } else if (hash != chainparams.GetConsensus().hashGenesisBlock && pindex->nHeight % 1000 == 0) {
-                      LogPrint(BCLog::REINDEX, "Block Import: already had block %s at height %d\n", hash.ToString(), pindex->nHeight);
+                        // process in case the block isn't known yet
+                        CBlockIndex* pindex = LookupBlockIndex(hash);
+                        if (!pindex || (pindex->nStatus & BLOCK_HAVE_DATA) == 0) {
+                          BlockValidationState state;
+                          if (::ChainstateActive().AcceptBlock(pblock, state, chainparams, nullptr, true, pos, nullptr)) {
+                              nLoaded++;
+                          }
+                          if (state.IsError()) {
+                              fAbort = true;
+                              break;
+                          }
+                        } else if (hash != chainparams.GetConsensus().hashGenesisBlock && pindex->nHeight % 1000 == 0) {
+                          LogPrint(BCLog::REINDEX, "Block Import: already had block %s at height %d\n", hash.ToString(), pindex->nHeight);
+                        }
                     }
-                }
 
-                // Activate the genesis block so normal node progress can continue
-                if (hash == chainparams.GetConsensus().hashGenesisBlock) {
-                    BlockValidationState state;
-                    if (!ActivateBestChain(state, chainparams)) {
-                        break;
+                    // Activate the genesis block so normal node progress can continue
+                    if (hash == chainparams.GetConsensus().hashGenesisBlock) {
+                        BlockValidationState state;
+                        if (!ActivateBestChain(state, chainparams)) {
+                            fAbort = true;
+                            break;
+                        }
                     }
-                }
 
-                NotifyHeaderTip();
-
-                // Recursively process earlier encountered successors of this block
-                std::deque<uint256> queue;
-                queue.push_back(hash);
-                while (!queue.empty()) {
-                    uint256 head = queue.front();
-                    queue.pop_front();
-                    std::pair<std::multimap<uint256, FlatFilePos>::iterator, std::multimap<uint256, FlatFilePos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
-                    while (range.first != range.second) {
-                        std::multimap<uint256, FlatFilePos>::iterator it = range.first;
-                        std::shared_ptr<CBlock> pblockrecursive = std::make_shared<CBlock>();
-                        if (ReadBlockFromDisk(*pblockrecursive, it->second, chainparams.GetConsensus()))
-                        {
-                            LogPrint(BCLog::REINDEX, "%s: Processing out of order child %s of %s\n", __func__, pblockrecursive->GetHash().ToString(),
-                                    head.ToString());
-                            LOCK(cs_main);
-                            BlockValidationState dummy;
-                            if (::ChainstateActive().AcceptBlock(pblockrecursive, dummy, chainparams, nullptr, true, &it->second, nullptr))
+                    NotifyHeaderTip();
+
+                    // Recursively process earlier encountered successors of this block
+                    std::deque<uint256> queue;
+                    queue.push_back(hash);
+                    while (!queue.empty()) {
+                        uint256 head = queue.front();
+                        queue.pop_front();
+                        std::pair<std::multimap<uint256, FlatFilePos>::iterator, std::multimap<uint256, FlatFilePos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
+                        while (range.first != range.second) {
+                            std::multimap<uint256, FlatFilePos>::iterator it = range.first;
+                            std::shared_ptr<CBlock> pblockrecursive = std::make_shared<CBlock>();
+                            if (ReadBlockFromDisk(*pblockrecursive, it->second, chainparams.GetConsensus()))
                             {
-                                nLoaded++;
-                                queue.push_back(pblockrecursive->GetHash());
+                                LogPrint(BCLog::REINDEX, "%s: Processing out of order child %s of %s\n", __func__, pblockrecursive->GetHash().ToString(),
+                                        head.ToString());
+                                LOCK(cs_main);
+                                BlockValidationState dummy;
+                                if (::ChainstateActive().AcceptBlock(pblockrecursive, dummy, chainparams, nullptr, true, &it->second, nullptr))
+                                {
+                                    nLoaded++;
+                                    queue.push_back(pblockrecursive->GetHash());
+                                }
                             }
+                            range.first++;
+                            mapBlocksUnknownParent.erase(it);
+                            NotifyHeaderTip();
                         }
-                        range.first++;
-                        mapBlocksUnknownParent.erase(it);
-                        NotifyHeaderTip();
                     }
+                } catch (const std::exception& e) {
+                    LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
                 }
-            } catch (const std::exception& e) {
-                LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
             }
         }
     } catch (const std::runtime_error& e) {
         AbortNode(std::string("System error: ") + e.what());
+    } catch (...) {
+        stop_pipeline();
+        throw;
     }
+    stop_pipeline();
+    ScryptReleaseScratchpads();
     if (nLoaded > 0)
         LogPrintf("Loaded %i blocks from external file in %dms\n", nLoaded, GetTimeMillis() - nStart);
     return nLoaded > 0;
@@ -141,6 +141,10 @@ static const unsigned int MAX_BLOCKS_TO_ANNOUNCE = 8;
 /** Maximum number of unconnecting headers announcements before DoS score */
 static const int MAX_UNCONNECTING_HEADERS = 10;
 
+/** Default for -asyncflush */
+static const bool DEFAULT_ASYNC_FLUSH = false;
+/** Default for -recheckpow */
+static const bool DEFAULT_RECHECK_POW = false;
 /** Default for -stopatheight */
 static const int DEFAULT_STOPATHEIGHT = 0;
 
@@ -166,6 +170,10 @@ extern std::atomic_bool fReindex;
  * False indicates all script checking is done on the main threadMessageHandler thread.
  */
 extern bool g_parallel_script_checks;
+/** Whether to write flushes of the coins cache on a background thread (-asyncflush) */
+extern bool g_async_coins_flush;
+/** Number of additional script verification threads started for -par */
+extern int g_script_check_threads;
 extern bool fRequireStandard;
 extern bool fCheckBlockIndex;
 extern bool fCheckpointsEnabled;
@@ -179,6 +187,12 @@ extern int64_t nMaxTipAge;
 /** Block hash whose ancestors we will assume to have valid scripts without checking them. */
 extern uint256 hashAssumeValid;
 
+/** Block hash whose ancestors we will assume to have valid proof of work without hashing them. */
+extern uint256 hashAssumeValidPow;
+
+/** Number of proof of work checks skipped because of -assumevalidpow. */
+extern std::atomic<uint64_t> nPoWChecksSkipped;
+
 /** Minimum work we will assume exists on some valid chain. */
 extern arith_uint256 nMinimumChainWork;
 
@@ -261,6 +275,14 @@ bool LoadBlockIndex(const CChainParams& chainparams) EXCLUSIVE_LOCKS_REQUIRED(cs
 void UnloadBlockIndex();
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck(int worker_num);
+/** Run an instance of the header proof-of-work checking thread */
+void ThreadHeaderPoWCheck(int worker_num);
+/** Run an instance of the context-free block check thread */
+void ThreadBlockCheck(int worker_num);
+/** Run an instance of the coins fetch thread of the input prefetcher */
+void ThreadCoinsFetch(int worker_num);
+/** Recompute the work hashes recorded in the block index for the active chain and report mismatches */
+void ThreadRecheckBlockWork();
 void AlertNotify(const std::string& strMessage, bool fUpdateUI = true);
 /** Retrieve a transaction (from memory pool, or from disk, if possible) */
 bool GetTransaction(const uint256& hash, CTransactionRef& tx, const Consensus::Params& params, uint256& hashBlock, const CBlockIndex* const blockIndex = nullptr);
@@ -351,13 +373,130 @@ public:
     ScriptError GetScriptError() const { return error; }
 };
 
+/**
+ * Closure representing the scrypt proof-of-work check of a run of block headers.
+ * The headers are hashed together with the multi-way scrypt kernels, and the
+ * work hash of each one is stored in work_hashes at the same index.
+ */
+class CHeaderPoWCheck
+{
+private:
+    const std::vector<CBlockHeader>* m_headers;
+    std::vector<size_t> m_indices;
+    std::vector<uint256>* m_work_hashes;
+    const Consensus::Params* m_params;
+    //! Set when the headers could not be hashed at all, for lack of memory
+    std::atomic<bool>* m_hash_failed;
+    //! Whether a header missing its target fails the check, or only gets its hash computed
+    bool m_check_target;
+
+public:
+    CHeaderPoWCheck(): m_headers(nullptr), m_work_hashes(nullptr), m_params(nullptr), m_hash_failed(nullptr), m_check_target(true) {}
+    CHeaderPoWCheck(const std::vector<CBlockHeader>& headers, std::vector<size_t> indices, std::vector<uint256>& work_hashes, const Consensus::Params& params, std::atomic<bool>& hash_failed, bool check_target) :
+        m_headers(&headers), m_indices(std::move(indices)), m_work_hashes(&work_hashes), m_params(&params), m_hash_failed(&hash_failed), m_check_target(check_target) { }
+
+    bool operator()();
+
+    void swap(CHeaderPoWCheck &check) {
+        std::swap(m_headers, check.m_headers);
+        std::swap(m_indices, check.m_indices);
+        std::swap(m_work_hashes, check.m_work_hashes);
+        std::swap(m_params, check.m_params);
+        std::swap(m_hash_failed, check.m_hash_failed);
+        std::swap(m_check_target, check.m_check_target);
+    }
+};
+
+/**
+ * Closure running the context-free checks of a run of transactions of a block
+ * for CheckBlock(): CheckTransaction() on each, up to the first one that
+ * fails, whose index and state are stored, and the sum of their legacy sigop
+ * counts. It always returns true, so that every run is checked and the first
+ * failure in block order is the one reported, whichever thread got to it.
+ *
+ * Built with merkle_root instead, it only hashes the run up to its node of the
+ * block's merkle tree, at the level where every run is one node, and records
+ * whether a level repeated a hash (CVE-2012-2459) on the way. CheckBlock()
+ * does that first, so no transaction is checked before the block is known to
+ * match its header.
+ */
+class CBlockTxCheck
+{
+private:
+    const CBlock* m_block;
+    size_t m_begin;
+    size_t m_end;
+    int* m_failed_tx;
+    TxValidationState* m_state;
+    unsigned int* m_sigops;
+    uint256* m_merkle_root;
+    bool* m_mutated;
+
+public:
+    CBlockTxCheck(): m_block(nullptr), m_begin(0), m_end(0), m_failed_tx(nullptr), m_state(nullptr), m_sigops(nullptr), m_merkle_root(nullptr), m_mutated(nullptr) {}
+    CBlockTxCheck(const CBlock& block, size_t begin, size_t end, int& failed_tx, TxValidationState& state, unsigned int& sigops) :
+        m_block(&block), m_begin(begin), m_end(end), m_failed_tx(&failed_tx), m_state(&state), m_sigops(&sigops), m_merkle_root(nullptr), m_mutated(nullptr) { }
+    CBlockTxCheck(const CBlock& block, size_t begin, size_t end, uint256& merkle_root, bool& mutated) :
+        m_block(&block), m_begin(begin), m_end(end), m_failed_tx(nullptr), m_state(nullptr), m_sigops(nullptr), m_merkle_root(&merkle_root), m_mutated(&mutated) { }
+
+    bool operator()();
+
+    void swap(CBlockTxCheck &check) {
+        std::swap(m_block, check.m_block);
+        std::swap(m_begin, check.m_begin);
+        std::swap(m_end, check.m_end);
+        std::swap(m_failed_tx, check.m_failed_tx);
+        std::swap(m_state, check.m_state);
+        std::swap(m_sigops, check.m_sigops);
+        std::swap(m_merkle_root, check.m_merkle_root);
+        std::swap(m_mutated, check.m_mutated);
+    }
+};
+
+/**
+ * Closure reading the coin of one block input from the coins database, for
+ * the input prefetcher. Reads run on the coins fetch threads, which must not
+ * touch the coins caches; the coin is added to the cache by the caller once
+ * all reads are done. A failed read only leaves the coin spent, so that
+ * ConnectBlock() reads it again and reports the error.
+ */
+class CCoinsFetch
+{
+private:
+    const CCoinsView* m_view;
+    const COutPoint* m_outpoint;
+    Coin* m_coin;
+    int64_t* m_read_time;
+
+public:
+    CCoinsFetch(): m_view(nullptr), m_outpoint(nullptr), m_coin(nullptr), m_read_time(nullptr) {}
+    CCoinsFetch(const CCoinsView& view, const COutPoint& outpoint, Coin& coin, int64_t& read_time) :
+        m_view(&view), m_outpoint(&outpoint), m_coin(&coin), m_read_time(&read_time) { }
+
+    bool operator()();
+
+    void swap(CCoinsFetch &check) {
+        std::swap(m_view, check.m_view);
+        std::swap(m_outpoint, check.m_outpoint);
+        std::swap(m_coin, check.m_coin);
+        std::swap(m_read_time, check.m_read_time);
+    }
+};
+
 /** Initializes the script-execution cache */
 void InitScriptExecutionCache();
 
 
 /** Functions for disk access for blocks */
 bool ReadBlockFromDisk(CBlock& block, const FlatFilePos& pos, const Consensus::Params& consensusParams);
+/**
+ * Read a block, from the block cache if it is there, without adding it to the
+ * cache. For readers that go through many blocks once, like index sync, wallet
+ * rescans and VerifyDB, so that they do not evict the blocks peers ask for.
+ */
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams);
+/** Read a block through the block cache, sharing it with the other readers. Returns nullptr on failure. */
+std::shared_ptr<const CBlock> ReadCachedBlock(const CBlockIndex* pindex, const Consensus::Params& consensusParams);
 bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const FlatFilePos& pos, const CMessageHeader::MessageStartChars& message_start);
 bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& message_start);
 
@@ -365,7 +504,11 @@ bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex* pindex);
 
 /** Functions for validating blocks and updating the block tree */
 
-/** Context-independent validity checks */
+/**
+ * Context-independent validity checks. With fCheckMerkleRoot, this includes
+ * the signature of a proof-of-stake block, which is not covered by its hash:
+ * a bad one is reported as BLOCK_MUTATED.
+ */
 bool CheckBlock(const CBlock& block, BlockValidationState& state, const Consensus::Params& consensusParams, bool fCheckPOW = true, bool fCheckMerkleRoot = true);
 
 /** Check a block is completely valid from start to finish (only works on top of our current best block) */
@@ -488,7 +631,8 @@ public:
         const CBlockHeader& block,
         BlockValidationState& state,
         const CChainParams& chainparams,
-        CBlockIndex** ppindex) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+        CBlockIndex** ppindex,
+        bool fCheckPOW = true) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 };
 
 /**
@@ -507,6 +651,10 @@ public:
     //! All unspent coins reside in this store.
     CCoinsViewDB m_dbview GUARDED_BY(cs_main);
 
+    //! This view writes flushes of the cache to m_dbview on a background thread with
+    //! -asyncflush, and answers reads from what it has not written yet.
+    CCoinsViewBackgroundFlush m_flushview GUARDED_BY(cs_main);
+
     //! This view wraps access to the leveldb instance and handles read errors gracefully.
     CCoinsViewErrorCatcher m_catcherview GUARDED_BY(cs_main);
 
@@ -514,7 +662,7 @@ public:
     //! can fit per the dbcache setting.
     std::unique_ptr<CCoinsViewCache> m_cacheview GUARDED_BY(cs_main);
 
-    //! This constructor initializes CCoinsViewDB and CCoinsViewErrorCatcher instances, but it
+    //! This constructor initializes CCoinsViewDB, CCoinsViewBackgroundFlush and CCoinsViewErrorCatcher instances, but it
     //! *does not* create a CCoinsViewCache instance by default. This is done separately because the
     //! presence of the cache has implications on whether or not we're allowed to flush the cache's
     //! state to disk, which should not be done until the health of the database is verified.
@@ -630,7 +778,8 @@ public:
         return *m_coins_views->m_cacheview.get();
     }
 
-    //! @returns A reference to the on-disk UTXO set database.
+    //! @returns A reference to the on-disk UTXO set database. With -asyncflush it
+    //!     is only up to date after ForceFlushStateToDisk().
     CCoinsViewDB& CoinsDB() EXCLUSIVE_LOCKS_REQUIRED(cs_main)
     {
         return m_coins_views->m_dbview;
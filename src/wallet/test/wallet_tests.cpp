@@ -4,6 +4,8 @@
 
 #include <wallet/wallet.h>
 
+#include <algorithm>
+#include <limits>
 #include <memory>
 #include <stdint.h>
 #include <vector>
@@ -574,6 +576,45 @@ BOOST_FIXTURE_TEST_CASE(ListCoins, ListCoinsTestingSetup)
     BOOST_CHECK_EQUAL(list.begin()->second.size(), 2U);
 }
 
+static bool HasStakeableOutput(const std::vector<CStakeableOutput>& outputs, const COutPoint& prevout)
+{
+    return std::any_of(outputs.begin(), outputs.end(), [&](const CStakeableOutput& out) { return out.prevout == prevout; });
+}
+
+BOOST_FIXTURE_TEST_CASE(stakeable_outputs, ListCoinsTestingSetup)
+{
+    const int64_t nStakeMinAge = Params().GetConsensus().nStakeMinAge;
+    const int64_t nTimeMax = std::numeric_limits<int64_t>::max();
+
+    // Every coinbase the rescan found, mature or not, paying to coinbaseKey
+    std::vector<CStakeableOutput> outputs = wallet->GetStakeableOutputs(nTimeMax);
+    BOOST_CHECK_EQUAL(outputs.size(), WITH_LOCK(wallet->cs_wallet, return wallet->mapWallet.size()));
+    int64_t nTimeFirst = nTimeMax;
+    for (const CStakeableOutput& out : outputs) {
+        BOOST_CHECK(out.fCoinBase);
+        BOOST_CHECK(out.pubkey == coinbaseKey.GetPubKey());
+        BOOST_CHECK(WITH_LOCK(cs_main, return LookupBlockIndex(out.hashBlock)) != nullptr);
+        nTimeFirst = std::min<int64_t>(nTimeFirst, out.nTime);
+    }
+
+    // Only the ones old enough at the time asked for
+    BOOST_CHECK(wallet->GetStakeableOutputs(nTimeFirst + nStakeMinAge - 1).empty());
+    BOOST_CHECK(!wallet->GetStakeableOutputs(nTimeFirst + nStakeMinAge).empty());
+
+    // Locking a coin takes it out, unlocking puts it back
+    const COutPoint prevout = outputs.front().prevout;
+    WITH_LOCK(wallet->cs_wallet, wallet->LockCoin(prevout));
+    BOOST_CHECK(!HasStakeableOutput(wallet->GetStakeableOutputs(nTimeMax), prevout));
+    BOOST_CHECK_EQUAL(wallet->GetStakeableOutputs(nTimeMax).size(), outputs.size() - 1);
+    WITH_LOCK(wallet->cs_wallet, wallet->UnlockAllCoins());
+    BOOST_CHECK(HasStakeableOutput(wallet->GetStakeableOutputs(nTimeMax), prevout));
+
+    // Spending a coin takes it out without a rescan
+    const CWalletTx& wtx = AddTx(CRecipient{GetScriptForRawPubKey({}), 1 * COIN, false /* subtract fee */});
+    BOOST_CHECK(!HasStakeableOutput(wallet->GetStakeableOutputs(nTimeMax), wtx.tx->vin[0].prevout));
+    BOOST_CHECK_EQUAL(wallet->GetStakeableOutputs(nTimeMax).size(), outputs.size() - wtx.tx->vin.size());
+}
+
 BOOST_FIXTURE_TEST_CASE(wallet_disableprivkeys, TestChain100Setup)
 {
     NodeContext node;
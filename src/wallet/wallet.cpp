@@ -6,6 +6,7 @@
 #include <wallet/wallet.h>
 
 #include <chain.h>
+#include <chainparams.h>
 #include <consensus/consensus.h>
 #include <consensus/validation.h>
 #include <fs.h>
@@ -854,6 +855,7 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFlushOnClose)
 
     // Break debit/credit balance caches:
     wtx.MarkDirty();
+    UpdateStakeableOutputs(*wtx.tx);
 
     // Notify UI of new or updated transaction
     NotifyTransactionChanged(this, hash, fInsertedNew ? CT_NEW : CT_UPDATED);
@@ -989,6 +991,63 @@ void CWallet::MarkInputsDirty(const CTransactionRef& tx)
     }
 }
 
+void CWallet::UpdateStakeableOutput(const CWalletTx& wtx, unsigned int n)
+{
+    AssertLockHeld(cs_wallet);
+    const COutPoint prevout(wtx.GetHash(), n);
+    const CTxOut& txout = wtx.tx->vout[n];
+
+    // The coinstake pays back to the key of the staked output, and the block is signed with it
+    CPubKey pubkey;
+    bool fStakeable = wtx.isConfirmed() && !IsSpent(prevout.hash, n) && !IsLockedCoin(prevout.hash, n) && (IsMine(txout) & ISMINE_SPENDABLE);
+    if (fStakeable) {
+        const LegacyScriptPubKeyMan* spk_man = GetLegacyScriptPubKeyMan();
+        std::vector<std::vector<unsigned char>> vSolutions;
+        const txnouttype type = Solver(txout.scriptPubKey, vSolutions);
+        if (type == TX_PUBKEY)
+            pubkey = CPubKey(vSolutions[0]);
+        else if (type != TX_PUBKEYHASH || !spk_man || !spk_man->GetPubKey(CKeyID(uint160(vSolutions[0])), pubkey))
+            fStakeable = false;
+        fStakeable = fStakeable && spk_man && spk_man->HaveKey(pubkey.GetID());
+    }
+
+    LOCK(cs_stakeable);
+    auto it = m_stakeable.find(prevout);
+    if (it != m_stakeable.end()) {
+        m_stakeable_by_time.erase(std::make_pair((int64_t)it->second.nTime + Params().GetConsensus().nStakeMinAge, prevout));
+        m_stakeable.erase(it);
+    }
+    if (fStakeable) {
+        m_stakeable.emplace(prevout, CStakeableOutput{prevout, txout.nValue, wtx.tx->nTime, wtx.m_confirm.hashBlock, wtx.m_confirm.block_height,
+            wtx.IsCoinBase() || wtx.IsCoinStake(), pubkey});
+        m_stakeable_by_time.emplace((int64_t)wtx.tx->nTime + Params().GetConsensus().nStakeMinAge, prevout);
+    }
+}
+
+void CWallet::UpdateStakeableOutputs(const CTransaction& tx)
+{
+    AssertLockHeld(cs_wallet);
+    auto it = mapWallet.find(tx.GetHash());
+    if (it != mapWallet.end()) {
+        for (unsigned int i = 0; i < tx.vout.size(); i++)
+            UpdateStakeableOutput(it->second, i);
+    }
+    for (const CTxIn& txin : tx.vin) {
+        auto it = mapWallet.find(txin.prevout.hash);
+        if (it != mapWallet.end() && txin.prevout.n < it->second.tx->vout.size())
+            UpdateStakeableOutput(it->second, txin.prevout.n);
+    }
+}
+
+std::vector<CStakeableOutput> CWallet::GetStakeableOutputs(int64_t nTime) const
+{
+    std::vector<CStakeableOutput> vOutputs;
+    LOCK(cs_stakeable);
+    for (auto it = m_stakeable_by_time.begin(); it != m_stakeable_by_time.end() && it->first <= nTime; it++)
+        vOutputs.push_back(m_stakeable.at(it->second));
+    return vOutputs;
+}
+
 bool CWallet::AbandonTransaction(const uint256& hashTx)
 {
     auto locked_chain = chain().lock(); // Temporary. Removed in upcoming lock cleanup
@@ -1038,6 +1097,7 @@ bool CWallet::AbandonTransaction(const uint256& hashTx)
             // If a transaction changes 'conflicted' state, that changes the balance
             // available of the outputs it spends. So force those to be recomputed
             MarkInputsDirty(wtx.tx);
+            UpdateStakeableOutputs(*wtx.tx);
         }
     }
 
@@ -1093,6 +1153,7 @@ void CWallet::MarkConflicted(const uint256& hashBlock, int conflicting_height, c
             // If a transaction changes 'conflicted' state, that changes the balance
             // available of the outputs it spends. So force those to be recomputed
             MarkInputsDirty(wtx.tx);
+            UpdateStakeableOutputs(*wtx.tx);
         }
     }
 }
@@ -3548,18 +3609,30 @@ void CWallet::LockCoin(const COutPoint& output)
 {
     AssertLockHeld(cs_wallet);
     setLockedCoins.insert(output);
+    auto it = mapWallet.find(output.hash);
+    if (it != mapWallet.end() && output.n < it->second.tx->vout.size())
+        UpdateStakeableOutput(it->second, output.n);
 }
 
 void CWallet::UnlockCoin(const COutPoint& output)
 {
     AssertLockHeld(cs_wallet);
     setLockedCoins.erase(output);
+    auto it = mapWallet.find(output.hash);
+    if (it != mapWallet.end() && output.n < it->second.tx->vout.size())
+        UpdateStakeableOutput(it->second, output.n);
 }
 
 void CWallet::UnlockAllCoins()
 {
     AssertLockHeld(cs_wallet);
-    setLockedCoins.clear();
+    std::set<COutPoint> setUnlocked;
+    setUnlocked.swap(setLockedCoins);
+    for (const COutPoint& output : setUnlocked) {
+        auto it = mapWallet.find(output.hash);
+        if (it != mapWallet.end() && output.n < it->second.tx->vout.size())
+            UpdateStakeableOutput(it->second, output.n);
+    }
 }
 
 bool CWallet::IsLockedCoin(uint256 hash, unsigned int n) const
@@ -4145,6 +4218,11 @@ void CWallet::postInitProcess()
 
     // Update wallet transactions with current mempool transactions.
     chain().requestMempoolTransactions(*this);
+
+    // Transactions loaded from disk skipped AddToWallet(), and their keys may
+    // have been loaded after them
+    for (const auto& entry : mapWallet)
+        UpdateStakeableOutputs(*entry.second.tx);
 }
 
 bool CWallet::BackupWallet(const std::string& strDest) const
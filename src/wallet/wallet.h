@@ -553,6 +553,22 @@ public:
     bool IsImmatureCoinBase() const;
 };
 
+/** An output of the wallet that can stake, see CWallet::GetStakeableOutputs() */
+struct CStakeableOutput
+{
+    COutPoint prevout;
+    CAmount nValue;
+    //! Time of the transaction that created the output
+    unsigned int nTime;
+    //! Block of that transaction
+    uint256 hashBlock;
+    int nHeight;
+    //! Whether the output is of a coinbase or coinstake, and so must mature first
+    bool fCoinBase;
+    //! The key the coinstake pays back to and the block is signed with
+    CPubKey pubkey;
+};
+
 class COutput
 {
 public:
@@ -679,6 +695,23 @@ private:
      * Should be called with non-zero block_hash and posInBlock if this is for a transaction that is included in a block. */
     void SyncTransaction(const CTransactionRef& tx, CWalletTx::Confirmation confirm, bool update_tx = true) EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
 
+    /**
+     * Outputs that can stake once they are old enough: confirmed, unspent,
+     * unlocked and paying to a key of the wallet. Kept up to date as
+     * transactions change, under a lock of their own so the staker never
+     * waits on cs_wallet. The outpoints are also ordered by the time they
+     * become old enough, nTime + nStakeMinAge.
+     */
+    mutable Mutex cs_stakeable;
+    std::map<COutPoint, CStakeableOutput> m_stakeable GUARDED_BY(cs_stakeable);
+    std::set<std::pair<int64_t, COutPoint>> m_stakeable_by_time GUARDED_BY(cs_stakeable);
+
+    /* Add output n of wtx to the stakeable outputs, or remove it from them */
+    void UpdateStakeableOutput(const CWalletTx& wtx, unsigned int n) EXCLUSIVE_LOCKS_REQUIRED(cs_wallet) LOCKS_EXCLUDED(cs_stakeable);
+
+    /* Update the stakeable outputs for the outputs of tx and the ones it spends */
+    void UpdateStakeableOutputs(const CTransaction& tx) EXCLUSIVE_LOCKS_REQUIRED(cs_wallet) LOCKS_EXCLUDED(cs_stakeable);
+
     std::atomic<uint64_t> m_wallet_flags{0};
 
     bool SetAddressBookWithDB(WalletBatch& batch, const CTxDestination& address, const std::string& strName, const std::string& strPurpose);
@@ -838,6 +871,13 @@ public:
     void UnlockAllCoins() EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
     void ListLockedCoins(std::vector<COutPoint>& vOutpts) const EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
 
+    /**
+     * The outputs that can stake at nTime as far as their age is concerned,
+     * without taking cs_wallet. Coinbase and coinstake outputs may still be
+     * immature, and the block of an output may be younger than its transaction.
+     */
+    std::vector<CStakeableOutput> GetStakeableOutputs(int64_t nTime) const LOCKS_EXCLUDED(cs_stakeable);
+
     /*
      * Rescan abort properties
      */
@@ -0,0 +1,501 @@
+// Copyright (c) 2020 The Vericonomy developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <workserver.h>
+
+#include <chain.h>
+#include <chainparams.h>
+#include <consensus/merkle.h>
+#include <crypto/common.h>
+#include <hash.h>
+#include <key_io.h>
+#include <miner.h>
+#include <netbase.h>
+#include <primitives/transaction.h>
+#include <streams.h>
+#include <timedata.h>
+#include <txmempool.h>
+#include <ui_interface.h>
+#include <univalue.h>
+#include <util/strencodings.h>
+#include <util/system.h>
+#include <util/translation.h>
+#include <validation.h>
+#include <validationinterface.h>
+#include <version.h>
+
+#include <algorithm>
+#include <thread>
+
+#include <event2/buffer.h>
+#include <event2/bufferevent.h>
+#include <event2/event.h>
+#include <event2/listener.h>
+#include <event2/thread.h>
+
+/** Stratum sends the previous block hash as eight 32-bit words with their bytes reversed */
+static std::string StratumHash(const uint256& hash)
+{
+    std::vector<unsigned char> bytes(hash.begin(), hash.end());
+    for (size_t i = 0; i < bytes.size(); i += 4)
+        std::reverse(bytes.begin() + i, bytes.begin() + i + 4);
+    return HexStr(bytes);
+}
+
+/** Parse the 8 hex digits of a big-endian 32-bit stratum field */
+static bool ParseStratumUInt32(const UniValue& value, uint32_t& result)
+{
+    if (!value.isStr() || value.get_str().size() != 8 || !IsHex(value.get_str()))
+        return false;
+    result = ReadBE32(ParseHex(value.get_str()).data());
+    return true;
+}
+
+/** Merkle branch of the coinbase, which does not depend on the coinbase itself */
+static std::vector<uint256> CoinbaseMerkleBranch(const CBlock& block)
+{
+    std::vector<uint256> branch;
+    std::vector<uint256> level;
+    for (const auto& tx : block.vtx)
+        level.push_back(tx->GetHash());
+    while (level.size() > 1) {
+        branch.push_back(level[1]);
+        if (level.size() & 1)
+            level.push_back(level.back());
+        std::vector<uint256> next;
+        for (size_t i = 0; i < level.size(); i += 2)
+            next.push_back(Hash(level[i].begin(), level[i].end(), level[i + 1].begin(), level[i + 1].end()));
+        level.swap(next);
+    }
+    return branch;
+}
+
+static CMutableTransaction MakeCoinbase(const CBlock& block, int nHeight, const CScript& scriptPubKey, const std::vector<unsigned char>& extranonce)
+{
+    CMutableTransaction tx(*block.vtx[0]);
+    tx.vin[0].scriptSig = CScript() << nHeight << extranonce;
+    tx.vout[0].scriptPubKey = scriptPubKey;
+    return tx;
+}
+
+static UniValue StratumError(int code, const std::string& message)
+{
+    UniValue error(UniValue::VARR);
+    error.push_back(code);
+    error.push_back(message);
+    error.push_back(NullUniValue);
+    return error;
+}
+
+WorkServer::WorkServer(SendFn send, SubmitFn submit) : m_send(send), m_submit(submit) {}
+
+void WorkServer::AddClient(int64_t client)
+{
+    m_clients[client].nExtraNonce1 = ++m_extranonce1_counter;
+}
+
+void WorkServer::RemoveClient(int64_t client)
+{
+    m_clients.erase(client);
+}
+
+void WorkServer::Reply(int64_t client, const UniValue& id, const UniValue& result, const UniValue& error)
+{
+    UniValue reply(UniValue::VOBJ);
+    reply.pushKV("id", id);
+    reply.pushKV("result", result);
+    reply.pushKV("error", error);
+    m_send(client, reply.write());
+}
+
+void WorkServer::SendJob(int64_t client, const Client& state, const Job& job, bool fClean)
+{
+    // Split the coinbase around a placeholder of the size of both extranonces
+    const std::vector<unsigned char> placeholder(WORKSERVER_EXTRANONCE1_SIZE + WORKSERVER_EXTRANONCE2_SIZE, 0);
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS);
+    ss << MakeCoinbase(job.block, job.nHeight, state.scriptPubKey, placeholder);
+    const std::vector<unsigned char> coinbase(ss.begin(), ss.end());
+    const CScript needle = CScript() << job.nHeight << placeholder;
+    auto it = std::search(coinbase.begin(), coinbase.end(), needle.begin(), needle.end());
+    assert(it != coinbase.end());
+    it += needle.size() - placeholder.size();
+
+    UniValue branch(UniValue::VARR);
+    for (const uint256& hash : job.vMerkleBranch)
+        branch.push_back(HexStr(hash.begin(), hash.end()));
+
+    UniValue target(UniValue::VOBJ);
+    target.pushKV("id", NullUniValue);
+    target.pushKV("method", "mining.set_target");
+    UniValue target_params(UniValue::VARR);
+    target_params.push_back(job.shareTarget.GetHex());
+    target.pushKV("params", target_params);
+    m_send(client, target.write());
+
+    UniValue params(UniValue::VARR);
+    params.push_back(job.id);
+    params.push_back(StratumHash(job.block.hashPrevBlock));
+    params.push_back(HexStr(coinbase.begin(), it));
+    params.push_back(HexStr(it + placeholder.size(), coinbase.end()));
+    params.push_back(branch);
+    params.push_back(strprintf("%08x", (uint32_t)job.block.nVersion));
+    params.push_back(strprintf("%08x", job.block.nBits));
+    params.push_back(strprintf("%08x", job.block.nTime));
+    params.push_back(UniValue(fClean));
+    UniValue notify(UniValue::VOBJ);
+    notify.pushKV("id", NullUniValue);
+    notify.pushKV("method", "mining.notify");
+    notify.pushKV("params", params);
+    m_send(client, notify.write());
+}
+
+void WorkServer::NewJob(const CBlock& block, int nHeight, bool fClean)
+{
+    if (fClean) {
+        m_jobs.clear();
+        for (auto& client : m_clients)
+            client.second.setSubmitted.clear();
+    }
+    while (m_jobs.size() >= MAX_WORKSERVER_JOBS)
+        m_jobs.pop_front();
+
+    Job job;
+    job.id = strprintf("%x", ++m_job_counter);
+    job.block = block;
+    job.nHeight = nHeight;
+    job.vMerkleBranch = CoinbaseMerkleBranch(block);
+    const arith_uint256 target = arith_uint256().SetCompact(block.nBits);
+    job.shareTarget = target << WORKSERVER_SHARE_SHIFT;
+    if ((job.shareTarget >> WORKSERVER_SHARE_SHIFT) != target)
+        job.shareTarget = ~arith_uint256();
+    m_jobs.push_back(std::move(job));
+
+    for (const auto& client : m_clients) {
+        if (client.second.fSubscribed && client.second.fAuthorized)
+            SendJob(client.first, client.second, m_jobs.back(), fClean);
+    }
+}
+
+bool WorkServer::ProcessLine(int64_t client, const std::string& line)
+{
+    auto it = m_clients.find(client);
+    if (it == m_clients.end())
+        return false;
+    Client& state = it->second;
+
+    UniValue request;
+    if (!request.read(line) || !request.isObject())
+        return false;
+    const UniValue& id = find_value(request, "id");
+    const UniValue& method = find_value(request, "method");
+    const UniValue& params = find_value(request, "params");
+    if (!method.isStr() || !(params.isNull() || params.isArray()))
+        return false;
+
+    if (method.get_str() == "mining.subscribe") {
+        const std::string extranonce1 = strprintf("%08x", state.nExtraNonce1);
+        UniValue subscription(UniValue::VARR);
+        subscription.push_back("mining.notify");
+        subscription.push_back(extranonce1);
+        UniValue subscriptions(UniValue::VARR);
+        subscriptions.push_back(subscription);
+        UniValue result(UniValue::VARR);
+        result.push_back(subscriptions);
+        result.push_back(extranonce1);
+        result.push_back(WORKSERVER_EXTRANONCE2_SIZE);
+        Reply(client, id, result, NullUniValue);
+        const bool fFirst = !state.fSubscribed;
+        state.fSubscribed = true;
+        if (fFirst && state.fAuthorized && !m_jobs.empty())
+            SendJob(client, state, m_jobs.back(), true);
+    } else if (method.get_str() == "mining.authorize") {
+        // The user name is the address to pay, optionally followed by a worker name
+        std::string user = params.size() > 0 && params[0].isStr() ? params[0].get_str() : "";
+        CTxDestination dest = DecodeDestination(user.substr(0, user.find('.')));
+        if (!IsValidDestination(dest)) {
+            Reply(client, id, false, StratumError(24, "User name must be an address to pay to"));
+            return true;
+        }
+        state.scriptPubKey = GetScriptForDestination(dest);
+        Reply(client, id, true, NullUniValue);
+        const bool fFirst = !state.fAuthorized;
+        state.fAuthorized = true;
+        if (fFirst && state.fSubscribed && !m_jobs.empty())
+            SendJob(client, state, m_jobs.back(), true);
+    } else if (method.get_str() == "mining.submit") {
+        if (!state.fSubscribed) {
+            Reply(client, id, false, StratumError(25, "Not subscribed"));
+        } else if (!state.fAuthorized) {
+            Reply(client, id, false, StratumError(24, "Unauthorized worker"));
+        } else {
+            const UniValue error = params.isArray() ? Submit(state, params) : StratumError(20, "Missing parameters");
+            Reply(client, id, error.isNull(), error);
+            if (state.nLowShares >= MAX_WORKSERVER_LOW_SHARES) {
+                LogPrintf("workserver: dropping client %d after %u low difficulty shares\n", client, state.nLowShares);
+                return false;
+            }
+        }
+    } else {
+        Reply(client, id, NullUniValue, StratumError(20, "Unknown method"));
+    }
+    return true;
+}
+
+UniValue WorkServer::Submit(Client& state, const UniValue& params)
+{
+    // [worker, job id, extranonce2, ntime, nonce]
+    if (params.size() < 5 || !params[1].isStr() || !params[2].isStr())
+        return StratumError(20, "Missing parameters");
+    auto job = std::find_if(m_jobs.begin(), m_jobs.end(), [&](const Job& j) { return j.id == params[1].get_str(); });
+    if (job == m_jobs.end())
+        return StratumError(21, "Job not found");
+    const std::string& extranonce2 = params[2].get_str();
+    uint32_t nTime, nNonce;
+    if (extranonce2.size() != 2 * WORKSERVER_EXTRANONCE2_SIZE || !IsHex(extranonce2) ||
+        !ParseStratumUInt32(params[3], nTime) || !ParseStratumUInt32(params[4], nNonce))
+        return StratumError(20, "Malformed share");
+    if (nTime < job->block.nTime || nTime > GetAdjustedTime() + MAX_FUTURE_BLOCK_TIME)
+        return StratumError(20, "ntime out of range");
+    const std::string key = strprintf("%s:%s:%08x:%08x", job->id, HexStr(ParseHex(extranonce2)), nTime, nNonce);
+    if (state.setSubmitted.count(key))
+        return StratumError(22, "Duplicate share");
+    // Checking a share takes a full scrypt on the event loop, so it is rationed
+    const int64_t nNow = GetTime();
+    if (nNow - state.nShareWindowStart >= 60) {
+        state.nShareWindowStart = nNow;
+        state.nWindowShares = 0;
+    }
+    if (state.nWindowShares >= MAX_WORKSERVER_SHARES_PER_MINUTE)
+        return StratumError(20, "Too many shares, raise the difficulty");
+    ++state.nWindowShares;
+
+    std::vector<unsigned char> extranonce(4);
+    WriteBE32(extranonce.data(), state.nExtraNonce1);
+    const std::vector<unsigned char> vchExtraNonce2 = ParseHex(extranonce2);
+    extranonce.insert(extranonce.end(), vchExtraNonce2.begin(), vchExtraNonce2.end());
+
+    CBlock block = job->block;
+    block.vtx[0] = MakeTransactionRef(MakeCoinbase(block, job->nHeight, state.scriptPubKey, extranonce));
+    block.hashMerkleRoot = BlockMerkleRoot(block);
+    block.nTime = nTime;
+    block.nNonce = nNonce;
+
+    const arith_uint256 hash = UintToArith256(block.GetWorkHash());
+    if (hash > job->shareTarget) {
+        ++state.nLowShares;
+        return StratumError(23, "Low difficulty share");
+    }
+    state.nLowShares = 0;
+    state.setSubmitted.insert(key);
+    ++m_shares_accepted;
+
+    if (hash <= arith_uint256().SetCompact(block.nBits)) {
+        if (m_submit(block)) {
+            ++m_blocks_found;
+            LogPrintf("workserver: block %s found by a client\n", block.GetHash().ToString());
+        } else {
+            LogPrintf("workserver: block %s found by a client was not accepted\n", block.GetHash().ToString());
+        }
+    }
+    return NullUniValue;
+}
+
+//
+// Network side: a libevent loop on its own thread owns the WorkServer, its
+// connections and the job refresh timer.
+//
+
+static struct event_base* g_workserver_base = nullptr;
+static struct evconnlistener* g_workserver_listener = nullptr;
+static struct event* g_workserver_job_event = nullptr;
+static std::thread g_workserver_thread;
+static std::unique_ptr<WorkServer> g_workserver;
+static std::map<int64_t, struct bufferevent*> g_workserver_conns;
+static int64_t g_workserver_next_conn = 0;
+static uint256 g_workserver_job_prev;
+static unsigned int g_workserver_job_tx_updated = 0;
+static int64_t g_workserver_job_time = 0;
+
+/** Wakes the job timer as soon as the tip changes */
+class WorkServerNotifier final : public CValidationInterface
+{
+protected:
+    void UpdatedBlockTip(const CBlockIndex* pindexNew, const CBlockIndex* pindexFork, bool fInitialDownload) override
+    {
+        if (!fInitialDownload)
+            event_active(g_workserver_job_event, EV_TIMEOUT, 0);
+    }
+};
+static std::shared_ptr<WorkServerNotifier> g_workserver_notifier;
+
+static void WorkServerDisconnect(int64_t conn)
+{
+    auto it = g_workserver_conns.find(conn);
+    if (it == g_workserver_conns.end())
+        return;
+    LogPrint(BCLog::RPC, "workserver: client %d disconnected\n", conn);
+    bufferevent_free(it->second);
+    g_workserver_conns.erase(it);
+    g_workserver->RemoveClient(conn);
+}
+
+static void WorkServerSend(int64_t conn, const std::string& line)
+{
+    auto it = g_workserver_conns.find(conn);
+    if (it == g_workserver_conns.end())
+        return;
+    bufferevent_write(it->second, line.data(), line.size());
+    bufferevent_write(it->second, "\n", 1);
+}
+
+static void WorkServerReadCallback(struct bufferevent* bev, void* ctx)
+{
+    const int64_t conn = (int64_t)(intptr_t)ctx;
+    struct evbuffer* input = bufferevent_get_input(bev);
+    size_t n_read_out = 0;
+    char* line;
+    while ((line = evbuffer_readln(input, &n_read_out, EVBUFFER_EOL_CRLF)) != nullptr) {
+        const bool fKeep = n_read_out <= MAX_WORKSERVER_LINE && g_workserver->ProcessLine(conn, std::string(line, n_read_out));
+        free(line);
+        if (!fKeep) {
+            WorkServerDisconnect(conn);
+            return;
+        }
+    }
+    if (evbuffer_get_length(input) > MAX_WORKSERVER_LINE)
+        WorkServerDisconnect(conn);
+}
+
+static void WorkServerEventCallback(struct bufferevent* bev, short what, void* ctx)
+{
+    if (what & (BEV_EVENT_EOF | BEV_EVENT_ERROR))
+        WorkServerDisconnect((int64_t)(intptr_t)ctx);
+}
+
+static void WorkServerAcceptCallback(struct evconnlistener* listener, evutil_socket_t fd, struct sockaddr* addr, int socklen, void* ctx)
+{
+    if (g_workserver_conns.size() >= MAX_WORKSERVER_CLIENTS) {
+        evutil_closesocket(fd);
+        return;
+    }
+    struct bufferevent* bev = bufferevent_socket_new(g_workserver_base, fd, BEV_OPT_CLOSE_ON_FREE);
+    if (!bev) {
+        evutil_closesocket(fd);
+        return;
+    }
+    const int64_t conn = ++g_workserver_next_conn;
+    bufferevent_setcb(bev, WorkServerReadCallback, nullptr, WorkServerEventCallback, (void*)(intptr_t)conn);
+    bufferevent_enable(bev, EV_READ | EV_WRITE);
+    g_workserver_conns[conn] = bev;
+    g_workserver->AddClient(conn);
+    LogPrint(BCLog::RPC, "workserver: client %d connected\n", conn);
+}
+
+/** Build a new job when the tip changed, or the mempool changed and the job is old enough */
+static void WorkServerUpdateJob(evutil_socket_t, short, void*)
+{
+    if (!g_workserver->HasClients() || ::ChainstateActive().IsInitialBlockDownload())
+        return;
+
+    std::unique_ptr<CBlockTemplate> pblocktemplate;
+    int nHeight;
+    bool fClean;
+    {
+        LOCK(cs_main);
+        const CBlockIndex* pindexPrev = ::ChainActive().Tip();
+        fClean = pindexPrev->GetBlockHash() != g_workserver_job_prev;
+        if (!fClean && (mempool.GetTransactionsUpdated() == g_workserver_job_tx_updated || GetTime() - g_workserver_job_time < WORKSERVER_JOB_REFRESH))
+            return;
+        g_workserver_job_tx_updated = mempool.GetTransactionsUpdated();
+        try {
+            // Each client's job pays to its own address, see WorkServer::SendJob()
+            pblocktemplate = BlockAssembler(mempool, Params()).CreateNewBlock(CScript() << OP_TRUE);
+        } catch (const std::runtime_error& e) {
+            LogPrintf("workserver: cannot create a block template: %s\n", e.what());
+            return;
+        }
+        g_workserver_job_prev = pindexPrev->GetBlockHash();
+        g_workserver_job_time = GetTime();
+        nHeight = pindexPrev->nHeight + 1;
+    }
+    g_workserver->NewJob(pblocktemplate->block, nHeight, fClean);
+}
+
+static void WorkServerThread()
+{
+    event_base_dispatch(g_workserver_base);
+}
+
+bool StartWorkServer()
+{
+    assert(!g_workserver_base);
+    const int port = gArgs.GetArg("-workserver", 0);
+    if (port <= 0 || port > 65535)
+        return InitError(strprintf(_("Invalid port specified in %s: '%s'").translated, "-workserver", gArgs.GetArg("-workserver", "")));
+    const std::string bind = gArgs.GetArg("-workserverbind", DEFAULT_WORKSERVER_BIND);
+    CService addr;
+    if (!Lookup(bind, addr, port, false))
+        return InitError(strprintf(_("Cannot resolve -%s address: '%s'").translated, "workserverbind", bind));
+    struct sockaddr_storage sockaddr;
+    socklen_t len = sizeof(sockaddr);
+    if (!addr.GetSockAddr((struct sockaddr*)&sockaddr, &len))
+        return InitError(strprintf(_("Cannot resolve -%s address: '%s'").translated, "workserverbind", bind));
+
+#ifdef WIN32
+    evthread_use_windows_threads();
+#else
+    evthread_use_pthreads();
+#endif
+    g_workserver_base = event_base_new();
+    if (!g_workserver_base)
+        return InitError("workserver: Unable to create event_base");
+    g_workserver_listener = evconnlistener_new_bind(g_workserver_base, WorkServerAcceptCallback, nullptr,
+        LEV_OPT_CLOSE_ON_FREE | LEV_OPT_REUSEABLE, -1, (struct sockaddr*)&sockaddr, len);
+    if (!g_workserver_listener) {
+        event_base_free(g_workserver_base);
+        g_workserver_base = nullptr;
+        return InitError(strprintf(_("Unable to bind to %s on this computer. %s is probably already running.").translated, addr.ToString(), PACKAGE_NAME));
+    }
+
+    g_workserver = MakeUnique<WorkServer>(WorkServerSend, [](CBlock& block) { return CheckWork(&block); });
+    g_workserver_job_event = event_new(g_workserver_base, -1, EV_PERSIST, WorkServerUpdateJob, nullptr);
+    struct timeval tv = {1, 0};
+    event_add(g_workserver_job_event, &tv);
+    g_workserver_notifier = std::make_shared<WorkServerNotifier>();
+    RegisterSharedValidationInterface(g_workserver_notifier);
+
+    LogPrintf("workserver: listening on %s\n", addr.ToString());
+    g_workserver_thread = std::thread(std::bind(&TraceThread<void (*)()>, "workserver", &WorkServerThread));
+    return true;
+}
+
+void InterruptWorkServer()
+{
+    if (g_workserver_base) {
+        event_base_once(g_workserver_base, -1, EV_TIMEOUT, [](evutil_socket_t, short, void*) {
+            event_base_loopbreak(g_workserver_base);
+        }, nullptr, nullptr);
+    }
+}
+
+void StopWorkServer()
+{
+    if (!g_workserver_base)
+        return;
+    UnregisterSharedValidationInterface(g_workserver_notifier);
+    g_workserver_notifier.reset();
+    // Let a tip notification in flight finish with the job event before it is freed
+    SyncWithValidationInterfaceQueue();
+    g_workserver_thread.join();
+    for (const auto& conn : g_workserver_conns)
+        bufferevent_free(conn.second);
+    g_workserver_conns.clear();
+    evconnlistener_free(g_workserver_listener);
+    g_workserver_listener = nullptr;
+    event_free(g_workserver_job_event);
+    g_workserver_job_event = nullptr;
+    g_workserver.reset();
+    event_base_free(g_workserver_base);
+    g_workserver_base = nullptr;
+}
@@ -0,0 +1,127 @@
+// Copyright (c) 2020 The Vericonomy developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_WORKSERVER_H
+#define BITCOIN_WORKSERVER_H
+
+#include <arith_uint256.h>
+#include <primitives/block.h>
+#include <script/script.h>
+#include <uint256.h>
+
+#include <deque>
+#include <functional>
+#include <map>
+#include <set>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+class UniValue;
+
+/** Default for -workserverbind */
+static const char* const DEFAULT_WORKSERVER_BIND = "127.0.0.1";
+/** Longest line a work server client may send */
+static const size_t MAX_WORKSERVER_LINE = 16 * 1024;
+/** Most clients the work server accepts at once */
+static const size_t MAX_WORKSERVER_CLIENTS = 512;
+/** Jobs kept for late submissions, until the tip changes */
+static const size_t MAX_WORKSERVER_JOBS = 8;
+/** Seconds a job stays current while only the mempool changes */
+static const int64_t WORKSERVER_JOB_REFRESH = 60;
+/** Shares are 2^WORKSERVER_SHARE_SHIFT times easier than blocks */
+static const int WORKSERVER_SHARE_SHIFT = 8;
+/** Shares a client may have hashed per minute, each costs a full scrypt on the server */
+static const unsigned int MAX_WORKSERVER_SHARES_PER_MINUTE = 12;
+/** Low difficulty shares in a row after which a client is dropped */
+static const unsigned int MAX_WORKSERVER_LOW_SHARES = 3;
+/** Size of the extranonce the server assigns, and of the one clients roll */
+static const int WORKSERVER_EXTRANONCE1_SIZE = 4;
+static const int WORKSERVER_EXTRANONCE2_SIZE = 4;
+
+/**
+ * Stratum-style job and share bookkeeping of the work server, kept apart
+ * from the network code so it can be driven directly.
+ *
+ * Clients subscribe, authorize with the address blocks should pay to, and
+ * then get a mining.notify for every new job. From it they build the
+ * coinbase as coinb1 + extranonce1 + extranonce2 + coinb2, where
+ * extranonce1 is unique to the client and extranonce2 is theirs to roll,
+ * fold it into the merkle branch and hash headers without asking the node
+ * again until the next job.
+ */
+class WorkServer
+{
+public:
+    /** Send one line of JSON to a client */
+    typedef std::function<void(int64_t client, const std::string& line)> SendFn;
+    /** Process a block that met its target, returns whether it was accepted */
+    typedef std::function<bool(CBlock& block)> SubmitFn;
+
+    WorkServer(SendFn send, SubmitFn submit);
+
+    void AddClient(int64_t client);
+    void RemoveClient(int64_t client);
+    bool HasClients() const { return !m_clients.empty(); }
+
+    /** Handle one line from a client, returns false if it should be disconnected */
+    bool ProcessLine(int64_t client, const std::string& line);
+
+    /**
+     * Publish a job for a block template whose first transaction is the
+     * coinbase. fClean makes clients drop their current work and forgets
+     * older jobs; it is meant for tip changes.
+     */
+    void NewJob(const CBlock& block, int nHeight, bool fClean);
+
+    uint64_t SharesAccepted() const { return m_shares_accepted; }
+    uint64_t BlocksFound() const { return m_blocks_found; }
+
+private:
+    struct Job
+    {
+        std::string id;
+        CBlock block;
+        int nHeight;
+        std::vector<uint256> vMerkleBranch;
+        arith_uint256 shareTarget;
+    };
+
+    struct Client
+    {
+        uint32_t nExtraNonce1;
+        bool fSubscribed{false};
+        bool fAuthorized{false};
+        CScript scriptPubKey;
+        /** Submissions for the current jobs, to reject duplicates */
+        std::set<std::string> setSubmitted;
+        /** Start of the current rate limit minute, and shares hashed in it */
+        int64_t nShareWindowStart{0};
+        unsigned int nWindowShares{0};
+        /** Low difficulty shares since the last good one */
+        unsigned int nLowShares{0};
+    };
+
+    SendFn m_send;
+    SubmitFn m_submit;
+    std::map<int64_t, Client> m_clients;
+    std::deque<Job> m_jobs;
+    uint64_t m_job_counter{0};
+    uint32_t m_extranonce1_counter{0};
+    uint64_t m_shares_accepted{0};
+    uint64_t m_blocks_found{0};
+
+    void Reply(int64_t client, const UniValue& id, const UniValue& result, const UniValue& error);
+    void SendJob(int64_t client, const Client& state, const Job& job, bool fClean);
+    UniValue Submit(Client& state, const UniValue& params);
+};
+
+/** Start the work server on -workserver, returns false if it could not listen */
+bool StartWorkServer();
+/** Interrupt the work server event loop */
+void InterruptWorkServer();
+/** Stop the work server and disconnect its clients */
+void StopWorkServer();
+
+#endif // BITCOIN_WORKSERVER_H
@@ -42,6 +42,16 @@ class RpcMiscTest(BitcoinTestFramework):
         assert_greater_than(memory['chunks_free'], 0)
         assert_equal(memory['used'] + memory['free'], memory['total'])
 
+        self.log.info("test getmemoryinfo blockcache")
+        blockcache = node.getmemoryinfo()['blockcache']
+        assert_equal(blockcache['max_usage'], 32 * 1024 * 1024)
+        assert_greater_than_or_equal(blockcache['max_usage'], blockcache['usage'])
+        node.getblock(node.getbestblockhash())
+        node.getblock(node.getbestblockhash())
+        blockcache_after = node.getmemoryinfo()['blockcache']
+        assert_greater_than(blockcache_after['blocks'], 0)
+        assert_greater_than(blockcache_after['hits'], blockcache['hits'])
+
         self.log.info("test mallocinfo")
         try:
             mallocinfo = node.getmemoryinfo(mode="mallocinfo")